@@ -63,6 +63,11 @@ typedef enum {
 typedef struct monome monome_t; /* opaque data type */
 typedef struct monome_event monome_event_t;
 typedef struct monome_poll_group monome_poll_group_t;
+typedef struct monome_frame monome_frame_t;
+typedef struct monome_ring_frame monome_ring_frame_t;
+typedef struct monome_event_queue monome_event_queue_t;
+typedef struct monome_tx_stats monome_tx_stats_t;
+typedef struct monome_stats monome_stats_t;
 
 typedef void (*monome_event_callback_t)
 	(const monome_event_t *event, void *data);
@@ -94,6 +99,73 @@ struct monome_event {
 monome_t *monome_open(const char *monome_device, ...);
 void monome_close(monome_t *monome);
 
+/**
+ * open `count` serial devices at once, running their handshakes side by
+ * side so that it takes about as long as the slowest one. out[i] is the
+ * device opened from devs[i], or NULL if it couldn't be opened (OSC URLs
+ * can't be, since they need arguments). returns how many were opened.
+ */
+int monome_open_many(const char * const *devs, size_t count,
+                     monome_t **out);
+
+/**
+ * device enumeration
+ */
+
+typedef struct monome_device_info {
+	const char *devpath;
+	const char *serial;
+	const char *proto;
+	const char *friendly;
+
+	/* 0 for a mext device the descriptor cache hasn't seen, since it only
+	   says what size it is once it's opened */
+	int rows, cols;
+} monome_device_info_t;
+
+/**
+ * every monome attached, found in one pass over the system's serial
+ * devices. the list ends with an entry whose devpath is NULL. returns NULL
+ * if the devices couldn't be listed.
+ *
+ * with the descriptor cache enabled, what's found is added to it, so
+ * opening one of the devices doesn't look its serial up again.
+ */
+monome_device_info_t *monome_enumerate(void);
+void monome_enumerate_free(monome_device_info_t *devices);
+
+/**
+ * how long monome_open() waits, in all, for a device to answer the
+ * queries it sends on opening, in milliseconds. 0 restores the default
+ * of one second. opening fails if the device hasn't answered by then.
+ * key and encoder events that arrive in the meantime aren't lost, they're
+ * the first events read from the device.
+ */
+void monome_set_open_timeout(unsigned int msec);
+
+/**
+ * descriptor cache
+ *
+ * with the cache enabled, monome_open() remembers the serial, protocol,
+ * size and name of every tty it opens. opening the same path again skips
+ * asking udev for the serial, and a mext device opens without waiting for
+ * its handshake: the queries are still sent, and the answers are checked
+ * as events are read. an entry the device contradicts is dropped, so the
+ * next open does the full handshake.
+ *
+ * the cache is shared by the whole process and isn't thread-safe.
+ */
+void monome_descriptor_cache_enable(int enable);
+
+/* drop every entry. the cache stays enabled if it was. */
+void monome_descriptor_cache_clear(void);
+
+/* add the entries in the file at `path` and enable the cache. returns the
+ * number of entries read, or MONOME_ERROR_GENERIC if the file couldn't be
+ * opened. */
+int monome_descriptor_cache_load(const char *path);
+int monome_descriptor_cache_save(const char *path);
+
 void monome_set_rotation(monome_t *monome, monome_rotate_t cable);
 monome_rotate_t monome_get_rotation(monome_t *monome);
 
@@ -110,6 +182,78 @@ int monome_unregister_handler(monome_t *monome,
                               monome_event_type_t event_type);
 int monome_event_next(monome_t *monome, monome_event_t *event_buf);
 int monome_event_handle_next(monome_t *monome);
+
+/**
+ * batched event retrieval
+ *
+ * decode up to `max` events that are already buffered or can be read
+ * without blocking. the next_batch variant returns the number of events
+ * stored in `events`, handle_next_batch returns the number dispatched to
+ * registered handlers. both return -1 on error.
+ */
+int monome_event_next_batch(monome_t *monome, monome_event_t *events,
+                            size_t max);
+int monome_event_handle_next_batch(monome_t *monome, size_t max);
+
+/**
+ * event timestamps
+ *
+ * every event carries the time the read() that completed it returned, in
+ * nanoseconds on the clock monome_get_time_ns() reads (CLOCK_MONOTONIC,
+ * or the performance counter on windows). the _ts variant of
+ * monome_event_next_batch() stores it in timestamps[i] for events[i].
+ *
+ * inside a handler, monome_event_get_timestamp() gives it for the event
+ * the handler was passed. for any other event (a copy, or one that
+ * didn't come through a handler) it returns 0. coalesced events keep the
+ * timestamp of the first event folded into them.
+ */
+int monome_event_next_batch_ts(monome_t *monome, monome_event_t *events,
+                               uint64_t *timestamps, size_t max);
+uint64_t monome_event_get_timestamp(const monome_event_t *event);
+uint64_t monome_get_time_ns(void);
+
+/**
+ * event masks
+ *
+ * by default every event a device sends is decoded and delivered.
+ * monome_set_event_mask() limits that to the event types whose
+ * MONOME_EVENT_MASK() bits are set. input for the others is dropped as
+ * it's read, before an event is built, and mext devices skip masked
+ * subsystems (keys, encoders, tilt) without decoding their payload.
+ *
+ * masking MONOME_TILT also switches tilt off on the device for sensors
+ * enabled with monome_tilt_enable(), so it stops sending samples nobody
+ * reads. they're switched back on when MONOME_TILT is unmasked.
+ */
+#define MONOME_EVENT_MASK(type) (1U << (type))
+#define MONOME_EVENT_MASK_ALL   ((1U << MONOME_EVENT_MAX) - 1)
+
+int monome_set_event_mask(monome_t *monome, unsigned int mask);
+unsigned int monome_get_event_mask(monome_t *monome);
+
+/**
+ * input coalescing
+ *
+ * a fast arc spin produces an event per detent, and tilt streams samples
+ * continuously. with MONOME_COALESCE_ENCODER set, the deltas each encoder
+ * produces within one batch (a call to monome_event_next_batch(), or a
+ * poll group wakeup) are summed into a single event, and with
+ * MONOME_COALESCE_TILT only the latest sample per sensor is kept. an
+ * encoder key event ends the sum, so turns and presses stay in order.
+ *
+ * a nonzero `rate_hz` also limits each encoder and sensor to that many
+ * events a second. anything that arrives sooner is held back (summed, or
+ * the latest sample) and delivered once the interval is up, and poll
+ * group waits and monome_event_loop() wake up for it. flags of 0 turn
+ * coalescing off; anything held goes out with the next batch.
+ */
+#define MONOME_COALESCE_ENCODER (1 << 0)
+#define MONOME_COALESCE_TILT    (1 << 1)
+
+int monome_set_coalescing(monome_t *monome, unsigned int flags,
+                          unsigned int rate_hz);
+
 void monome_event_loop(monome_t *monome);
 int monome_get_fd(monome_t *monome);
 
@@ -123,6 +267,255 @@ int monome_poll_group_remove(monome_poll_group_t *group, monome_t *monome);
 int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms);
 void monome_poll_group_loop(monome_poll_group_t *group);
 
+/**
+ * handle whatever input the group's devices have right now, without
+ * blocking. events are taken one device at a time, round-robin, starting
+ * after the device the previous call stopped at. stops after `max_events`
+ * events or once `budget_us` microseconds have passed (0 means no limit
+ * for either). returns 1 if input is still waiting, 0 if everything was
+ * drained, or -1 on error.
+ */
+int monome_poll_group_process(monome_poll_group_t *group, size_t max_events,
+                              unsigned int budget_us);
+
+/**
+ * hotplug
+ *
+ * with hotplug enabled, a poll group opens and adds monomes as they're
+ * plugged in, and removes devices that are unplugged, calling `cb` for
+ * each. a departed device is no longer in the group and can't be used any
+ * more other than to close it, which is up to the app, since the group
+ * may not be the one that opened it. an unplugged device no longer makes
+ * monome_poll_group_wait() fail.
+ *
+ * arrivals are opened from within the wait, which blocks for the
+ * handshake. hotplug can't be enabled on a group an event queue is
+ * reading. returns MONOME_ERROR_UNSUPPORTED where there's no device
+ * monitor (only linux has one so far).
+ */
+typedef enum {
+	MONOME_HOTPLUG_ARRIVED,
+	MONOME_HOTPLUG_DEPARTED
+} monome_hotplug_event_t;
+
+typedef void (*monome_hotplug_callback_t)(monome_poll_group_t *group,
+                                          monome_t *monome,
+                                          monome_hotplug_event_t event,
+                                          void *data);
+
+int monome_poll_group_enable_hotplug(monome_poll_group_t *group,
+                                     monome_hotplug_callback_t cb,
+                                     void *data);
+void monome_poll_group_disable_hotplug(monome_poll_group_t *group);
+
+/**
+ * threaded input
+ *
+ * monome_event_queue_new() starts a thread that reads and decodes every
+ * device in `group` and pushes the events into a ring of `capacity` slots
+ * (0 for a default, rounded up to a power of two). pop and pop_batch never
+ * block or make a system call, so they're safe to use from a realtime
+ * thread. if the ring is full, new events are dropped and counted.
+ *
+ * the fd from monome_event_queue_get_fd() polls readable when events have
+ * been pushed. monome_event_queue_wait() resets it and, with a timeout,
+ * blocks until there are events to pop.
+ *
+ * the group must not be changed while a queue is reading it. pop returns
+ * 1 for an event, 0 if the queue is empty, and -1 once it's empty and the
+ * reader has stopped because of a device error. pop_batch_ts also gives
+ * each event's read timestamp, so the time spent in the ring shows.
+ *
+ * not available on windows, where monome_event_queue_new() returns NULL.
+ */
+monome_event_queue_t *monome_event_queue_new(monome_poll_group_t *group,
+                                             size_t capacity);
+void monome_event_queue_free(monome_event_queue_t *queue);
+int monome_event_queue_pop(monome_event_queue_t *queue, monome_event_t *e);
+size_t monome_event_queue_pop_batch(monome_event_queue_t *queue,
+                                    monome_event_t *events, size_t max);
+size_t monome_event_queue_pop_batch_ts(monome_event_queue_t *queue,
+                                       monome_event_t *events,
+                                       uint64_t *timestamps, size_t max);
+int monome_event_queue_get_fd(monome_event_queue_t *queue);
+int monome_event_queue_wait(monome_event_queue_t *queue, int timeout_ms);
+size_t monome_event_queue_get_dropped(monome_event_queue_t *queue);
+
+/**
+ * output buffering
+ *
+ * while a device is deferred, led commands are encoded into a per-device
+ * buffer instead of being written immediately. monome_flush() sends
+ * everything queued in a single write, which also happens automatically
+ * when the buffer fills up or deferred mode is switched off.
+ */
+int monome_set_deferred(monome_t *monome, int deferred);
+int monome_flush(monome_t *monome);
+
+/**
+ * pending output
+ *
+ * devices are written without blocking. whatever the tty won't take yet
+ * is kept, in order, and sent once it has room: a poll group watches for
+ * that by itself, otherwise poll monome_get_fd() for writability while
+ * `pending` is non-zero and call monome_flush(). if the pending queue is
+ * full, whole writes are dropped rather than split.
+ */
+struct monome_tx_stats {
+	unsigned long queued;   /* writes that couldn't go out straight away */
+	unsigned long dropped;  /* writes thrown away because the queue was full */
+	unsigned long errors;   /* failed writes, including what was pending */
+	size_t pending;         /* bytes still waiting for the device */
+
+	/* see monome_set_output_rate() */
+	unsigned long coalesced; /* led messages made moot before they went out */
+	size_t scheduled;        /* bytes of led messages waiting their turn */
+};
+
+int monome_get_tx_stats(monome_t *monome, monome_tx_stats_t *stats);
+
+/**
+ * performance counters
+ *
+ * off by default, and costing a pointer test per hook while they are.
+ * monome_set_stats() switches them on for a device, and
+ * monome_get_stats() takes a snapshot (all zeroes while they're off).
+ * counters are updated without locking, so a snapshot taken while another
+ * thread is using the device may be a few events out of step between
+ * fields. don't switch stats off while a writer thread or event queue is
+ * running on the device.
+ *
+ * messages are counted by their first byte, which for mext is the
+ * subsystem in the high nibble and the command in the low one. outgoing
+ * messages are counted as the led calls make them, whether or not pacing
+ * later makes them moot.
+ *
+ * the histograms count nanoseconds in MONOME_STATS_BUCKETS log-linear
+ * buckets (four per power of two). monome_stats_bucket_ns() gives a
+ * bucket's lower bound, and monome_stats_percentile() the bucket a
+ * percentile (0 to 100) falls in.
+ */
+#define MONOME_STATS_BUCKETS 128
+
+struct monome_stats {
+	uint64_t bytes_in, bytes_out;
+	uint64_t messages_in, messages_out;
+	uint64_t messages_in_by_header[256];
+	uint64_t messages_out_by_header[256];
+
+	uint64_t reads, writes;   /* read() and write() calls */
+	uint64_t short_writes;    /* writes the tty only took part of */
+	uint64_t write_again;     /* writes it took none of (EAGAIN) */
+
+	uint64_t resyncs;         /* bytes skipped that didn't start a message */
+	uint64_t events_dispatched;
+	uint64_t events_dropped;  /* masked, or with no handler registered */
+
+	/* from the read() that brought an event in to its handler being
+	   called, and how long the handler took */
+	uint64_t read_to_callback[MONOME_STATS_BUCKETS];
+	uint64_t callback_duration[MONOME_STATS_BUCKETS];
+};
+
+int monome_set_stats(monome_t *monome, int enable);
+int monome_get_stats(monome_t *monome, monome_stats_t *stats);
+void monome_reset_stats(monome_t *monome);
+
+uint64_t monome_stats_bucket_ns(unsigned int bucket);
+uint64_t monome_stats_percentile(const uint64_t *histogram, double percentile);
+
+/**
+ * wire tap
+ *
+ * `cb` is called with every chunk of bytes read from the device and every
+ * chunk the device accepted on write, as they pass through, along with
+ * when the read or write returned (see monome_get_time_ns()). output that
+ * the tty only took part of shows up once per part that went out, so the
+ * tap sees exactly what went over the wire, in order. it runs on whichever
+ * thread did the i/o, which may be a writer thread or an event queue's
+ * reader, and mustn't call back into the device. don't change the tap
+ * while one of those threads is running. a NULL `cb` removes the tap.
+ * OSC devices have no wire to tap.
+ */
+typedef enum {
+	MONOME_WIRE_IN,
+	MONOME_WIRE_OUT
+} monome_wire_direction_t;
+
+typedef void (*monome_wire_tap_t)(monome_t *monome,
+                                  monome_wire_direction_t direction,
+                                  uint64_t timestamp, const uint8_t *buf,
+                                  size_t nbyte, void *data);
+
+int monome_set_wire_tap(monome_t *monome, monome_wire_tap_t cb, void *data);
+
+/**
+ * recording and replay
+ *
+ * monome_record_start() writes everything that goes over the device's
+ * wire from then on to a trace file at `path`, with when it happened,
+ * until monome_record_stop() or monome_close(). starting again replaces
+ * the trace being written. like the wire tap, recording happens on the
+ * thread doing the i/o.
+ *
+ * monome_open_replay() opens a recorded trace as if it were the device.
+ * its input is read back into the protocol's decoder at the pace it was
+ * recorded (to within a millisecond), or as fast as it'll go with
+ * MONOME_REPLAY_FAST, and led output is accepted and thrown away. monome_open()
+ * opens "replay:///path/to/trace" at the recorded pace. a replay has no
+ * fd, so it can't join a poll group or run monome_event_loop(). read it
+ * with monome_event_handle_next_batch() and friends, which return -1 once
+ * the trace is used up.
+ */
+#define MONOME_REPLAY_FAST (1 << 0)
+
+int monome_record_start(monome_t *monome, const char *path);
+void monome_record_stop(monome_t *monome);
+
+monome_t *monome_open_replay(const char *path, unsigned int flags);
+
+/**
+ * output pacing
+ *
+ * a serial link only carries so many bytes a second (11520 at 115200
+ * baud), and an app that draws faster than that builds up a backlog of
+ * stale led state in the tty. with an output rate set, led commands wait
+ * in a per-device schedule and are released no faster than
+ * `bytes_per_sec`, and a waiting command is dropped as soon as a later
+ * one overwrites every led it would have changed. what goes out is always
+ * the most recent state, and a new command never waits behind more than
+ * one redraw's worth of output.
+ *
+ * MONOME_OUTPUT_RATE_LINK uses the rate of the device's serial link
+ * (MONOME_ERROR_UNSUPPORTED if it has none, e.g. over OSC), and 0 turns
+ * pacing off again, sending anything still waiting. waiting commands are
+ * released by monome_poll_group_wait(), monome_poll_group_process(),
+ * monome_event_loop() and monome_flush(). pacing has no effect while a
+ * writer thread is running.
+ */
+#define MONOME_OUTPUT_RATE_LINK -1
+
+int monome_set_output_rate(monome_t *monome, int bytes_per_sec);
+
+/**
+ * threaded output
+ *
+ * monome_writer_start() gives the device its own writer thread, fed by a
+ * lock-free queue of up to `capacity` messages (0 for a default). from then
+ * on, led calls may be made from any number of threads at once: each one
+ * queues its encoded messages without locking or making a system call, and
+ * the writer sends everything queued in a single write(). an led call
+ * fails if the queue is full.
+ *
+ * deferred output has no effect while a writer is running. start and stop
+ * the writer while no other thread is using the device; stopping it sends
+ * whatever is still queued. monome_close() stops it for you.
+ *
+ * returns MONOME_ERROR_UNSUPPORTED on windows.
+ */
+int monome_writer_start(monome_t *monome, size_t capacity);
+int monome_writer_stop(monome_t *monome);
+
 /**
  * led grid commands
  */
@@ -139,6 +532,21 @@ int monome_led_row(monome_t *monome, unsigned int x_off, unsigned int y,
                    size_t count, const uint8_t *row_data);
 int monome_led_intensity(monome_t *monome, unsigned int brightness);
 
+/**
+ * urgent led updates
+ *
+ * for feedback that should show up right away, like lighting a key as it's
+ * pressed. these go out ahead of anything still deferred (see
+ * monome_set_deferred()) or waiting to be paced (monome_set_output_rate()),
+ * unless something waiting may change the same led, in which case they
+ * queue behind it like any other call so that the led ends up showing the
+ * newest state. output already handed to the device isn't reordered.
+ */
+int monome_led_set_urgent(monome_t *monome, unsigned int x, unsigned int y,
+                          unsigned int on);
+int monome_led_level_set_urgent(monome_t *monome, unsigned int x,
+                                unsigned int y, unsigned int level);
+
 int monome_led_level_set(monome_t *monome, unsigned int x, unsigned int y,
                          unsigned int level);
 int monome_led_level_all(monome_t *monome, unsigned int level);
@@ -148,6 +556,53 @@ int monome_led_level_row(monome_t *monome, unsigned int x_off,
                          unsigned int y, size_t count, const uint8_t *data);
 int monome_led_level_col(monome_t *monome, unsigned int x, unsigned int y_off,
                          size_t count, const uint8_t *data);
+/**
+ * retained led frames
+ *
+ * a frame is a rows*cols array of levels (0-15, row-major) that you draw
+ * into and then commit. the frame remembers what the device was last sent
+ * and a commit only transmits what changed, choosing between single leds,
+ * rows, columns, whole quads and led_level_all by byte cost. if you draw
+ * on the device by other means, call monome_frame_invalidate() so that
+ * the next commit resends everything.
+ */
+monome_frame_t *monome_frame_new(monome_t *monome);
+void monome_frame_free(monome_frame_t *frame);
+int monome_frame_get_rows(const monome_frame_t *frame);
+int monome_frame_get_cols(const monome_frame_t *frame);
+uint8_t *monome_frame_get_data(monome_frame_t *frame);
+int monome_frame_set(monome_frame_t *frame, unsigned int x, unsigned int y,
+                     unsigned int level);
+int monome_frame_get(const monome_frame_t *frame, unsigned int x,
+                     unsigned int y);
+void monome_frame_clear(monome_frame_t *frame, unsigned int level);
+void monome_frame_invalidate(monome_frame_t *frame);
+int monome_frame_commit(monome_frame_t *frame);
+
+/**
+ * retained ring frames
+ *
+ * the same for an arc: `rings` rings of MONOME_RING_LEDS levels each,
+ * ring-major. a commit sends each changed ring as whichever of single
+ * leds, ranges, ring_all and ring_map is fewest bytes, so moving a
+ * position indicator by one led costs a few bytes rather than a whole
+ * ring_map.
+ */
+#define MONOME_RING_LEDS 64
+
+monome_ring_frame_t *monome_ring_frame_new(monome_t *monome,
+                                           unsigned int rings);
+void monome_ring_frame_free(monome_ring_frame_t *frame);
+int monome_ring_frame_get_rings(const monome_ring_frame_t *frame);
+uint8_t *monome_ring_frame_get_data(monome_ring_frame_t *frame);
+int monome_ring_frame_set(monome_ring_frame_t *frame, unsigned int ring,
+                          unsigned int led, unsigned int level);
+int monome_ring_frame_get(const monome_ring_frame_t *frame, unsigned int ring,
+                          unsigned int led);
+void monome_ring_frame_clear(monome_ring_frame_t *frame, unsigned int level);
+void monome_ring_frame_invalidate(monome_ring_frame_t *frame);
+int monome_ring_frame_commit(monome_ring_frame_t *frame);
+
 int monome_event_get_grid(const monome_event_t *e,
 			  unsigned int *out_x, unsigned int *out_y,
 			  monome_t **monome);
@@ -0,0 +1,377 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "coalesce.h"
+
+/* encoders and tilt sensors numbered past this go through untouched */
+#define COALESCE_SOURCES 8
+
+/* the most one protocol batch can add to `held` once folded: every event
+   plus a flushed delta ahead of each encoder key, and one release per
+   source */
+#define COALESCE_ROOM ((2 * MONOME_EVENT_BATCH_SIZE) + (2 * COALESCE_SOURCES))
+#define COALESCE_HELD ((2 * MONOME_EVENT_BATCH_SIZE) + COALESCE_ROOM)
+
+#define NS_PER_S  1000000000ULL
+#define NS_PER_MS 1000000ULL
+
+typedef struct {
+	/* index in `held` of the event this fill has already put out for the
+	   source, which later ones are folded into, or -1 */
+	int slot;
+
+	/* an event held back until `last` + interval */
+	int waiting;
+	monome_event_t e;
+	uint64_t e_stamp;
+
+	uint64_t last;
+} coalesce_source_t;
+
+struct monome_coalesce {
+	uint_t flags;
+	uint64_t interval; /* ns, 0 for no rate limit */
+
+	/* folded events waiting to be handed out, `count` of them from
+	   `start`. `more` if the protocol may have more buffered. */
+	monome_event_t held[COALESCE_HELD];
+	uint64_t held_stamps[COALESCE_HELD];
+	size_t start, count;
+	int more;
+
+	coalesce_source_t encoders[COALESCE_SOURCES];
+	coalesce_source_t tilt[COALESCE_SOURCES];
+};
+
+/**
+ * private
+ */
+
+static coalesce_source_t *source_for(monome_coalesce_t *c,
+                                     const monome_event_t *e) {
+	switch( e->event_type ) {
+	case MONOME_ENCODER_DELTA:
+	case MONOME_ENCODER_KEY_DOWN:
+	case MONOME_ENCODER_KEY_UP:
+		if( !(c->flags & MONOME_COALESCE_ENCODER)
+		    || e->encoder.number >= COALESCE_SOURCES )
+			return NULL;
+
+		return &c->encoders[e->encoder.number];
+
+	case MONOME_TILT:
+		if( !(c->flags & MONOME_COALESCE_TILT)
+		    || e->tilt.sensor >= COALESCE_SOURCES )
+			return NULL;
+
+		return &c->tilt[e->tilt.sensor];
+
+	default:
+		return NULL;
+	}
+}
+
+static void fold(monome_event_t *into, const monome_event_t *e) {
+	if( e->event_type == MONOME_ENCODER_DELTA )
+		into->encoder.delta += e->encoder.delta;
+	else
+		into->tilt = e->tilt;
+}
+
+static void hold(monome_coalesce_t *c, const monome_event_t *e,
+                 uint64_t stamp) {
+	c->held_stamps[c->start + c->count] = stamp;
+	c->held[c->start + c->count++] = *e;
+}
+
+static void release(monome_coalesce_t *c, coalesce_source_t *src,
+                    uint64_t now) {
+	src->waiting = 0;
+	src->last = now;
+
+	/* deltas that cancelled out */
+	if( src->e.event_type == MONOME_ENCODER_DELTA && !src->e.encoder.delta ) {
+		src->slot = -1;
+		return;
+	}
+
+	src->slot = c->start + c->count;
+	hold(c, &src->e, src->e_stamp);
+}
+
+static int is_due(const monome_coalesce_t *c, const coalesce_source_t *src,
+                  uint64_t now) {
+	return !c->interval || now - src->last >= c->interval;
+}
+
+static void coalesce_batch(monome_coalesce_t *c, const monome_event_t *in,
+                           const uint64_t *stamps, int n, uint64_t now) {
+	coalesce_source_t *src;
+	int i;
+
+	for( i = 0; i < n; i++ ) {
+		if( !(src = source_for(c, &in[i])) ) {
+			hold(c, &in[i], stamps[i]);
+			continue;
+		}
+
+		/* a key on an encoder goes out after any turn that came before
+		   it, and later turns don't get folded in ahead of it */
+		if( in[i].event_type != MONOME_ENCODER_DELTA
+		    && in[i].event_type != MONOME_TILT ) {
+			if( src->waiting )
+				release(c, src, now);
+
+			src->slot = -1;
+			hold(c, &in[i], stamps[i]);
+			continue;
+		}
+
+		if( src->slot >= 0 ) {
+			fold(&c->held[src->slot], &in[i]);
+			continue;
+		}
+
+		if( src->waiting )
+			fold(&src->e, &in[i]);
+		else {
+			src->e = in[i];
+			src->e_stamp = stamps[i];
+			src->waiting = 1;
+		}
+
+		if( is_due(c, src, now) )
+			release(c, src, now);
+	}
+}
+
+static void release_due(monome_coalesce_t *c, uint64_t now) {
+	int i;
+
+	for( i = 0; i < COALESCE_SOURCES; i++ ) {
+		if( c->encoders[i].waiting && is_due(c, &c->encoders[i], now) )
+			release(c, &c->encoders[i], now);
+
+		if( c->tilt[i].waiting && is_due(c, &c->tilt[i], now) )
+			release(c, &c->tilt[i], now);
+	}
+}
+
+static int any_waiting(const monome_coalesce_t *c) {
+	int i;
+
+	for( i = 0; i < COALESCE_SOURCES; i++ )
+		if( c->encoders[i].waiting || c->tilt[i].waiting )
+			return 1;
+
+	return 0;
+}
+
+/* decode everything the protocol has buffered, plus at most one read, and
+   fold it in behind whatever is still held */
+static int coalesce_fill(monome_t *monome, monome_coalesce_t *c) {
+	monome_event_t in[MONOME_EVENT_BATCH_SIZE];
+	uint64_t stamps[MONOME_EVENT_BATCH_SIZE];
+	uint64_t now = m_now_ns();
+	int i, n = 0;
+
+	if( c->start ) {
+		memmove(c->held, &c->held[c->start], c->count * sizeof(*c->held));
+		memmove(c->held_stamps, &c->held_stamps[c->start],
+		        c->count * sizeof(*c->held_stamps));
+		c->start = 0;
+	}
+
+	/* events still held may already have been handed out in part, so
+	   don't fold anything more into them */
+	for( i = 0; i < COALESCE_SOURCES; i++ )
+		c->encoders[i].slot = c->tilt[i].slot = -1;
+
+	while( COALESCE_HELD - c->count >= COALESCE_ROOM ) {
+		if( (n = monome->next_events(monome, in, stamps,
+		                             MONOME_EVENT_BATCH_SIZE)) < 0 )
+			break;
+
+		coalesce_batch(c, in, stamps, n, now);
+
+		if( n < MONOME_EVENT_BATCH_SIZE )
+			break;
+	}
+
+	c->more = (n == MONOME_EVENT_BATCH_SIZE);
+	release_due(c, now);
+
+	return (n < 0) ? n : 0;
+}
+
+/**
+ * internal
+ */
+
+int monome_coalesce_next(monome_t *monome, monome_event_t *events,
+                         uint64_t *stamps, size_t max) {
+	monome_coalesce_t *c = monome->coalesce;
+	int status = 0;
+	size_t i, n;
+
+	if( !c->count || (c->more && c->count < max) )
+		status = coalesce_fill(monome, c);
+
+	n = (c->count < max) ? c->count : max;
+
+	for( i = 0; i < n; i++ ) {
+		events[i] = c->held[c->start + i];
+		events[i].monome = monome;
+
+		if( stamps )
+			stamps[i] = c->held_stamps[c->start + i];
+	}
+
+	c->start += n;
+	c->count -= n;
+
+	/* switched off, and everything it held has gone out */
+	if( !c->flags && !c->count && !any_waiting(c) )
+		monome_coalesce_free(monome);
+
+	if( !n && status < 0 )
+		return status;
+
+	return n;
+}
+
+int monome_coalesce_ready(monome_t *monome) {
+	monome_coalesce_t *c = monome->coalesce;
+	uint64_t now;
+	int i;
+
+	if( !c )
+		return 0;
+
+	if( c->count )
+		return 1;
+
+	now = m_now_ns();
+
+	for( i = 0; i < COALESCE_SOURCES; i++ )
+		if( (c->encoders[i].waiting && is_due(c, &c->encoders[i], now))
+		    || (c->tilt[i].waiting && is_due(c, &c->tilt[i], now)) )
+			return 1;
+
+	return 0;
+}
+
+static int source_timeout(const monome_coalesce_t *c,
+                          const coalesce_source_t *src, uint64_t now,
+                          int timeout_ms) {
+	uint64_t due;
+	int ms;
+
+	if( !src->waiting )
+		return timeout_ms;
+
+	due = src->last + c->interval;
+	ms = (due > now) ? (int) ((due - now + NS_PER_MS - 1) / NS_PER_MS) : 0;
+
+	if( timeout_ms < 0 || ms < timeout_ms )
+		return ms;
+
+	return timeout_ms;
+}
+
+int monome_coalesce_timeout(monome_t *monome, int timeout_ms) {
+	monome_coalesce_t *c = monome->coalesce;
+	uint64_t now;
+	int i;
+
+	if( !c )
+		return timeout_ms;
+
+	if( c->count )
+		return 0;
+
+	now = m_now_ns();
+
+	for( i = 0; i < COALESCE_SOURCES; i++ ) {
+		timeout_ms = source_timeout(c, &c->encoders[i], now, timeout_ms);
+		timeout_ms = source_timeout(c, &c->tilt[i], now, timeout_ms);
+	}
+
+	return timeout_ms;
+}
+
+int monome_coalesce_group_timeout(monome_poll_group_t *group, int timeout_ms) {
+	unsigned int i;
+
+	for( i = 0; i < group->count; i++ )
+		timeout_ms = monome_coalesce_timeout(group->monomes[i], timeout_ms);
+
+	return timeout_ms;
+}
+
+int monome_coalesce_group_dispatch(monome_poll_group_t *group) {
+	unsigned int i;
+	int ret, dispatched = 0;
+
+	for( i = 0; i < group->count; i++ ) {
+		if( !monome_coalesce_ready(group->monomes[i]) )
+			continue;
+
+		ret = monome_event_handle_next_batch(group->monomes[i], SIZE_MAX);
+		if( ret > 0 )
+			dispatched += ret;
+	}
+
+	return dispatched;
+}
+
+void monome_coalesce_free(monome_t *monome) {
+	m_free(monome->coalesce);
+	monome->coalesce = NULL;
+}
+
+/**
+ * public
+ */
+
+int monome_set_coalescing(monome_t *monome, uint_t flags, uint_t rate_hz) {
+	monome_coalesce_t *c;
+
+	if( flags & ~(MONOME_COALESCE_ENCODER | MONOME_COALESCE_TILT) )
+		return MONOME_ERROR_INVALID_ARG;
+
+	if( !(c = monome->coalesce) ) {
+		if( !flags )
+			return MONOME_OK;
+
+		if( !(c = m_calloc(1, sizeof(*c))) )
+			return MONOME_ERROR_GENERIC;
+
+		monome->coalesce = c;
+	}
+
+	/* when switching off, anything held goes out on the next batch and
+	   the state is freed once it's empty */
+	c->flags = flags;
+	c->interval = (flags && rate_hz) ? NS_PER_S / rate_hz : 0;
+	return MONOME_OK;
+}
@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "descriptor.h"
+
+/* one line per device: devpath, serial, protocol, cols, rows and friendly
+   name, separated by tabs. the friendly name runs to the end of the line. */
+#define LINE_MAX_LEN 512
+
+static struct {
+	int enabled;
+
+	monome_descriptor_t *entries;
+	size_t count, capacity;
+} cache;
+
+/**
+ * private
+ */
+
+static void entry_free(monome_descriptor_t *d) {
+	m_free(d->devpath);
+	m_free(d->serial);
+	m_free(d->proto);
+	m_free(d->friendly);
+}
+
+static monome_descriptor_t *entry_find(const char *devpath) {
+	size_t i;
+
+	for( i = 0; i < cache.count; i++ )
+		if( !strcmp(cache.entries[i].devpath, devpath) )
+			return &cache.entries[i];
+
+	return NULL;
+}
+
+static int entry_set(const char *devpath, const char *serial,
+                     const char *proto, const char *friendly,
+                     int rows, int cols) {
+	monome_descriptor_t *d, e = {
+		.devpath  = m_strdup(devpath),
+		.serial   = m_strdup(serial),
+		.proto    = m_strdup(proto),
+		.friendly = m_strdup(friendly ? friendly : ""),
+		.rows = rows,
+		.cols = cols
+	};
+
+	if( !e.devpath || !e.serial || !e.proto || !e.friendly )
+		goto err;
+
+	if( !(d = entry_find(devpath)) ) {
+		if( cache.count == cache.capacity ) {
+			size_t capacity = cache.capacity ? cache.capacity * 2 : 8;
+
+			d = m_realloc(cache.entries, capacity * sizeof(*d));
+			if( !d )
+				goto err;
+
+			cache.entries = d;
+			cache.capacity = capacity;
+		}
+
+		d = &cache.entries[cache.count++];
+	} else
+		entry_free(d);
+
+	*d = e;
+	return 0;
+
+err:
+	entry_free(&e);
+	return -1;
+}
+
+/**
+ * internal
+ */
+
+const monome_descriptor_t *monome_descriptor_lookup(const char *devpath) {
+	if( !cache.enabled )
+		return NULL;
+
+	return entry_find(devpath);
+}
+
+void monome_descriptor_store(monome_t *monome) {
+	if( !cache.enabled || !monome->device || !monome->serial )
+		return;
+
+	entry_set(monome->device, monome->serial, monome->proto,
+	          monome->friendly, monome->rows, monome->cols);
+}
+
+void monome_descriptor_add(const char *devpath, const char *serial,
+                           const char *proto, const char *friendly,
+                           int rows, int cols) {
+	if( !cache.enabled || entry_find(devpath) )
+		return;
+
+	entry_set(devpath, serial, proto, friendly, rows, cols);
+}
+
+void monome_descriptor_forget(const char *devpath) {
+	monome_descriptor_t *d;
+
+	if( !devpath || !(d = entry_find(devpath)) )
+		return;
+
+	entry_free(d);
+	*d = cache.entries[--cache.count];
+}
+
+void monome_descriptor_check(monome_t *monome, monome_descriptor_check_t check) {
+	atomic_store_explicit(&monome->descriptor_check, check,
+	                      memory_order_release);
+}
+
+void monome_descriptor_settle(monome_t *monome) {
+	monome_descriptor_check_t check;
+
+	check = atomic_exchange_explicit(&monome->descriptor_check,
+	                                 DESCRIPTOR_UNCHECKED,
+	                                 memory_order_acquire);
+
+	switch( check ) {
+	case DESCRIPTOR_CONFIRMED:
+		monome_descriptor_store(monome);
+		break;
+
+	case DESCRIPTOR_MISMATCHED:
+		/* take what the device says it is now, and have the next open
+		   ask it again */
+		monome->friendly = monome->reported.friendly;
+		monome->rows = monome->reported.rows;
+		monome->cols = monome->reported.cols;
+
+		monome_descriptor_forget(monome->device);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * public
+ */
+
+void monome_descriptor_cache_enable(int enable) {
+	cache.enabled = !!enable;
+}
+
+void monome_descriptor_cache_clear(void) {
+	size_t i;
+
+	for( i = 0; i < cache.count; i++ )
+		entry_free(&cache.entries[i]);
+
+	m_free(cache.entries);
+	cache.entries = NULL;
+	cache.count = cache.capacity = 0;
+}
+
+int monome_descriptor_cache_load(const char *path) {
+	char line[LINE_MAX_LEN], *fields[6], *p;
+	int i, loaded = 0;
+	FILE *f;
+
+	if( !(f = fopen(path, "r")) )
+		return MONOME_ERROR_GENERIC;
+
+	while( fgets(line, sizeof(line), f) ) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		/* the last field takes the rest of the line */
+		for( p = line, i = 0; i < 6 && p; i++ ) {
+			fields[i] = p;
+
+			if( i < 5 && (p = strchr(p, '\t')) )
+				*p++ = '\0';
+		}
+
+		if( i < 6 || !p )
+			continue;
+
+		if( !entry_set(fields[0], fields[1], fields[2], fields[5],
+		               atoi(fields[4]), atoi(fields[3])) )
+			loaded++;
+	}
+
+	fclose(f);
+	cache.enabled = 1;
+	return loaded;
+}
+
+int monome_descriptor_cache_save(const char *path) {
+	monome_descriptor_t *d;
+	size_t i;
+	FILE *f;
+
+	if( !(f = fopen(path, "w")) )
+		return MONOME_ERROR_GENERIC;
+
+	for( i = 0; i < cache.count; i++ ) {
+		d = &cache.entries[i];
+		fprintf(f, "%s\t%s\t%s\t%d\t%d\t%s\n", d->devpath, d->serial,
+		        d->proto, d->cols, d->rows, d->friendly);
+	}
+
+	if( fclose(f) )
+		return MONOME_ERROR_GENERIC;
+
+	return MONOME_OK;
+}
@@ -0,0 +1,533 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "monobright.h"
+#include "encoder.h"
+
+#define COST_UNAVAILABLE 0xFFFF
+#define IS_BINARY(level) ((level) == 0 || (level) == 15)
+
+typedef enum {
+	QUAD_UNCHANGED,
+	QUAD_ROWS,
+	QUAD_COLS,
+	QUAD_MAP
+} quad_strategy_t;
+
+/* one 8x8 quad, as the device should show it (`next`) and as it does now
+   (`base`, if `known`). both hold levels as the device will display them. */
+typedef struct {
+	uint8_t next[64];
+	uint8_t base[64];
+	int known;
+} encoder_quad_t;
+
+/* mext's varibright commands, for protocols which don't say otherwise */
+static const monome_led_cost_t default_cost = {
+	.level_set = 4,
+	.level_row = 7,
+	.level_col = 7,
+	.level_map = 35,
+	.level_all = 2,
+
+	.ring_set = 4,
+	.ring_all = 3,
+	.ring_map = 34,
+	.ring_range = 5
+};
+
+/**
+ * private
+ */
+
+static uint8_t effective_level(const monome_led_cost_t *cost, uint_t level) {
+	level &= 0xF;
+
+	if( cost->monobright )
+		return reduce_level_to_bit(level) ? 15 : 0;
+
+	return level;
+}
+
+static size_t cmd_cost(uint8_t binary_cost, uint8_t level_cost, int binary) {
+	if( binary && binary_cost )
+		return binary_cost;
+
+	if( level_cost )
+		return level_cost;
+
+	return COST_UNAVAILABLE;
+}
+
+/* `prev` may be NULL, in which case the quad is diffed against `uniform`
+   if that's a level, or treated as entirely changed if it's negative */
+static void quad_load(const monome_led_cost_t *cost, encoder_quad_t *q,
+                      const uint8_t *next, const uint8_t *prev, int uniform,
+                      uint_t cols, uint_t x_off, uint_t y_off) {
+	uint_t x, y, i, src;
+
+	q->known = prev || uniform >= 0;
+
+	for( y = 0; y < 8; y++ ) {
+		for( x = 0; x < 8; x++ ) {
+			i = (y * 8) + x;
+			src = ((y_off + y) * cols) + x_off + x;
+
+			q->next[i] = effective_level(cost, next[src]);
+
+			if( prev )
+				q->base[i] = effective_level(cost, prev[src]);
+			else if( uniform >= 0 )
+				q->base[i] = uniform;
+		}
+	}
+}
+
+#define QUAD_INDEX(is_col, line, i) \
+	((is_col) ? (((i) * 8) + (line)) : (((line) * 8) + (i)))
+
+/* cheapest way to update one row or column of a quad: either every changed
+   led on its own or the whole line at once (*whole). */
+static size_t line_cost(const monome_led_cost_t *cost, const encoder_quad_t *q,
+                        int is_col, uint_t line, int *whole) {
+	size_t leds = 0, all;
+	uint_t i, idx, changed = 0;
+	int binary = 1;
+
+	for( i = 0; i < 8; i++ ) {
+		idx = QUAD_INDEX(is_col, line, i);
+
+		if( !IS_BINARY(q->next[idx]) )
+			binary = 0;
+
+		if( q->known && q->next[idx] == q->base[idx] )
+			continue;
+
+		leds += cmd_cost(cost->set, cost->level_set, IS_BINARY(q->next[idx]));
+		changed++;
+	}
+
+	*whole = 0;
+
+	if( !changed )
+		return 0;
+
+	if( is_col )
+		all = cmd_cost(cost->col, cost->level_col, binary);
+	else
+		all = cmd_cost(cost->row, cost->level_row, binary);
+
+	if( all < leds ) {
+		*whole = 1;
+		return all;
+	}
+
+	return leds;
+}
+
+static int quad_is_binary(const encoder_quad_t *q) {
+	uint_t i;
+
+	for( i = 0; i < 64; i++ )
+		if( !IS_BINARY(q->next[i]) )
+			return 0;
+
+	return 1;
+}
+
+static size_t quad_cost(const monome_led_cost_t *cost, const encoder_quad_t *q,
+                        quad_strategy_t *strategy) {
+	size_t rows = 0, cols = 0, map;
+	uint_t i;
+	int whole;
+
+	for( i = 0; i < 8; i++ ) {
+		rows += line_cost(cost, q, 0, i, &whole);
+		cols += line_cost(cost, q, 1, i, &whole);
+	}
+
+	if( !rows ) {
+		*strategy = QUAD_UNCHANGED;
+		return 0;
+	}
+
+	map = cmd_cost(cost->map, cost->level_map, quad_is_binary(q));
+
+	if( rows <= cols && rows <= map ) {
+		*strategy = QUAD_ROWS;
+		return rows;
+	} else if( cols <= map ) {
+		*strategy = QUAD_COLS;
+		return cols;
+	}
+
+	*strategy = QUAD_MAP;
+	return map;
+}
+
+static size_t frame_cost(const monome_led_cost_t *cost, const uint8_t *next,
+                         const uint8_t *prev, int uniform,
+                         uint_t rows, uint_t cols) {
+	quad_strategy_t strategy;
+	size_t bytes = 0;
+	uint_t x, y;
+	encoder_quad_t q;
+
+	for( y = 0; y < rows; y += 8 ) {
+		for( x = 0; x < cols; x += 8 ) {
+			quad_load(cost, &q, next, prev, uniform, cols, x, y);
+			bytes += quad_cost(cost, &q, &strategy);
+		}
+	}
+
+	return bytes;
+}
+
+static int send_led(monome_t *monome, const monome_led_cost_t *cost,
+                    uint_t x, uint_t y, uint_t level) {
+	if( IS_BINARY(level) && cost->set )
+		return monome_led_set(monome, x, y, !!level);
+
+	return monome_led_level_set(monome, x, y, level);
+}
+
+static int send_line(monome_t *monome, const monome_led_cost_t *cost,
+                     const encoder_quad_t *q, int is_col, uint_t line,
+                     uint_t x_off, uint_t y_off) {
+	uint8_t levels[8], mask;
+	uint_t i;
+	int binary = 1;
+
+	for( i = 0; i < 8; i++ ) {
+		levels[i] = q->next[QUAD_INDEX(is_col, line, i)];
+
+		if( !IS_BINARY(levels[i]) )
+			binary = 0;
+	}
+
+	mask = reduce_levels_to_bitmask(levels);
+
+	if( is_col ) {
+		if( binary && cost->col )
+			return monome_led_col(monome, x_off + line, y_off, 1, &mask);
+
+		return monome_led_level_col(monome, x_off + line, y_off, 8, levels);
+	}
+
+	if( binary && cost->row )
+		return monome_led_row(monome, x_off, y_off + line, 1, &mask);
+
+	return monome_led_level_row(monome, x_off, y_off + line, 8, levels);
+}
+
+static int send_quad(monome_t *monome, const monome_led_cost_t *cost,
+                     const encoder_quad_t *q, uint_t x_off, uint_t y_off) {
+	quad_strategy_t strategy;
+	uint8_t masks[8];
+	uint_t line, i, idx;
+	int is_col, whole, ret;
+
+	quad_cost(cost, q, &strategy);
+
+	switch( strategy ) {
+	case QUAD_UNCHANGED:
+		return 0;
+
+	case QUAD_MAP:
+		if( !(quad_is_binary(q) && cost->map) )
+			return monome_led_level_map(monome, x_off, y_off, q->next);
+
+		for( i = 0; i < 8; i++ )
+			masks[i] = reduce_levels_to_bitmask(&q->next[i * 8]);
+
+		return monome_led_map(monome, x_off, y_off, masks);
+
+	case QUAD_ROWS:
+	case QUAD_COLS:
+		break;
+	}
+
+	is_col = (strategy == QUAD_COLS);
+
+	for( line = 0; line < 8; line++ ) {
+		if( !line_cost(cost, q, is_col, line, &whole) )
+			continue;
+
+		if( whole ) {
+			ret = send_line(monome, cost, q, is_col, line, x_off, y_off);
+			if( ret < 0 )
+				return ret;
+
+			continue;
+		}
+
+		for( i = 0; i < 8; i++ ) {
+			idx = QUAD_INDEX(is_col, line, i);
+
+			if( q->known && q->next[idx] == q->base[idx] )
+				continue;
+
+			ret = send_led(monome, cost, x_off + (idx & 7),
+			               y_off + (idx >> 3), q->next[idx]);
+			if( ret < 0 )
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * rings
+ */
+
+/* what a ring is diffed against. unknown leds get a level no ring can
+   show, so that they always count as changed. */
+static void ring_base(uint8_t *base, const uint8_t *prev, int uniform) {
+	if( prev )
+		memcpy(base, prev, MONOME_RING_LEDS);
+	else
+		memset(base, (uniform >= 0) ? uniform : 0xFF, MONOME_RING_LEDS);
+}
+
+/* starting at the changed led `start`, how far a ring_range at its level
+   can reach without setting anything to the wrong level. *last is the last
+   changed led in that stretch and *changed how many there are. ranges
+   never wrap past the last led, which keeps us clear of firmware that
+   disagrees on how wrapping works. */
+static void ring_run(const uint8_t *next, const uint8_t *base, uint_t start,
+                     uint_t *last, uint_t *changed) {
+	uint_t i;
+
+	*last = start;
+	*changed = 0;
+
+	for( i = start; i < MONOME_RING_LEDS && next[i] == next[start]; i++ ) {
+		if( next[i] == base[i] )
+			continue;
+
+		*last = i;
+		(*changed)++;
+	}
+}
+
+static int ring_run_is_range(const monome_led_cost_t *cost, uint_t changed) {
+	return cost->ring_range && cost->ring_range < changed * cost->ring_set;
+}
+
+static size_t ring_diff_cost(const monome_led_cost_t *cost,
+                             const uint8_t *next, const uint8_t *base) {
+	uint_t i, last, changed;
+	size_t bytes = 0;
+
+	for( i = 0; i < MONOME_RING_LEDS; i++ ) {
+		if( next[i] == base[i] )
+			continue;
+
+		ring_run(next, base, i, &last, &changed);
+
+		if( ring_run_is_range(cost, changed) ) {
+			bytes += cost->ring_range;
+			i = last;
+		} else
+			bytes += cost->ring_set;
+	}
+
+	return bytes;
+}
+
+static int ring_diff_send(monome_t *monome, const monome_led_cost_t *cost,
+                          uint_t ring, const uint8_t *next,
+                          const uint8_t *base) {
+	uint_t i, last, changed;
+	int ret;
+
+	for( i = 0; i < MONOME_RING_LEDS; i++ ) {
+		if( next[i] == base[i] )
+			continue;
+
+		ring_run(next, base, i, &last, &changed);
+
+		if( ring_run_is_range(cost, changed) ) {
+			ret = monome_led_ring_range(monome, ring, i, last, next[i]);
+			i = last;
+		} else
+			ret = monome_led_ring_set(monome, ring, i, next[i]);
+
+		if( ret < 0 )
+			return ret;
+	}
+
+	return 0;
+}
+
+/**
+ * public
+ */
+
+const monome_led_cost_t *monome_encoder_cost(const monome_t *monome) {
+	if( !monome->led_cost.level_set )
+		return &default_cost;
+
+	return &monome->led_cost;
+}
+
+size_t monome_encoder_plan(const monome_led_cost_t *cost,
+                           const uint8_t *next, const uint8_t *prev,
+                           uint_t rows, uint_t cols,
+                           monome_encoder_plan_t *plan) {
+	size_t diff, all, hist[16] = {0}, i;
+	uint_t common = 0;
+
+	plan->use_all = 0;
+	plan->all_level = 0;
+
+	diff = frame_cost(cost, next, prev, -1, rows, cols);
+	if( !diff ) {
+		plan->bytes = 0;
+		return 0;
+	}
+
+	/* the alternative is clearing everything to the most common level
+	   first, so that only the leds which differ from it need sending. */
+	for( i = 0; i < rows * cols; i++ )
+		hist[effective_level(cost, next[i])]++;
+
+	for( i = 1; i < 16; i++ )
+		if( hist[i] > hist[common] )
+			common = i;
+
+	all = cmd_cost(cost->all, cost->level_all, IS_BINARY(common));
+	if( all != COST_UNAVAILABLE )
+		all += frame_cost(cost, next, NULL, common, rows, cols);
+
+	if( all < diff ) {
+		plan->use_all = 1;
+		plan->all_level = common;
+		plan->bytes = all;
+	} else
+		plan->bytes = diff;
+
+	return plan->bytes;
+}
+
+int monome_encoder_send(monome_t *monome, const monome_encoder_plan_t *plan,
+                        const uint8_t *next, const uint8_t *prev,
+                        uint_t rows, uint_t cols) {
+	const monome_led_cost_t *cost = monome_encoder_cost(monome);
+	int uniform = -1, ret;
+	uint_t x, y;
+	encoder_quad_t q;
+
+	if( !plan->bytes )
+		return 0;
+
+	if( plan->use_all ) {
+		if( IS_BINARY(plan->all_level) && cost->all )
+			ret = monome_led_all(monome, !!plan->all_level);
+		else
+			ret = monome_led_level_all(monome, plan->all_level);
+
+		if( ret < 0 )
+			return ret;
+
+		uniform = plan->all_level;
+		prev = NULL;
+	}
+
+	for( y = 0; y < rows; y += 8 ) {
+		for( x = 0; x < cols; x += 8 ) {
+			quad_load(cost, &q, next, prev, uniform, cols, x, y);
+
+			if( (ret = send_quad(monome, cost, &q, x, y)) < 0 )
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+size_t monome_encoder_ring_plan(const monome_led_cost_t *cost,
+                                const uint8_t *next, const uint8_t *prev,
+                                monome_ring_plan_t *plan) {
+	uint8_t base[MONOME_RING_LEDS];
+	size_t best, all;
+	uint_t level;
+
+	plan->use_map = 0;
+	plan->use_all = 0;
+	plan->all_level = 0;
+
+	ring_base(base, prev, -1);
+	best = ring_diff_cost(cost, next, base);
+
+	if( !best ) {
+		plan->bytes = 0;
+		return 0;
+	}
+
+	/* a ring is short enough to try clearing it to every level */
+	for( level = 0; cost->ring_all && level < 16; level++ ) {
+		ring_base(base, NULL, level);
+		all = cost->ring_all + ring_diff_cost(cost, next, base);
+
+		if( all < best ) {
+			plan->use_all = 1;
+			plan->all_level = level;
+			best = all;
+		}
+	}
+
+	if( cost->ring_map && cost->ring_map < best ) {
+		plan->use_map = 1;
+		plan->use_all = 0;
+		best = cost->ring_map;
+	}
+
+	plan->bytes = best;
+	return best;
+}
+
+int monome_encoder_ring_send(monome_t *monome, uint_t ring,
+                             const monome_ring_plan_t *plan,
+                             const uint8_t *next, const uint8_t *prev) {
+	const monome_led_cost_t *cost = monome_encoder_cost(monome);
+	uint8_t base[MONOME_RING_LEDS];
+	int ret;
+
+	if( !plan->bytes )
+		return 0;
+
+	if( plan->use_map )
+		return monome_led_ring_map(monome, ring, next);
+
+	if( plan->use_all ) {
+		ret = monome_led_ring_all(monome, ring, plan->all_level);
+		if( ret < 0 )
+			return ret;
+
+		ring_base(base, NULL, plan->all_level);
+	} else
+		ring_base(base, prev, -1);
+
+	return ring_diff_send(monome, cost, ring, next, base);
+}
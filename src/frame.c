@@ -0,0 +1,244 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "io.h"
+#include "encoder.h"
+
+#define FRAME_INDEX(frame, x, y) (((y) * (frame)->cols) + (x))
+#define RING_INDEX(ring, led) (((ring) * MONOME_RING_LEDS) + (led))
+
+/**
+ * public
+ */
+
+monome_frame_t *monome_frame_new(monome_t *monome) {
+	monome_frame_t *frame;
+	int rows, cols;
+
+	rows = monome_get_rows(monome);
+	cols = monome_get_cols(monome);
+
+	/* grids come in 8x8 quads */
+	if( rows <= 0 || cols <= 0 || rows % 8 || cols % 8 )
+		return NULL;
+
+	if( !(frame = m_calloc(1, sizeof(*frame))) )
+		return NULL;
+
+	frame->levels = m_calloc(2, rows * cols);
+	if( !frame->levels ) {
+		m_free(frame);
+		return NULL;
+	}
+
+	frame->monome = monome;
+	frame->rows = rows;
+	frame->cols = cols;
+	frame->shadow = frame->levels + (rows * cols);
+	frame->valid = 0;
+
+	return frame;
+}
+
+void monome_frame_free(monome_frame_t *frame) {
+	if( !frame )
+		return;
+
+	m_free(frame->levels);
+	m_free(frame);
+}
+
+int monome_frame_get_rows(const monome_frame_t *frame) {
+	return frame->rows;
+}
+
+int monome_frame_get_cols(const monome_frame_t *frame) {
+	return frame->cols;
+}
+
+uint8_t *monome_frame_get_data(monome_frame_t *frame) {
+	return frame->levels;
+}
+
+int monome_frame_set(monome_frame_t *frame, uint_t x, uint_t y,
+                     uint_t level) {
+	if( x >= (uint_t) frame->cols || y >= (uint_t) frame->rows )
+		return MONOME_ERROR_OUT_OF_RANGE;
+
+	frame->levels[FRAME_INDEX(frame, x, y)] = level & 0xF;
+	return MONOME_OK;
+}
+
+int monome_frame_get(const monome_frame_t *frame, uint_t x, uint_t y) {
+	if( x >= (uint_t) frame->cols || y >= (uint_t) frame->rows )
+		return MONOME_ERROR_OUT_OF_RANGE;
+
+	return frame->levels[FRAME_INDEX(frame, x, y)];
+}
+
+void monome_frame_clear(monome_frame_t *frame, uint_t level) {
+	memset(frame->levels, level & 0xF, frame->rows * frame->cols);
+}
+
+void monome_frame_invalidate(monome_frame_t *frame) {
+	frame->valid = 0;
+}
+
+int monome_frame_commit(monome_frame_t *frame) {
+	monome_t *monome = frame->monome;
+	size_t size = frame->rows * frame->cols;
+	monome_encoder_plan_t plan;
+	const uint8_t *prev;
+	int ret;
+
+	if( !monome->led_level )
+		return MONOME_ERROR_UNSUPPORTED;
+
+	if( frame->valid && !memcmp(frame->levels, frame->shadow, size) )
+		return MONOME_OK;
+
+	prev = frame->valid ? frame->shadow : NULL;
+	monome_encoder_plan(monome_encoder_cost(monome), frame->levels, prev,
+	                    frame->rows, frame->cols, &plan);
+
+	monome_io_begin(monome);
+	ret = monome_encoder_send(monome, &plan, frame->levels, prev,
+	                          frame->rows, frame->cols);
+
+	if( monome_io_end(monome) && ret >= 0 )
+		ret = MONOME_ERROR_GENERIC;
+
+	if( ret < 0 ) {
+		/* we don't know how much of the frame made it out */
+		frame->valid = 0;
+		return ret;
+	}
+
+	memcpy(frame->shadow, frame->levels, size);
+	frame->valid = 1;
+	return MONOME_OK;
+}
+
+/**
+ * ring frames
+ */
+
+monome_ring_frame_t *monome_ring_frame_new(monome_t *monome, uint_t rings) {
+	monome_ring_frame_t *frame;
+
+	if( !rings )
+		return NULL;
+
+	if( !(frame = m_calloc(1, sizeof(*frame))) )
+		return NULL;
+
+	frame->levels = m_calloc(2, rings * MONOME_RING_LEDS);
+	if( !frame->levels ) {
+		m_free(frame);
+		return NULL;
+	}
+
+	frame->monome = monome;
+	frame->rings = rings;
+	frame->shadow = frame->levels + (rings * MONOME_RING_LEDS);
+	frame->valid = 0;
+
+	return frame;
+}
+
+void monome_ring_frame_free(monome_ring_frame_t *frame) {
+	if( !frame )
+		return;
+
+	m_free(frame->levels);
+	m_free(frame);
+}
+
+int monome_ring_frame_get_rings(const monome_ring_frame_t *frame) {
+	return frame->rings;
+}
+
+uint8_t *monome_ring_frame_get_data(monome_ring_frame_t *frame) {
+	return frame->levels;
+}
+
+int monome_ring_frame_set(monome_ring_frame_t *frame, uint_t ring, uint_t led,
+                          uint_t level) {
+	if( ring >= frame->rings || led >= MONOME_RING_LEDS )
+		return MONOME_ERROR_OUT_OF_RANGE;
+
+	frame->levels[RING_INDEX(ring, led)] = level & 0xF;
+	return MONOME_OK;
+}
+
+int monome_ring_frame_get(const monome_ring_frame_t *frame, uint_t ring,
+                          uint_t led) {
+	if( ring >= frame->rings || led >= MONOME_RING_LEDS )
+		return MONOME_ERROR_OUT_OF_RANGE;
+
+	return frame->levels[RING_INDEX(ring, led)];
+}
+
+void monome_ring_frame_clear(monome_ring_frame_t *frame, uint_t level) {
+	memset(frame->levels, level & 0xF, frame->rings * MONOME_RING_LEDS);
+}
+
+void monome_ring_frame_invalidate(monome_ring_frame_t *frame) {
+	frame->valid = 0;
+}
+
+int monome_ring_frame_commit(monome_ring_frame_t *frame) {
+	monome_t *monome = frame->monome;
+	monome_ring_plan_t plan;
+	const uint8_t *next, *prev;
+	uint_t ring;
+	int ret = 0;
+
+	if( !monome->led_ring )
+		return MONOME_ERROR_UNSUPPORTED;
+
+	monome_io_begin(monome);
+
+	for( ring = 0; ring < frame->rings && ret >= 0; ring++ ) {
+		next = &frame->levels[RING_INDEX(ring, 0)];
+		prev = frame->valid ? &frame->shadow[RING_INDEX(ring, 0)] : NULL;
+
+		if( prev && !memcmp(next, prev, MONOME_RING_LEDS) )
+			continue;
+
+		monome_encoder_ring_plan(monome_encoder_cost(monome), next, prev,
+		                         &plan);
+		ret = monome_encoder_ring_send(monome, ring, &plan, next, prev);
+	}
+
+	if( monome_io_end(monome) && ret >= 0 )
+		ret = MONOME_ERROR_GENERIC;
+
+	if( ret < 0 ) {
+		frame->valid = 0;
+		return ret;
+	}
+
+	memcpy(frame->shadow, frame->levels, frame->rings * MONOME_RING_LEDS);
+	frame->valid = 1;
+	return MONOME_OK;
+}
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "hotplug.h"
+
+/**
+ * private
+ */
+
+static monome_t *member_by_path(monome_poll_group_t *group, const char *path) {
+	unsigned int i;
+
+	for( i = 0; i < group->count; i++ )
+		if( group->monomes[i]->device
+		    && !strcmp(group->monomes[i]->device, path) )
+			return group->monomes[i];
+
+	return NULL;
+}
+
+/* the callback owns the device from here on, and will usually close it */
+static void departed(monome_poll_group_t *group, monome_t *monome) {
+	monome_hotplug_t *h = group->hotplug;
+
+	monome_poll_group_remove(group, monome);
+	monome->poll_hup = 0;
+
+	h->cb(group, monome, MONOME_HOTPLUG_DEPARTED, h->data);
+}
+
+static int arrived(monome_poll_group_t *group, const char *path) {
+	monome_hotplug_t *h = group->hotplug;
+	monome_t *monome;
+
+	/* the app may have opened it itself, or seen it go and come back
+	   before we did */
+	if( member_by_path(group, path) )
+		return 0;
+
+	/* anything that isn't a monome fails here, before the tty is
+	   opened, since its serial doesn't match the device table */
+	if( !(monome = monome_open(path)) )
+		return 0;
+
+	if( monome_poll_group_add(group, monome) ) {
+		monome_close(monome);
+		return 0;
+	}
+
+	h->cb(group, monome, MONOME_HOTPLUG_ARRIVED, h->data);
+	return 1;
+}
+
+/**
+ * internal
+ */
+
+int monome_hotplug_process(monome_poll_group_t *group) {
+	monome_hotplug_t *h = group->hotplug;
+	monome_t *monome;
+	unsigned int i;
+	char *path;
+	int added, count = 0;
+
+	if( !h )
+		return 0;
+
+	/* departed() reorders the members, so start over after each one */
+	for( i = 0; i < group->count; ) {
+		if( group->monomes[i]->poll_hup ) {
+			departed(group, group->monomes[i]);
+			count++;
+			i = 0;
+		} else
+			i++;
+	}
+
+	if( !h->pending )
+		return count;
+
+	h->pending = 0;
+
+	while( monome_platform_hotplug_next(h->monitor, &path, &added) > 0 ) {
+		if( added )
+			count += arrived(group, path);
+		else if( (monome = member_by_path(group, path)) ) {
+			departed(group, monome);
+			count++;
+		}
+
+		m_free(path);
+	}
+
+	return count;
+}
+
+void monome_hotplug_free(monome_poll_group_t *group) {
+	monome_hotplug_t *h = group->hotplug;
+
+	if( !h )
+		return;
+
+	monome_platform_poll_group_unwatch(group, h->fd);
+	monome_platform_hotplug_free(h->monitor);
+	m_free(h);
+
+	group->hotplug = NULL;
+}
+
+/**
+ * public
+ */
+
+int monome_poll_group_enable_hotplug(monome_poll_group_t *group,
+                                     monome_hotplug_callback_t cb,
+                                     void *data) {
+	monome_hotplug_t *h;
+
+	if( !group || !cb )
+		return MONOME_ERROR_INVALID_ARG;
+
+	/* an event queue's reader thread would be opening devices and calling
+	   back into the app behind its back */
+	if( group->threaded )
+		return MONOME_ERROR_INVALID_ARG;
+
+	if( (h = group->hotplug) ) {
+		h->cb = cb;
+		h->data = data;
+		return MONOME_OK;
+	}
+
+	if( !(h = m_calloc(1, sizeof(*h))) )
+		return MONOME_ERROR_GENERIC;
+
+	if( !(h->monitor = monome_platform_hotplug_new(&h->fd)) ) {
+		m_free(h);
+		return MONOME_ERROR_UNSUPPORTED;
+	}
+
+	if( monome_platform_poll_group_watch(group, h->fd) ) {
+		monome_platform_hotplug_free(h->monitor);
+		m_free(h);
+		return MONOME_ERROR_GENERIC;
+	}
+
+	h->cb = cb;
+	h->data = data;
+	group->hotplug = h;
+	return MONOME_OK;
+}
+
+void monome_poll_group_disable_hotplug(monome_poll_group_t *group) {
+	if( group )
+		monome_hotplug_free(group);
+}
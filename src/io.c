@@ -0,0 +1,364 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "io.h"
+#include "writer.h"
+#include "schedule.h"
+#include "stats.h"
+#include "trace.h"
+#include "replay.h"
+
+/* hand traffic to the wire tap and the recorder, if there are any */
+static void io_observe(monome_t *monome, monome_wire_direction_t direction,
+                       uint64_t ns, const uint8_t *buf, size_t nbyte) {
+	if( monome->tap.cb )
+		monome->tap.cb(monome, direction, ns, buf, nbyte, monome->tap.data);
+
+	if( monome->record )
+		monome_trace_record(monome, direction, ns, buf, nbyte);
+}
+
+/**
+ * receive buffer
+ *
+ * protocols decode straight out of monome->rx and only call
+ * monome_io_fill() once they can't find a complete message in it. since
+ * that means there's at most one partial message sitting in the buffer at
+ * fill time, we compact it down to the front rather than wrapping, and the
+ * kernel gets one contiguous span to read() into.
+ */
+
+ssize_t monome_io_fill(monome_t *monome) {
+	size_t pending = RX_PENDING(monome);
+	ssize_t bytes;
+
+	if( monome->rx.start ) {
+		memmove(monome->rx.buf, RX_DATA(monome), pending);
+		monome->rx.start = 0;
+		monome->rx.end = pending;
+	}
+
+	if( monome->rx.end == sizeof(monome->rx.buf) )
+		return 0;
+
+	if( monome->replay )
+		bytes = monome_replay_read(monome,
+			&monome->rx.buf[monome->rx.end],
+			sizeof(monome->rx.buf) - monome->rx.end);
+	else
+		bytes = monome_platform_read_nonblock(monome,
+			&monome->rx.buf[monome->rx.end],
+			sizeof(monome->rx.buf) - monome->rx.end);
+
+	monome_stats_read(monome, bytes);
+
+	if( bytes > 0 ) {
+		monome->rx.read_ns = m_now_ns();
+		io_observe(monome, MONOME_WIRE_IN, monome->rx.read_ns,
+		           &monome->rx.buf[monome->rx.end], bytes);
+
+		monome->rx.end += bytes;
+	}
+
+	return bytes;
+}
+
+void monome_io_consume(monome_t *monome, size_t nbyte) {
+	monome->rx.start += nbyte;
+
+	if( monome->rx.start >= monome->rx.end )
+		monome->rx.start = monome->rx.end = 0;
+}
+
+/* decode up to `max` events, first from whatever is already buffered and
+   then from at most one read() of whatever the kernel has queued. */
+int monome_io_next_events(monome_t *monome, monome_io_decode_func_t decode,
+                          monome_event_t *events, uint64_t *stamps,
+                          size_t max) {
+	size_t count = 0, used;
+	ssize_t status;
+	int filled = 0, produced;
+
+	while( count < max ) {
+		produced = 0;
+		used = 0;
+
+		if( RX_PENDING(monome) )
+			used = decode(monome, RX_DATA(monome), RX_PENDING(monome),
+			              &events[count], &produced);
+
+		if( used ) {
+			monome_io_consume(monome, used);
+
+			if( produced
+			    && !MONOME_EVENT_WANTED(monome, events[count].event_type) ) {
+				STATS_ADD(monome, events_dropped, 1);
+				produced = 0;
+			}
+
+			if( produced && stamps )
+				stamps[count] = monome->rx.read_ns;
+
+			count += produced;
+			continue;
+		}
+
+		if( filled )
+			break;
+
+		if( (status = monome_io_fill(monome)) <= 0 ) {
+			if( status < 0 && !count )
+				return status;
+			break;
+		}
+
+		filled = 1;
+	}
+
+	return count;
+}
+
+/**
+ * transmit buffer
+ */
+
+ssize_t monome_io_write(monome_t *monome, const uint8_t *buf, size_t nbyte) {
+	monome_stats_message_out(monome, buf[0]);
+
+	/* the writer thread does its own batching, and the transmit buffer
+	   isn't safe to share between the threads that may be calling us */
+	if( monome->writer )
+		return monome_writer_push(monome->writer, buf, nbyte);
+
+	/* an urgent led call goes out ahead of deferred and paced output,
+	   which schedule.h has made sure it doesn't conflict with */
+	if( monome->tx.urgent ) {
+		monome_sched_charge(monome, nbyte);
+		return monome_io_send(monome, buf, nbyte);
+	}
+
+	/* an led call while output is paced */
+	if( monome->sched && monome->sched_key.kind )
+		return monome_sched_push(monome, buf, nbyte);
+
+	if( !monome->tx.deferred && !monome->tx.depth )
+		return monome_io_send(monome, buf, nbyte);
+
+	if( monome->tx.len + nbyte > sizeof(monome->tx.buf) ) {
+		if( monome_io_flush(monome) )
+			return -1;
+
+		if( nbyte > sizeof(monome->tx.buf) )
+			return monome_io_send(monome, buf, nbyte);
+	}
+
+	memcpy(&monome->tx.buf[monome->tx.len], buf, nbyte);
+	monome->tx.len += nbyte;
+	monome_sched_note_buffered(monome);
+
+	return nbyte;
+}
+
+int monome_io_flush(monome_t *monome) {
+	size_t len = monome->tx.len;
+
+	if( !len )
+		return 0;
+
+	monome->tx.len = 0;
+	monome->tx.touched = SCHED_RECT(0, 0, 0, 0);
+
+	if( monome_io_send(monome, monome->tx.buf, len) != len )
+		return -1;
+
+	return 0;
+}
+
+void monome_io_begin(monome_t *monome) {
+	if( monome->writer )
+		return;
+
+	monome->tx.depth++;
+}
+
+int monome_io_end(monome_t *monome) {
+	if( monome->writer )
+		return 0;
+
+	if( --monome->tx.depth || monome->tx.deferred )
+		return 0;
+
+	if( monome_io_flush(monome) )
+		return -1;
+
+	return monome_sched_pump(monome);
+}
+
+/**
+ * pending output
+ *
+ * the fd is non-blocking, so a write() comes up short when the tty's output
+ * buffer is full. rather than lose the rest, it waits in monome->txq, and
+ * everything sent after it queues up behind it so that the device still
+ * sees whole messages in order. while anything is queued, the device's
+ * poll group watches for the fd to become writable and drains it.
+ *
+ * a write that doesn't fit in the queue is dropped whole. the tail of a
+ * write that was partly sent always fits, since the queue was empty when
+ * it started and is bigger than anything we send in one go.
+ */
+
+static void txq_want_output(monome_t *monome, int want) {
+	/* a writer thread waits for output itself, see writer_thread(). the
+	   flag tracks what the poll group was told, so leave it alone. */
+	if( monome->writer || monome->txq.want_output == want )
+		return;
+
+	monome->txq.want_output = want;
+
+	if( monome->group && !monome->group->threaded )
+		monome_platform_poll_group_want_output(monome->group, monome, want);
+}
+
+static int txq_append(monome_t *monome, const uint8_t *buf, size_t nbyte) {
+	size_t pending = TXQ_PENDING(monome);
+
+	if( pending + nbyte > sizeof(monome->txq.buf) )
+		return -1;
+
+	if( monome->txq.end + nbyte > sizeof(monome->txq.buf) ) {
+		memmove(monome->txq.buf, TXQ_DATA(monome), pending);
+		monome->txq.start = 0;
+		monome->txq.end = pending;
+	}
+
+	memcpy(&monome->txq.buf[monome->txq.end], buf, nbyte);
+	monome->txq.end += nbyte;
+	return 0;
+}
+
+/* every write to the platform goes through here, so that the counters,
+   the tap and the recorder see it. a trace being replayed takes anything. */
+static ssize_t io_platform_write(monome_t *monome, const uint8_t *buf,
+                                 size_t nbyte) {
+	ssize_t written;
+
+	if( monome->replay )
+		written = nbyte;
+	else
+		written = monome_platform_write(monome, buf, nbyte);
+
+	monome_stats_write(monome, nbyte, written);
+
+	if( written > 0 && (monome->tap.cb || monome->record) )
+		io_observe(monome, MONOME_WIRE_OUT, m_now_ns(), buf, written);
+
+	return written;
+}
+
+/* a failed write means the device is most likely gone, and what's pending
+   will never make it there */
+static void txq_discard(monome_t *monome) {
+	monome->tx_stats.errors++;
+	monome->txq.start = monome->txq.end = 0;
+	txq_want_output(monome, 0);
+}
+
+int monome_io_drain(monome_t *monome) {
+	ssize_t written;
+
+	while( TXQ_PENDING(monome) ) {
+		written = io_platform_write(monome, TXQ_DATA(monome),
+		                            TXQ_PENDING(monome));
+
+		if( written < 0 ) {
+			txq_discard(monome);
+			return -1;
+		}
+
+		if( !written ) {
+			txq_want_output(monome, 1);
+			return 1;
+		}
+
+		monome->txq.start += written;
+	}
+
+	monome->txq.start = monome->txq.end = 0;
+	txq_want_output(monome, 0);
+	return 0;
+}
+
+int monome_io_drain_wait(monome_t *monome, uint_t msec) {
+	uint64_t deadline = m_now_ns() + (uint64_t) msec * 1000000;
+	uint64_t now;
+	int ret;
+
+	while( (ret = monome_io_drain(monome)) > 0 ) {
+		if( (now = m_now_ns()) >= deadline )
+			break;
+
+		if( monome_platform_wait_for_output(monome,
+		        (deadline - now + 999999) / 1000000) )
+			break;
+	}
+
+	return ret;
+}
+
+ssize_t monome_io_send(monome_t *monome, const uint8_t *buf, size_t nbyte) {
+	ssize_t written = 0;
+
+	/* give whatever is already waiting a chance to go first */
+	if( TXQ_PENDING(monome) && monome_io_drain(monome) < 0 )
+		return -1;
+
+	if( !TXQ_PENDING(monome) ) {
+		if( (written = io_platform_write(monome, buf, nbyte)) < 0 ) {
+			monome->tx_stats.errors++;
+			return -1;
+		}
+
+		if( written == nbyte )
+			return nbyte;
+	}
+
+	if( txq_append(monome, buf + written, nbyte - written) ) {
+		monome->tx_stats.dropped++;
+		return -1;
+	}
+
+	monome->tx_stats.queued++;
+	txq_want_output(monome, 1);
+	return nbyte;
+}
+
+void monome_io_output_ready(monome_poll_group_t *group, monome_t *monome) {
+	/* the writer thread owns the queue. just stop the group waking up. */
+	if( monome->writer ) {
+		monome->txq.want_output = 0;
+		monome_platform_poll_group_want_output(group, monome, 0);
+		return;
+	}
+
+	monome_io_drain(monome);
+}
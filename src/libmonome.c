@@ -31,6 +31,14 @@
 #include "platform.h"
 #include "rotation.h"
 #include "devices.h"
+#include "io.h"
+#include "schedule.h"
+#include "coalesce.h"
+#include "descriptor.h"
+#include "hotplug.h"
+#include "stats.h"
+#include "trace.h"
+#include "replay.h"
 
 #ifndef LIBSUFFIX
 #define LIBSUFFIX ".so"
@@ -40,6 +48,18 @@
 #define LIBDIR "/usr/lib"
 #endif
 
+/* monome_open() treats the rest of a device that starts with this as the
+   path of a trace to replay */
+#define REPLAY_SCHEME "replay://"
+
+/* how long monome_close() waits for pending output to drain */
+#define CLOSE_DRAIN_MS 250
+
+/* how long monome_open() gives a device to answer, unless told otherwise */
+#define DEFAULT_OPEN_TIMEOUT_MS 1000
+
+static uint_t open_timeout = DEFAULT_OPEN_TIMEOUT_MS;
+
 /**
  * private
  */
@@ -55,21 +75,18 @@ static monome_devmap_t *map_serial_to_device(const char *serial) {
 	return NULL;
 }
 
-/**
- * public
- */
-
-monome_t *monome_open(const char *dev, ...) {
+/* everything monome_open() does that's safe to run on another thread.
+   the descriptor cache isn't, so `*cached` has been looked up already, and
+   is cleared if it turns out to be stale. */
+static monome_t *open_device(const char *dev,
+                             const monome_descriptor_t **cached,
+                             va_list arguments) {
 	monome_t *monome;
 	monome_devmap_t *m;
 
-	va_list arguments;
 	char *serial, *proto;
 	int error;
 
-	if( !dev )
-		return NULL;
-
 	serial = NULL;
 	m = NULL;
 
@@ -78,13 +95,29 @@ monome_t *monome_open(const char *dev, ...) {
 		/* assume that the device is a tty...let's probe and see what device
 		   we're dealing with */
 
-		if( !(serial = monome_platform_get_dev_serial(dev)) )
-			return NULL;
+		if( *cached && !strcmp((*cached)->proto, "mext") ) {
+			/* we've opened this one before, no need to ask udev. if
+			   something else is there now, the handshake finds out. */
+			if( !(serial = m_strdup((*cached)->serial)) )
+				return NULL;
+		} else {
+			/* nothing else checks who it's talking to, so the entry is
+			   only any use if it's for the serial that's there now */
+			if( !(serial = monome_platform_get_dev_serial(dev)) )
+				return NULL;
+
+			if( *cached && strcmp((*cached)->serial, serial) )
+				*cached = NULL;
+		}
 
 		if( (m = map_serial_to_device(serial)) )
 			proto = m->proto;
 		else
-			return NULL;
+			goto err_proto;
+
+		/* an entry that no longer agrees with the device table is stale */
+		if( *cached && strcmp((*cached)->proto, proto) )
+			*cached = NULL;
 	} else
 		/* otherwise, we'll assume that what we have is an OSC URL.
 
@@ -95,9 +128,12 @@ monome_t *monome_open(const char *dev, ...) {
 	if( !(monome = monome_platform_load_protocol(proto)) )
 		goto err_proto;
 
-	va_start(arguments, dev);
+	monome->open_timeout = open_timeout;
+	monome->descriptor = *cached;
+
 	error = monome->open(monome, dev, serial, m, arguments);
-	va_end(arguments);
+
+	monome->descriptor = NULL;
 
 	if( error )
 		goto err_open;
@@ -108,7 +144,9 @@ monome_t *monome_open(const char *dev, ...) {
 		goto err_nomem;
 
 	monome->rotation = MONOME_ROTATE_0;
-	if( serial ) m_free(serial);
+
+	/* the protocol kept `serial` as monome->serial, which monome_close()
+	   frees */
 	return monome;
 
 err_nomem:
@@ -123,9 +161,321 @@ err_proto:
 	return NULL;
 }
 
+/* a trace, opened by its protocol as though it were the device it was
+   recorded from. see replay.h */
+static monome_t *open_replay(const char *dev, const char *path, uint_t flags,
+                             ...) {
+	monome_descriptor_t descriptor = {0};
+	monome_trace_header_t header;
+	monome_replay_t *replay;
+	monome_devmap_t *m;
+	monome_t *monome;
+	va_list arguments;
+	char *serial;
+	int error;
+
+	if( !(replay = monome_replay_new(path, flags, &header)) )
+		return NULL;
+
+	/* the device table has to agree on what it was */
+	if( !(m = map_serial_to_device(header.serial))
+	    || strcmp(m->proto, header.proto) )
+		goto err_proto;
+
+	if( !(serial = m_strdup(header.serial)) )
+		goto err_proto;
+
+	if( !(monome = monome_platform_load_protocol(m->proto)) )
+		goto err_load;
+
+	/* so that mext takes its id and size from the trace, rather than
+	   waiting for a handshake nobody will answer */
+	descriptor.devpath = (char *) dev;
+	descriptor.serial = serial;
+	descriptor.proto = m->proto;
+	descriptor.friendly = header.friendly;
+	descriptor.rows = header.rows;
+	descriptor.cols = header.cols;
+
+	monome->replay = replay;
+	monome->descriptor = &descriptor;
+
+	va_start(arguments, flags);
+	error = monome->open(monome, dev, serial, m, arguments);
+	va_end(arguments);
+
+	monome->descriptor = NULL;
+
+	if( error ) {
+		monome_platform_free(monome);
+		goto err_load;
+	}
+
+	monome->proto = m->proto;
+	monome->link_rate = header.link_rate;
+	monome->rotation = MONOME_ROTATE_0;
+
+	/* monome_close() frees the replay from here on */
+	if( !(monome->device = m_strdup(dev)) ) {
+		monome_close(monome);
+		return NULL;
+	}
+
+	return monome;
+
+err_load:
+	m_free(serial);
+err_proto:
+	monome_replay_free(replay);
+	return NULL;
+}
+
+/* for opening a tty, which takes no arguments */
+static monome_t *open_tty(const char *dev,
+                          const monome_descriptor_t **cached, ...) {
+	monome_t *monome;
+	va_list arguments;
+
+	va_start(arguments, cached);
+	monome = open_device(dev, cached, arguments);
+	va_end(arguments);
+
+	return monome;
+}
+
+/* whether to store what the device said once it's open. a mext device
+   opened from a complete cache entry is stored once it has answered
+   instead, see mext.c */
+static int open_needs_store(const monome_descriptor_t *cached) {
+	return !cached || !DESCRIPTOR_HAS_SIZE(cached);
+}
+
+typedef struct {
+	const char *dev;
+	const monome_descriptor_t *cached;
+	monome_t *monome;
+	m_thread_t *thread;
+	int store;
+} open_job_t;
+
+static void *open_job(void *arg) {
+	open_job_t *job = arg;
+
+	job->monome = open_tty(job->dev, &job->cached);
+	job->store = open_needs_store(job->cached);
+	return NULL;
+}
+
+typedef struct {
+	monome_device_info_t *list;
+	size_t count, capacity;
+	int failed;
+} enumeration_t;
+
+static void enumerate_found(const char *path, const char *serial, void *arg) {
+	enumeration_t *e = arg;
+	const monome_descriptor_t *cached;
+	monome_device_info_t *info;
+	monome_devmap_t *m;
+
+	/* only the ttys that are monomes, so that nobody has to open the rest
+	   to find out */
+	if( e->failed || !*serial || !(m = map_serial_to_device(serial)) )
+		return;
+
+	/* always leave room for the terminating entry */
+	if( e->count + 1 >= e->capacity ) {
+		size_t capacity = e->capacity ? e->capacity * 2 : 8;
+
+		if( !(info = m_realloc(e->list, capacity * sizeof(*info))) ) {
+			e->failed = 1;
+			return;
+		}
+
+		e->list = info;
+		e->capacity = capacity;
+	}
+
+	info = &e->list[e->count];
+	info->proto = m->proto;
+	info->cols  = m->dimensions.cols;
+	info->rows  = m->dimensions.rows;
+
+	/* a mext device only says what size it is when asked, so go by what
+	   it said last time, if it's the same device */
+	cached = monome_descriptor_lookup(path);
+
+	if( cached && !strcmp(cached->serial, serial)
+	    && !strcmp(cached->proto, m->proto) && DESCRIPTOR_HAS_SIZE(cached) ) {
+		info->cols = cached->cols;
+		info->rows = cached->rows;
+		info->friendly = m_strdup(cached->friendly);
+	} else
+		info->friendly = m_strdup(m->friendly);
+
+	info->devpath = m_strdup(path);
+	info->serial  = m_strdup(serial);
+
+	if( !info->devpath || !info->serial || !info->friendly ) {
+		m_free((char *) info->devpath);
+		m_free((char *) info->serial);
+		m_free((char *) info->friendly);
+		e->failed = 1;
+		return;
+	}
+
+	/* so monome_open() needn't look the serial up again */
+	monome_descriptor_add(path, serial, m->proto, m->friendly,
+	                      m->dimensions.rows, m->dimensions.cols);
+
+	e->count++;
+}
+
+/**
+ * public
+ */
+
+monome_device_info_t *monome_enumerate(void) {
+	enumeration_t e = {NULL, 0, 0, 0};
+
+	if( monome_platform_enumerate(enumerate_found, &e) || e.failed ) {
+		if( e.list )
+			e.list[e.count].devpath = NULL;
+
+		monome_enumerate_free(e.list);
+		return NULL;
+	}
+
+	if( !e.list && !(e.list = m_malloc(sizeof(*e.list))) )
+		return NULL;
+
+	memset(&e.list[e.count], 0, sizeof(*e.list));
+	return e.list;
+}
+
+void monome_enumerate_free(monome_device_info_t *devices) {
+	monome_device_info_t *info;
+
+	if( !devices )
+		return;
+
+	for( info = devices; info->devpath; info++ ) {
+		m_free((char *) info->devpath);
+		m_free((char *) info->serial);
+		m_free((char *) info->friendly);
+	}
+
+	m_free(devices);
+}
+
+monome_t *monome_open(const char *dev, ...) {
+	const monome_descriptor_t *cached = NULL;
+	monome_t *monome;
+	va_list arguments;
+
+	if( !dev )
+		return NULL;
+
+	if( !strncmp(dev, REPLAY_SCHEME, strlen(REPLAY_SCHEME)) )
+		return open_replay(dev, dev + strlen(REPLAY_SCHEME), 0);
+
+	if( !strstr(dev, "://") )
+		cached = monome_descriptor_lookup(dev);
+
+	va_start(arguments, dev);
+	monome = open_device(dev, &cached, arguments);
+	va_end(arguments);
+
+	if( monome && open_needs_store(cached) )
+		monome_descriptor_store(monome);
+
+	return monome;
+}
+
+int monome_open_many(const char * const *devs, size_t count, monome_t **out) {
+	open_job_t *jobs;
+	size_t i;
+	int opened = 0;
+
+	if( !(jobs = m_calloc(count ? count : 1, sizeof(*jobs))) ) {
+		for( i = 0; i < count; i++ )
+			out[i] = NULL;
+
+		return MONOME_ERROR_GENERIC;
+	}
+
+	/* the cache is only touched from this thread, before and after */
+	for( i = 0; i < count; i++ ) {
+		jobs[i].dev = devs[i];
+
+		/* an OSC device needs arguments we don't have */
+		if( !devs[i] || strstr(devs[i], "://") )
+			continue;
+
+		jobs[i].cached = monome_descriptor_lookup(devs[i]);
+
+		/* where there aren't threads, this opens one device at a time */
+		if( !(jobs[i].thread = m_thread_start(open_job, &jobs[i])) )
+			open_job(&jobs[i]);
+	}
+
+	for( i = 0; i < count; i++ )
+		if( jobs[i].thread )
+			m_thread_join(jobs[i].thread);
+
+	/* storing may move entries the jobs were opened from, so not until
+	   every one of them is done with its entry */
+	for( i = 0; i < count; i++ ) {
+		if( (out[i] = jobs[i].monome) ) {
+			if( jobs[i].store )
+				monome_descriptor_store(out[i]);
+
+			opened++;
+		}
+	}
+
+	m_free(jobs);
+	return opened;
+}
+
+monome_t *monome_open_replay(const char *path, uint_t flags) {
+	monome_t *monome;
+	char *dev;
+
+	if( !path || flags & ~MONOME_REPLAY_FAST )
+		return NULL;
+
+	if( !(dev = m_malloc(strlen(REPLAY_SCHEME) + strlen(path) + 1)) )
+		return NULL;
+
+	strcpy(dev, REPLAY_SCHEME);
+	strcat(dev, path);
+
+	monome = open_replay(dev, path, flags);
+	m_free(dev);
+	return monome;
+}
+
+void monome_set_open_timeout(uint_t msec) {
+	open_timeout = msec ? msec : DEFAULT_OPEN_TIMEOUT_MS;
+}
+
 void monome_close(monome_t *monome) {
 	assert(monome);
 
+	if( monome->writer )
+		monome_writer_stop(monome);
+
+	monome_sched_free(monome);
+	monome_coalesce_free(monome);
+	monome_io_flush(monome);
+
+	/* give anything the tty hadn't taken yet a moment to go out */
+	monome_io_drain_wait(monome, CLOSE_DRAIN_MS);
+	monome_stats_free(monome);
+	monome_trace_stop(monome);
+	monome_descriptor_settle(monome);
+
 	if( monome->serial )
 		m_free((char *) monome->serial);
 
@@ -133,6 +483,7 @@ void monome_close(monome_t *monome) {
 		m_free((char *) monome->device);
 
 	monome->close(monome);
+	monome_replay_free(monome->replay);
 	monome_platform_free(monome);
 }
 
@@ -194,27 +545,85 @@ int monome_unregister_handler(monome_t *monome,
 }
 
 int monome_event_next(monome_t *monome, monome_event_t *e) {
-	e->monome = monome;
+	return monome_event_next_batch(monome, e, 1);
+}
+
+int monome_event_next_batch(monome_t *monome, monome_event_t *events,
+                            size_t max) {
+	return monome_event_next_batch_ts(monome, events, NULL, max);
+}
+
+int monome_event_next_batch_ts(monome_t *monome, monome_event_t *events,
+                               uint64_t *timestamps, size_t max) {
+	int i, count;
+
+	if( !max )
+		return 0;
+
+	if( monome->coalesce )
+		count = monome_coalesce_next(monome, events, timestamps, max);
+	else if( (count = monome->next_events(monome, events, timestamps,
+	                                      max)) > 0 )
+		for( i = 0; i < count; i++ )
+			events[i].monome = monome;
 
-	return monome->next_event(monome, e);
+	/* an event queue's reader thread mustn't touch the cache. it's
+	   settled when the queue is freed instead. */
+	if( !monome->group || !monome->group->threaded )
+		monome_descriptor_settle(monome);
+
+	return count;
+}
+
+uint64_t monome_event_get_timestamp(const monome_event_t *e) {
+	monome_t *monome = e->monome;
+
+	if( !monome || monome->dispatching != e )
+		return 0;
+
+	return monome->dispatching_ns;
+}
+
+uint64_t monome_get_time_ns(void) {
+	return m_now_ns();
 }
 
 int monome_event_handle_next(monome_t *monome) {
-	monome_callback_t *handler;
 	monome_event_t e;
+	uint64_t stamp;
 	int status;
 
-	status = monome_event_next(monome, &e);
+	status = monome_event_next_batch_ts(monome, &e, &stamp, 1);
 	if (status <= 0)
 		return status;
 
-	handler = &monome->handlers[e.event_type];
+	return monome_stats_dispatch(monome, &e, stamp);
+}
 
-	if( !handler->cb )
-		return 0;
+int monome_event_handle_next_batch(monome_t *monome, size_t max) {
+	monome_event_t events[MONOME_EVENT_BATCH_SIZE];
+	uint64_t stamps[MONOME_EVENT_BATCH_SIZE];
+	size_t want, handled = 0;
+	int i, count, dispatched = 0;
 
-	handler->cb(&e, handler->data);
-	return 1;
+	/* protocols read at most once per call, so a short batch means
+	   there's nothing more to be had without blocking. */
+	do {
+		want = max - handled;
+		if( want > MONOME_EVENT_BATCH_SIZE )
+			want = MONOME_EVENT_BATCH_SIZE;
+
+		count = monome_event_next_batch_ts(monome, events, stamps, want);
+		if( count < 0 )
+			return dispatched ? dispatched : count;
+
+		for( i = 0; i < count; i++ )
+			dispatched += monome_stats_dispatch(monome, &events[i], stamps[i]);
+
+		handled += count;
+	} while( count == want && handled < max );
+
+	return dispatched;
 }
 
 int monome_get_fd(monome_t *monome) {
@@ -237,13 +646,28 @@ monome_poll_group_t *monome_poll_group_new(void) {
 
 	group->capacity = MONOME_POLL_GROUP_INITIAL_CAP;
 	group->count = 0;
+
+	if( monome_platform_poll_group_init(group) ) {
+		m_free(group->monomes);
+		m_free(group);
+		return NULL;
+	}
+
 	return group;
 }
 
 void monome_poll_group_free(monome_poll_group_t *group) {
+	unsigned int i;
+
 	if( !group )
 		return;
 
+	for( i = 0; i < group->count; i++ )
+		if( group->monomes[i]->group == group )
+			group->monomes[i]->group = NULL;
+
+	monome_hotplug_free(group);
+	monome_platform_poll_group_free(group);
 	m_free(group->monomes);
 	m_free(group);
 }
@@ -260,15 +684,19 @@ int monome_poll_group_add(monome_poll_group_t *group, monome_t *monome) {
 			return MONOME_ERROR_INVALID_ARG;
 
 	if( group->count == group->capacity ) {
-		new_arr = realloc(group->monomes,
-		                  group->capacity * 2 * sizeof(monome_t *));
+		new_arr = m_realloc(group->monomes,
+		                    group->capacity * 2 * sizeof(monome_t *));
 		if( !new_arr )
 			return MONOME_ERROR_GENERIC;
 		group->monomes = new_arr;
 		group->capacity *= 2;
 	}
 
+	if( monome_platform_poll_group_add(group, monome) )
+		return MONOME_ERROR_GENERIC;
+
 	group->monomes[group->count++] = monome;
+	monome->group = group;
 	return MONOME_OK;
 }
 
@@ -280,6 +708,11 @@ int monome_poll_group_remove(monome_poll_group_t *group, monome_t *monome) {
 
 	for( i = 0; i < group->count; i++ ) {
 		if( group->monomes[i] == monome ) {
+			monome_platform_poll_group_remove(group, monome);
+
+			if( monome->group == group )
+				monome->group = NULL;
+
 			group->monomes[i] = group->monomes[group->count - 1];
 			group->count--;
 			return MONOME_OK;
@@ -289,8 +722,183 @@ int monome_poll_group_remove(monome_poll_group_t *group, monome_t *monome) {
 	return MONOME_ERROR_INVALID_ARG;
 }
 
+static int poll_group_dispatch_one(monome_t *monome) {
+	monome_event_t e;
+	uint64_t stamp;
+	int count;
+
+	if( (count = monome_event_next_batch_ts(monome, &e, &stamp, 1)) <= 0 )
+		return count;
+
+	monome_stats_dispatch(monome, &e, stamp);
+	return 1;
+}
+
+int monome_poll_group_process(monome_poll_group_t *group, size_t max_events,
+                              unsigned int budget_us) {
+	uint64_t deadline = 0;
+	size_t handled = 0;
+	unsigned int i, idle;
+	monome_t *monome;
+	int nready, ret;
+
+	if( !group || (!group->count && !group->hotplug) )
+		return -1;
+
+	monome_sched_group_pump(group);
+
+	if( monome_platform_poll_group_ready(group, 0) < 0 )
+		return -1;
+
+	/* before walking the members, since this adds and removes them */
+	monome_hotplug_process(group);
+
+	/* anything already sitting in a receive buffer, or held back by
+	   coalescing and now due, counts as ready too */
+	for( nready = 0, i = 0; i < group->count; i++ ) {
+		monome = group->monomes[i];
+		monome->poll_ready |= RX_PENDING(monome)
+			|| monome_coalesce_ready(monome);
+		nready += monome->poll_ready;
+	}
+
+	if( budget_us )
+		deadline = m_now_ns() + ((uint64_t) budget_us * 1000);
+
+	/* one event per ready device per lap, picking up where the last call
+	   left off, so that a chatty device can't starve the others. */
+	for( idle = 0; nready && idle < group->count; ) {
+		if( group->cursor >= group->count )
+			group->cursor = 0;
+
+		monome = group->monomes[group->cursor++];
+		if( !monome->poll_ready ) {
+			/* a handler may have removed a device from the group, so
+			   don't trust nready to reach zero on its own */
+			idle++;
+			continue;
+		}
+
+		idle = 0;
+
+		if( (ret = poll_group_dispatch_one(monome)) < 0 )
+			return -1;
+
+		if( !ret ) {
+			monome->poll_ready = 0;
+			nready--;
+			continue;
+		}
+
+		if( max_events && ++handled >= max_events )
+			break;
+
+		if( deadline && m_now_ns() >= deadline )
+			break;
+	}
+
+	for( i = 0; i < group->count; i++ )
+		if( group->monomes[i]->poll_ready )
+			return 1;
+
+	return 0;
+}
+
+int monome_set_deferred(monome_t *monome, int deferred) {
+	monome->tx.deferred = !!deferred;
+
+	if( !deferred )
+		return monome_flush(monome);
+
+	return MONOME_OK;
+}
+
+int monome_flush(monome_t *monome) {
+	if( monome_io_flush(monome) )
+		return MONOME_ERROR_GENERIC;
+
+	if( !monome->writer && monome_io_drain(monome) < 0 )
+		return MONOME_ERROR_GENERIC;
+
+	if( monome_sched_pump(monome) )
+		return MONOME_ERROR_GENERIC;
+
+	return MONOME_OK;
+}
+
+int monome_get_tx_stats(monome_t *monome, monome_tx_stats_t *stats) {
+	if( !monome || !stats )
+		return MONOME_ERROR_INVALID_ARG;
+
+	*stats = monome->tx_stats;
+	stats->pending = TXQ_PENDING(monome);
+	stats->scheduled = monome_sched_pending(monome);
+	return MONOME_OK;
+}
+
+int monome_set_wire_tap(monome_t *monome, monome_wire_tap_t cb, void *data) {
+	if( !monome )
+		return MONOME_ERROR_INVALID_ARG;
+
+	monome->tap.cb = cb;
+	monome->tap.data = data;
+	return MONOME_OK;
+}
+
 #define REQUIRE(capability) if (!monome->capability) return MONOME_ERROR_UNSUPPORTED
 
+/**
+ * led calls tell the output scheduler which leds they're about to change,
+ * see schedule.h. devices round map, row and column offsets down to a
+ * multiple of 8, and series rows and columns always span the whole
+ * device, so what a call touches and what it's sure to cover can differ.
+ */
+
+#define FLOOR8(v) ((v) & ~7u)
+
+static monome_sched_rect_t sched_rect(uint_t x0, uint_t y0,
+                                      uint_t x1, uint_t y1) {
+	return SCHED_RECT((x0 > 0xFFFF) ? 0xFFFF : x0, (y0 > 0xFFFF) ? 0xFFFF : y0,
+	                  (x1 > 0xFFFF) ? 0xFFFF : x1, (y1 > 0xFFFF) ? 0xFFFF : y1);
+}
+
+static void sched_led(monome_t *monome, uint_t x, uint_t y) {
+	monome_sched_rect_t r = sched_rect(x, y, x + 1, y + 1);
+	monome_sched_begin(monome, SCHED_GRID, r, r);
+}
+
+static void sched_all(monome_t *monome, monome_sched_kind_t kind) {
+	monome_sched_begin(monome, kind, SCHED_RECT_ALL, SCHED_RECT_ALL);
+}
+
+static void sched_map(monome_t *monome, uint_t x_off, uint_t y_off) {
+	monome_sched_begin(monome, SCHED_GRID,
+		sched_rect(FLOOR8(x_off), FLOOR8(y_off), x_off + 8, y_off + 8),
+		sched_rect(x_off, y_off, FLOOR8(x_off) + 8, FLOOR8(y_off) + 8));
+}
+
+static void sched_row(monome_t *monome, uint_t x_off, uint_t y, size_t leds) {
+	monome_sched_begin(monome, SCHED_GRID,
+		sched_rect(0, y, 0xFFFF, y + 1),
+		sched_rect(x_off, y, FLOOR8(x_off) + leds, y + 1));
+}
+
+static void sched_col(monome_t *monome, uint_t x, uint_t y_off, size_t leds) {
+	monome_sched_begin(monome, SCHED_GRID,
+		sched_rect(x, 0, x + 1, 0xFFFF),
+		sched_rect(x, y_off, x + 1, FLOOR8(y_off) + leds));
+}
+
+static void sched_ring(monome_t *monome, uint_t ring, uint_t led0,
+                       uint_t led1, int exact) {
+	monome_sched_rect_t r = sched_rect(led0, ring, led1, ring + 1);
+
+	if( exact )
+		monome_sched_begin(monome, SCHED_RING, r, r);
+	else
+		monome_sched_begin(monome, SCHED_RING, r, SCHED_RECT(0, 0, 0, 0));
+}
+
 #define CHECK_BOUNDS(x, y) \
 	do { \
 		if ((x) >= (uint_t)monome_get_cols(monome) || \
@@ -301,7 +909,16 @@ int monome_poll_group_remove(monome_poll_group_t *group, monome_t *monome) {
 int monome_led_set(monome_t *monome, uint_t x, uint_t y, uint_t on) {
 	REQUIRE(led);
 	CHECK_BOUNDS(x, y);
-	return monome->led->set(monome, x, y, on);
+	sched_led(monome, x, y);
+	return monome_sched_end(monome, monome->led->set(monome, x, y, on));
+}
+
+int monome_led_set_urgent(monome_t *monome, uint_t x, uint_t y, uint_t on) {
+	REQUIRE(led);
+	CHECK_BOUNDS(x, y);
+	sched_led(monome, x, y);
+	monome_sched_urgent(monome);
+	return monome_sched_end(monome, monome->led->set(monome, x, y, on));
 }
 
 int monome_led_on(monome_t *monome, uint_t x, uint_t y) {
@@ -314,7 +931,8 @@ int monome_led_off(monome_t *monome, uint_t x, uint_t y) {
 
 int monome_led_all(monome_t *monome, uint_t status) {
 	REQUIRE(led);
-	return monome->led->all(monome, status);
+	sched_all(monome, SCHED_GRID);
+	return monome_sched_end(monome, monome->led->all(monome, status));
 }
 
 int monome_led_map(monome_t *monome, uint_t x_off, uint_t y_off,
@@ -323,7 +941,9 @@ int monome_led_map(monome_t *monome, uint_t x_off, uint_t y_off,
 	if (x_off >= (uint_t)monome_get_cols(monome) ||
 	    y_off >= (uint_t)monome_get_rows(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led->map(monome, x_off, y_off, data);
+	sched_map(monome, x_off, y_off);
+	return monome_sched_end(monome,
+		monome->led->map(monome, x_off, y_off, data));
 }
 
 int monome_led_row(monome_t *monome, uint_t x_off, uint_t y,
@@ -331,7 +951,9 @@ int monome_led_row(monome_t *monome, uint_t x_off, uint_t y,
 	REQUIRE(led);
 	if (y >= (uint_t)monome_get_rows(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led->row(monome, x_off, y, count, data);
+	sched_row(monome, x_off, y, count * 8);
+	return monome_sched_end(monome,
+		monome->led->row(monome, x_off, y, count, data));
 }
 
 int monome_led_col(monome_t *monome, uint_t x, uint_t y_off,
@@ -339,23 +961,40 @@ int monome_led_col(monome_t *monome, uint_t x, uint_t y_off,
 	REQUIRE(led);
 	if (x >= (uint_t)monome_get_cols(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led->col(monome, x, y_off, count, data);
+	sched_col(monome, x, y_off, count * 8);
+	return monome_sched_end(monome,
+		monome->led->col(monome, x, y_off, count, data));
 }
 
 int monome_led_intensity(monome_t *monome, uint_t brightness) {
 	REQUIRE(led);
-	return monome->led->intensity(monome, brightness);
+	sched_all(monome, SCHED_GRID_INTENSITY);
+	return monome_sched_end(monome,
+		monome->led->intensity(monome, brightness));
 }
 
 int monome_led_level_set(monome_t *monome, uint_t x, uint_t y, uint_t level) {
 	REQUIRE(led_level);
 	CHECK_BOUNDS(x, y);
-	return monome->led_level->set(monome, x, y, level);
+	sched_led(monome, x, y);
+	return monome_sched_end(monome,
+		monome->led_level->set(monome, x, y, level));
+}
+
+int monome_led_level_set_urgent(monome_t *monome, uint_t x, uint_t y,
+                                uint_t level) {
+	REQUIRE(led_level);
+	CHECK_BOUNDS(x, y);
+	sched_led(monome, x, y);
+	monome_sched_urgent(monome);
+	return monome_sched_end(monome,
+		monome->led_level->set(monome, x, y, level));
 }
 
 int monome_led_level_all(monome_t *monome, uint_t level) {
 	REQUIRE(led_level);
-	return monome->led_level->all(monome, level);
+	sched_all(monome, SCHED_GRID);
+	return monome_sched_end(monome, monome->led_level->all(monome, level));
 }
 
 int monome_led_level_map(monome_t *monome, uint_t x_off, uint_t y_off,
@@ -364,7 +1003,9 @@ int monome_led_level_map(monome_t *monome, uint_t x_off, uint_t y_off,
 	if (x_off >= (uint_t)monome_get_cols(monome) ||
 	    y_off >= (uint_t)monome_get_rows(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led_level->map(monome, x_off, y_off, data);
+	sched_map(monome, x_off, y_off);
+	return monome_sched_end(monome,
+		monome->led_level->map(monome, x_off, y_off, data));
 }
 
 int monome_led_level_row(monome_t *monome, uint_t x_off, uint_t y,
@@ -372,7 +1013,9 @@ int monome_led_level_row(monome_t *monome, uint_t x_off, uint_t y,
 	REQUIRE(led_level);
 	if (y >= (uint_t)monome_get_rows(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led_level->row(monome, x_off, y, count, data);
+	sched_row(monome, x_off, y, count & ~7u);
+	return monome_sched_end(monome,
+		monome->led_level->row(monome, x_off, y, count, data));
 }
 
 int monome_led_level_col(monome_t *monome, uint_t x, uint_t y_off,
@@ -380,7 +1023,9 @@ int monome_led_level_col(monome_t *monome, uint_t x, uint_t y_off,
 	REQUIRE(led_level);
 	if (x >= (uint_t)monome_get_cols(monome))
 		return MONOME_ERROR_OUT_OF_RANGE;
-	return monome->led_level->col(monome, x, y_off, count, data);
+	sched_col(monome, x, y_off, count & ~7u);
+	return monome_sched_end(monome,
+		monome->led_level->col(monome, x, y_off, count, data));
 }
 
 int monome_event_get_grid(const monome_event_t *e, unsigned int *out_x, unsigned int *out_y, monome_t **monome) {
@@ -393,36 +1038,99 @@ int monome_event_get_grid(const monome_event_t *e, unsigned int *out_x, unsigned
 int monome_led_ring_set(monome_t *monome, uint_t ring, uint_t led,
                         uint_t level) {
 	REQUIRE(led_ring);
-	return monome->led_ring->set(monome, ring, led, level);
+	sched_ring(monome, ring, led, led + 1, 1);
+	return monome_sched_end(monome,
+		monome->led_ring->set(monome, ring, led, level));
 }
 
 int monome_led_ring_all(monome_t *monome, uint_t ring, uint_t level) {
 	REQUIRE(led_ring);
-	return monome->led_ring->all(monome, ring, level);
+	sched_ring(monome, ring, 0, SCHED_RING_LEDS, 1);
+	return monome_sched_end(monome,
+		monome->led_ring->all(monome, ring, level));
 }
 
 int monome_led_ring_map(monome_t *monome, uint_t ring, const uint8_t *levels) {
 	REQUIRE(led_ring);
-	return monome->led_ring->map(monome, ring, levels);
+	sched_ring(monome, ring, 0, SCHED_RING_LEDS, 1);
+	return monome_sched_end(monome,
+		monome->led_ring->map(monome, ring, levels));
 }
 
 int monome_led_ring_range(monome_t *monome, uint_t ring, uint_t start,
                           uint_t end, uint_t level) {
 	REQUIRE(led_ring);
-	return monome->led_ring->range(monome, ring, start, end, level);
+	/* ranges may wrap around, so don't count on covering anything */
+	sched_ring(monome, ring, 0, SCHED_RING_LEDS, 0);
+	return monome_sched_end(monome,
+		monome->led_ring->range(monome, ring, start, end, level));
 }
 
 int monome_led_ring_intensity(monome_t *monome, uint_t brightness) {
 	REQUIRE(led_ring);
-	return monome->led_ring->intensity(monome, brightness);
+	sched_all(monome, SCHED_RING_INTENSITY);
+	return monome_sched_end(monome,
+		monome->led_ring->intensity(monome, brightness));
 }
 
+/* sensors past what tilt_enabled can track are passed straight through */
+#define TILT_SENSOR_BIT(sensor) \
+	(((sensor) < sizeof(uint_t) * 8) ? (1U << (sensor)) : 0)
+
 int monome_tilt_enable(monome_t *monome, uint_t sensor) {
 	REQUIRE(tilt);
+	monome->tilt_enabled |= TILT_SENSOR_BIT(sensor);
+
+	/* turned on for real once something listens, see
+	   monome_set_event_mask() */
+	if( !MONOME_EVENT_WANTED(monome, MONOME_TILT)
+	    && TILT_SENSOR_BIT(sensor) )
+		return MONOME_OK;
+
 	return monome->tilt->enable(monome, sensor);
 }
 
 int monome_tilt_disable(monome_t *monome, uint_t sensor) {
 	REQUIRE(tilt);
+	monome->tilt_enabled &= ~TILT_SENSOR_BIT(sensor);
 	return monome->tilt->disable(monome, sensor);
 }
+
+/**
+ * event masks
+ */
+
+int monome_set_event_mask(monome_t *monome, uint_t mask) {
+	int had_tilt, want_tilt, ret = MONOME_OK;
+	uint_t sensor;
+	int status;
+
+	if( mask & ~MONOME_EVENT_MASK_ALL )
+		return MONOME_ERROR_INVALID_ARG;
+
+	had_tilt = MONOME_EVENT_WANTED(monome, MONOME_TILT);
+	monome->event_ignore = MONOME_EVENT_MASK_ALL & ~mask;
+	want_tilt = MONOME_EVENT_WANTED(monome, MONOME_TILT);
+
+	if( !monome->tilt || had_tilt == want_tilt )
+		return MONOME_OK;
+
+	for( sensor = 0; sensor < sizeof(uint_t) * 8; sensor++ ) {
+		if( !(monome->tilt_enabled & (1U << sensor)) )
+			continue;
+
+		if( want_tilt )
+			status = monome->tilt->enable(monome, sensor);
+		else
+			status = monome->tilt->disable(monome, sensor);
+
+		if( status < 0 )
+			ret = MONOME_ERROR_GENERIC;
+	}
+
+	return ret;
+}
+
+uint_t monome_get_event_mask(monome_t *monome) {
+	return MONOME_EVENT_MASK_ALL & ~monome->event_ignore;
+}
@@ -17,12 +17,19 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <errno.h>
+#include <glob.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
 
 #include "internal.h"
 #include "platform.h"
+#include "io.h"
+#include "schedule.h"
+#include "coalesce.h"
 
 char *monome_platform_get_dev_serial(const char *path) {
 	char *serial;
@@ -44,6 +51,30 @@ char *monome_platform_get_dev_serial(const char *path) {
 	return strdup(serial + 1);
 }
 
+int monome_platform_enumerate(monome_platform_found_t found, void *arg) {
+	char *serial;
+	glob_t gb;
+	size_t i;
+
+	if( glob("/dev/tty.usbserial-*", 0, NULL, &gb) == GLOB_NOSPACE )
+		return -1;
+
+	if( glob("/dev/tty.usbmodem*", GLOB_APPEND, NULL, &gb) == GLOB_NOSPACE ) {
+		globfree(&gb);
+		return -1;
+	}
+
+	for( i = 0; i < gb.gl_pathc; i++ ) {
+		if( (serial = monome_platform_get_dev_serial(gb.gl_pathv[i])) ) {
+			found(gb.gl_pathv[i], serial, arg);
+			free(serial);
+		}
+	}
+
+	globfree(&gb);
+	return 0;
+}
+
 int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	struct timeval timeout[1];
 	fd_set rfds[1];
@@ -69,9 +100,126 @@ int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	return 0;
 }
 
+int monome_platform_wait_for_output(monome_t *monome, uint_t msec) {
+	struct timeval timeout[1];
+	fd_set wfds[1];
+	fd_set efds[1];
+	int fd;
+
+	fd = monome_get_fd(monome);
+
+	timeout->tv_sec  = msec / 1000;
+	timeout->tv_usec = (msec - (timeout->tv_sec * 1000)) * 1000;
+
+	FD_ZERO(wfds);
+	FD_SET(fd, wfds);
+	FD_ZERO(efds);
+	FD_SET(fd, efds);
+
+	if( !select(fd + 1, NULL, wfds, efds, timeout) )
+		return 1;
+
+	if( FD_ISSET(fd, efds) )
+		return -1;
+
+	return 0;
+}
+
+/* select() is rebuilt from the member list on every wait, so there's no
+   per-group state to keep. members with output pending (txq.want_output)
+   are watched for writability too. */
+
+int monome_platform_poll_group_init(monome_poll_group_t *group) {
+	group->fd = -1;
+	return 0;
+}
+
+void monome_platform_poll_group_free(monome_poll_group_t *group) {
+}
+
+int monome_platform_poll_group_add(monome_poll_group_t *group,
+                                   monome_t *monome) {
+	return 0;
+}
+
+void monome_platform_poll_group_remove(monome_poll_group_t *group,
+                                      monome_t *monome) {
+}
+
+void monome_platform_poll_group_want_output(monome_poll_group_t *group,
+                                            monome_t *monome, int want) {
+}
+
+/* there's no device monitor here yet, so hotplug can't be enabled */
+
+int monome_platform_poll_group_watch(monome_poll_group_t *group, int fd) {
+	return -1;
+}
+
+void monome_platform_poll_group_unwatch(monome_poll_group_t *group, int fd) {
+}
+
+monome_platform_hotplug_t *monome_platform_hotplug_new(int *fd) {
+	return NULL;
+}
+
+void monome_platform_hotplug_free(monome_platform_hotplug_t *monitor) {
+}
+
+int monome_platform_hotplug_next(monome_platform_hotplug_t *monitor,
+                                 char **path, int *arrived) {
+	return 0;
+}
+
+int monome_platform_poll_group_ready(monome_poll_group_t *group,
+                                     int timeout_ms) {
+	struct timeval tv, *tvp = NULL;
+	fd_set rfds, wfds, efds;
+	unsigned int i;
+	int maxfd, fd, ret;
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_ZERO(&efds);
+	maxfd = -1;
+
+	for( i = 0; i < group->count; i++ ) {
+		fd = monome_get_fd(group->monomes[i]);
+		FD_SET(fd, &rfds);
+		FD_SET(fd, &efds);
+		if( group->monomes[i]->txq.want_output && !group->threaded )
+			FD_SET(fd, &wfds);
+		if( fd > maxfd )
+			maxfd = fd;
+	}
+
+	if( timeout_ms >= 0 ) {
+		tv.tv_sec  = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+		tvp = &tv;
+	}
+
+	if( (ret = select(maxfd + 1, &rfds, &wfds, &efds, tvp)) < 0 )
+		return (errno == EINTR) ? 0 : -1;
+
+	for( i = 0; i < group->count; i++ ) {
+		fd = monome_get_fd(group->monomes[i]);
+
+		if( FD_ISSET(fd, &efds) )
+			return -1;
+
+		if( FD_ISSET(fd, &wfds) )
+			monome_io_output_ready(group, group->monomes[i]);
+
+		group->monomes[i]->poll_ready = FD_ISSET(fd, &rfds);
+	}
+
+	return ret;
+}
+
 int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 	struct timeval tv, *tvp;
-	fd_set rfds, efds;
+	fd_set rfds, wfds, efds;
 	unsigned int i;
 	int maxfd, fd, ret, dispatched;
 
@@ -79,6 +227,7 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 		return -1;
 
 	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
 	FD_ZERO(&efds);
 	maxfd = -1;
 
@@ -86,10 +235,18 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 		fd = monome_get_fd(group->monomes[i]);
 		FD_SET(fd, &rfds);
 		FD_SET(fd, &efds);
+		if( group->monomes[i]->txq.want_output )
+			FD_SET(fd, &wfds);
 		if( fd > maxfd )
 			maxfd = fd;
 	}
 
+	/* wake up in time to release paced output, see schedule.h */
+	timeout_ms = monome_sched_group_timeout(group, timeout_ms);
+
+	/* and input held back by coalescing, see coalesce.h */
+	timeout_ms = monome_coalesce_group_timeout(group, timeout_ms);
+
 	if( timeout_ms < 0 ) {
 		tvp = NULL;
 	} else {
@@ -98,23 +255,31 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 		tvp = &tv;
 	}
 
-	ret = select(maxfd + 1, &rfds, NULL, &efds, tvp);
+	ret = select(maxfd + 1, &rfds, &wfds, &efds, tvp);
 	if( ret < 0 )
 		return -1;
-	if( ret == 0 )
-		return 0;
+	if( ret == 0 ) {
+		dispatched = monome_coalesce_group_dispatch(group);
+		monome_sched_group_pump(group);
+		return dispatched;
+	}
 
 	dispatched = 0;
 	for( i = 0; i < group->count; i++ ) {
 		fd = monome_get_fd(group->monomes[i]);
 		if( FD_ISSET(fd, &efds) )
 			return -1;
+		if( FD_ISSET(fd, &wfds) )
+			monome_io_output_ready(group, group->monomes[i]);
 		if( FD_ISSET(fd, &rfds) ) {
-			ret = monome_event_handle_next(group->monomes[i]);
+			ret = monome_event_handle_next_batch(group->monomes[i], SIZE_MAX);
 			if( ret > 0 )
 				dispatched += ret;
 		}
 	}
 
+	dispatched += monome_coalesce_group_dispatch(group);
+
+	monome_sched_group_pump(group);
 	return dispatched;
 }
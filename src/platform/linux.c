@@ -14,12 +14,20 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <errno.h>
 #include <poll.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 
 #include <monome.h>
 #include "internal.h"
 #include "platform.h"
+#include "io.h"
+#include "schedule.h"
+#include "coalesce.h"
+#include "hotplug.h"
 
 int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	struct pollfd fds[1];
@@ -39,46 +47,194 @@ int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	return 0;
 }
 
-int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
-	struct pollfd *fds;
-	unsigned int i;
-	int ret, dispatched;
+int monome_platform_wait_for_output(monome_t *monome, uint_t msec) {
+	struct pollfd fds[1];
 
-	if( !group || !group->count )
-		return -1;
+	fds->fd = monome_get_fd(monome);
+	fds->events = POLLOUT;
 
-	fds = calloc(group->count, sizeof(struct pollfd));
-	if( !fds )
+	if( !poll(fds, 1, msec) )
+		return 1;
+
+	if( fds->revents & (POLLERR | POLLHUP) )
 		return -1;
 
-	for( i = 0; i < group->count; i++ ) {
-		fds[i].fd = monome_get_fd(group->monomes[i]);
-		fds[i].events = POLLIN;
+	return 0;
+}
+
+/**
+ * poll groups
+ *
+ * members are registered with epoll once, when they're added, so a wait
+ * doesn't have to rebuild anything and only walks the devices that are
+ * actually ready. the hotplug monitor, if there is one, is registered with
+ * a NULL data pointer, and `ready` always has room for it.
+ */
+
+#define MAX_EVENTS(group) ((group)->count + !!(group)->hotplug)
+
+/* a member's fd reported an error or hung up. with hotplug enabled it's
+   treated as unplugged, otherwise an error fails the wait. */
+static int member_gone(monome_poll_group_t *group, const struct epoll_event *ev) {
+	if( group->hotplug && (ev->events & (EPOLLERR | EPOLLHUP)) ) {
+		((monome_t *) ev->data.ptr)->poll_hup = 1;
+		return 1;
 	}
 
-	ret = poll(fds, group->count, timeout_ms);
-	if( ret < 0 ) {
-		free(fds);
+	return (ev->events & EPOLLERR) ? -1 : 0;
+}
+
+int monome_platform_poll_group_init(monome_poll_group_t *group) {
+	if( (group->fd = epoll_create1(EPOLL_CLOEXEC)) < 0 )
+		return -1;
+
+	group->ready = m_calloc(group->capacity + 1, sizeof(struct epoll_event));
+	if( !group->ready ) {
+		close(group->fd);
 		return -1;
 	}
-	if( ret == 0 ) {
-		free(fds);
-		return 0;
+
+	group->ready_cap = group->capacity + 1;
+	return 0;
+}
+
+void monome_platform_poll_group_free(monome_poll_group_t *group) {
+	close(group->fd);
+	m_free(group->ready);
+}
+
+int monome_platform_poll_group_add(monome_poll_group_t *group,
+                                   monome_t *monome) {
+	struct epoll_event ev = {
+		.events = EPOLLIN | (monome->txq.want_output ? EPOLLOUT : 0),
+		.data.ptr = monome
+	};
+	void *ready;
+
+	if( group->ready_cap < group->capacity + 1 ) {
+		ready = m_realloc(group->ready,
+		                  (group->capacity + 1) * sizeof(struct epoll_event));
+		if( !ready )
+			return -1;
+
+		group->ready = ready;
+		group->ready_cap = group->capacity + 1;
 	}
 
-	dispatched = 0;
-	for( i = 0; i < group->count; i++ ) {
-		if( fds[i].revents & POLLERR ) {
-			free(fds);
+	return epoll_ctl(group->fd, EPOLL_CTL_ADD, monome_get_fd(monome), &ev);
+}
+
+void monome_platform_poll_group_remove(monome_poll_group_t *group,
+                                      monome_t *monome) {
+	/* the fd may already be closed, which drops it from the epoll set
+	   on its own, so there's nothing useful to do with an error here. */
+	epoll_ctl(group->fd, EPOLL_CTL_DEL, monome_get_fd(monome), NULL);
+}
+
+void monome_platform_poll_group_want_output(monome_poll_group_t *group,
+                                            monome_t *monome, int want) {
+	struct epoll_event ev = {
+		.events = EPOLLIN | (want ? EPOLLOUT : 0),
+		.data.ptr = monome
+	};
+
+	epoll_ctl(group->fd, EPOLL_CTL_MOD, monome_get_fd(monome), &ev);
+}
+
+int monome_platform_poll_group_watch(monome_poll_group_t *group, int fd) {
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = NULL
+	};
+
+	return epoll_ctl(group->fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void monome_platform_poll_group_unwatch(monome_poll_group_t *group, int fd) {
+	epoll_ctl(group->fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int monome_platform_poll_group_ready(monome_poll_group_t *group,
+                                     int timeout_ms) {
+	struct epoll_event *ready = group->ready;
+	unsigned int i;
+	int nready, gone;
+
+	for( i = 0; i < group->count; i++ )
+		group->monomes[i]->poll_ready = 0;
+
+	nready = epoll_wait(group->fd, ready, MAX_EVENTS(group), timeout_ms);
+	if( nready < 0 )
+		return (errno == EINTR) ? 0 : -1;
+
+	for( i = 0; i < (unsigned int) nready; i++ ) {
+		if( !ready[i].data.ptr ) {
+			group->hotplug->pending = 1;
+			continue;
+		}
+
+		if( (gone = member_gone(group, &ready[i])) < 0 )
 			return -1;
+		else if( gone )
+			continue;
+
+		if( (ready[i].events & EPOLLOUT) && !group->threaded )
+			monome_io_output_ready(group, ready[i].data.ptr);
+
+		if( ready[i].events & (EPOLLIN | EPOLLHUP) )
+			((monome_t *) ready[i].data.ptr)->poll_ready = 1;
+	}
+
+	return nready;
+}
+
+int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
+	struct epoll_event *ready;
+	int i, nready, ret, gone, dispatched;
+
+	/* a group watching for hotplug may be waiting for its first device */
+	if( !group || !MAX_EVENTS(group) )
+		return -1;
+
+	/* wake up in time to release paced output, see schedule.h */
+	timeout_ms = monome_sched_group_timeout(group, timeout_ms);
+
+	/* and input held back by coalescing, see coalesce.h */
+	timeout_ms = monome_coalesce_group_timeout(group, timeout_ms);
+
+	ready = group->ready;
+	nready = epoll_wait(group->fd, ready, MAX_EVENTS(group), timeout_ms);
+
+	if( nready < 0 )
+		return -1;
+
+	dispatched = 0;
+	for( i = 0; i < nready; i++ ) {
+		if( !ready[i].data.ptr ) {
+			group->hotplug->pending = 1;
+			continue;
 		}
-		if( fds[i].revents & POLLIN ) {
-			ret = monome_event_handle_next(group->monomes[i]);
+
+		if( (gone = member_gone(group, &ready[i])) < 0 )
+			return -1;
+		else if( gone )
+			continue;
+
+		if( ready[i].events & EPOLLOUT )
+			monome_io_output_ready(group, ready[i].data.ptr);
+
+		if( ready[i].events & EPOLLIN ) {
+			ret = monome_event_handle_next_batch(ready[i].data.ptr, SIZE_MAX);
 			if( ret > 0 )
 				dispatched += ret;
 		}
 	}
 
-	free(fds);
+	dispatched += monome_coalesce_group_dispatch(group);
+
+	monome_sched_group_pump(group);
+
+	/* last, since the app may close a departed device from its callback */
+	dispatched += monome_hotplug_process(group);
 	return dispatched;
 }
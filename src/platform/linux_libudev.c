@@ -64,3 +64,122 @@ err_no_device:
 err_stat:
 	return NULL;
 }
+
+struct monome_platform_hotplug {
+	struct udev *udev;
+	struct udev_monitor *monitor;
+};
+
+monome_platform_hotplug_t *
+monome_platform_hotplug_new(int *fd)
+{
+	monome_platform_hotplug_t *h;
+
+	if (!(h = m_calloc(1, sizeof(*h))))
+		return NULL;
+
+	if (!(h->udev = udev_new()))
+		goto err_udev;
+
+	/* "udev" rather than "kernel", so that the device node exists and
+	   its properties are filled in by the time we hear about it */
+	if (!(h->monitor = udev_monitor_new_from_netlink(h->udev, "udev")))
+		goto err_monitor;
+
+	if (udev_monitor_filter_add_match_subsystem_devtype(h->monitor,
+	        "tty", NULL) < 0
+	    || udev_monitor_enable_receiving(h->monitor) < 0)
+		goto err_receive;
+
+	*fd = udev_monitor_get_fd(h->monitor);
+	return h;
+
+err_receive:
+	udev_monitor_unref(h->monitor);
+err_monitor:
+	udev_unref(h->udev);
+err_udev:
+	m_free(h);
+	return NULL;
+}
+
+void
+monome_platform_hotplug_free(monome_platform_hotplug_t *h)
+{
+	udev_monitor_unref(h->monitor);
+	udev_unref(h->udev);
+	m_free(h);
+}
+
+int
+monome_platform_hotplug_next(monome_platform_hotplug_t *h, char **path,
+                             int *arrived)
+{
+	struct udev_device *dev;
+	const char *action, *node;
+
+	/* the monitor's socket is non-blocking, so this returns NULL once
+	   everything queued has been read */
+	while ((dev = udev_monitor_receive_device(h->monitor))) {
+		action = udev_device_get_action(dev);
+		node = udev_device_get_devnode(dev);
+
+		if (action && node && (!strcmp(action, "add")
+		                       || !strcmp(action, "remove"))) {
+			*arrived = !strcmp(action, "add");
+			*path = m_strdup(node);
+			udev_device_unref(dev);
+
+			return *path ? 1 : 0;
+		}
+
+		udev_device_unref(dev);
+	}
+
+	return 0;
+}
+
+int
+monome_platform_enumerate(monome_platform_found_t found, void *arg)
+{
+	struct udev_list_entry *entry;
+	struct udev_enumerate *e;
+	struct udev_device *dev;
+	struct udev *udev;
+	const char *node, *serial;
+
+	if (!(udev = udev_new()))
+		return -1;
+
+	if (!(e = udev_enumerate_new(udev)))
+		goto err_enumerate;
+
+	udev_enumerate_add_match_subsystem(e, "tty");
+
+	if (udev_enumerate_scan_devices(e) < 0)
+		goto err_scan;
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e)) {
+		if (!(dev = udev_device_new_from_syspath(udev,
+		        udev_list_entry_get_name(entry))))
+			continue;
+
+		node = udev_device_get_devnode(dev);
+		serial = udev_device_get_property_value(dev, "ID_SERIAL_SHORT");
+
+		if (node && serial)
+			found(node, serial, arg);
+
+		udev_device_unref(dev);
+	}
+
+	udev_enumerate_unref(e);
+	udev_unref(udev);
+	return 0;
+
+err_scan:
+	udev_enumerate_unref(e);
+err_enumerate:
+	udev_unref(udev);
+	return -1;
+}
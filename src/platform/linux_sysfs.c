@@ -93,3 +93,26 @@ err_asprintf:
 err_nodevs:
 	return NULL;
 }
+
+int monome_platform_enumerate(monome_platform_found_t found, void *arg) {
+	char path[MAX_LENGTH], *serial, *tty;
+	glob_t gb;
+	size_t i;
+
+	/* FTDI_PATH/<usb device>:<interface>/ttyUSBn */
+	if( glob(FTDI_PATH "/*/tty*", 0, NULL, &gb) )
+		return 0;
+
+	for( i = 0; i < gb.gl_pathc; i++ ) {
+		tty = strrchr(gb.gl_pathv[i], '/') + 1;
+		snprintf(path, sizeof(path), "/dev/%s", tty);
+
+		if( (serial = monome_platform_get_dev_serial(path)) ) {
+			found(path, serial, arg);
+			free(serial);
+		}
+	}
+
+	globfree(&gb);
+	return 0;
+}
@@ -19,17 +19,24 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 #include <termios.h>
+#include <time.h>
 #include <errno.h>
 
 #include <monome.h>
 #include "internal.h"
 #include "platform.h"
+#include "io.h"
+#include "schedule.h"
+#include "coalesce.h"
 
 #define MONOME_BAUD_RATE B115200
 #define READ_TIMEOUT 25
@@ -99,6 +106,12 @@ int monome_platform_open(monome_t *monome, const monome_devmap_t *m,
 	struct termios nt, ot;
 	int fd;
 
+	/* a trace stands in for the tty, see replay.h */
+	if( monome->replay ) {
+		monome->fd = -1;
+		return 0;
+	}
+
 	if( (fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0 ) {
 		perror("libmonome: could not open monome device");
 		return 1;
@@ -140,6 +153,7 @@ int monome_platform_open(monome_t *monome, const monome_devmap_t *m,
 	tcflush(fd, TCIOFLUSH);
 
 	monome->fd = fd;
+	monome->link_rate = MONOME_LINK_RATE(m->quirks);
 	return 0;
 
 err_tcsetattr:
@@ -150,17 +164,22 @@ err_tcsetattr:
 }
 
 int monome_platform_close(monome_t *monome) {
+	if( monome->replay )
+		return 0;
+
 	return close(monome->fd);
 }
 
 ssize_t monome_platform_write(monome_t *monome, const uint8_t *buf, size_t nbyte) {
-	ssize_t ret = write(monome->fd, buf, nbyte);
+	ssize_t ret;
 
-	if( ret < nbyte )
-		perror("libmonome: write is missing bytes");
+	do {
+		ret = write(monome->fd, buf, nbyte);
+	} while( ret < 0 && errno == EINTR );
 
-	if( ret < 0 )
-		perror("libmonome: error in write");
+	/* the tty's output buffer is full. the io layer keeps the rest. */
+	if( ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+		return 0;
 
 	return ret;
 }
@@ -195,31 +214,59 @@ start:
 	return ret;
 }
 
-void monome_event_loop(monome_t *monome) {
-	monome_callback_t *handler;
-	monome_event_t e;
+/* a single read() of whatever is available right now. never waits for
+   the rest of a message, since the caller keeps partial data around. */
+ssize_t monome_platform_read_nonblock(monome_t *monome, uint8_t *buf,
+                                      size_t nbyte) {
+	ssize_t bytes;
 
-	fd_set fds;
+	do {
+		bytes = read(monome->fd, buf, nbyte);
+	} while( bytes < 0 && errno == EINTR );
+
+	if( bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+		return 0;
 
-	e.monome = monome;
+	return bytes;
+}
+
+void monome_event_loop(monome_t *monome) {
+	struct timeval tv, *tvp;
+	fd_set fds, wfds;
+	int ms;
 
 	do {
 		FD_ZERO(&fds);
 		FD_SET(monome->fd, &fds);
 
-		if( select(monome->fd + 1, &fds, NULL, NULL, NULL) < 0 ) {
+		/* handlers may have left output waiting for the tty to drain */
+		FD_ZERO(&wfds);
+		if( TXQ_PENDING(monome) )
+			FD_SET(monome->fd, &wfds);
+
+		/* and paced output, or input held back by coalescing, may be due
+		   before any input arrives */
+		ms = monome_coalesce_timeout(monome, monome_sched_next_ms(monome));
+
+		tvp = NULL;
+		if( ms >= 0 ) {
+			tv.tv_sec  = ms / 1000;
+			tv.tv_usec = (ms % 1000) * 1000;
+			tvp = &tv;
+		}
+
+		if( select(monome->fd + 1, &fds, &wfds, NULL, tvp) < 0 ) {
 			perror("libmonome: error in select()");
 			break;
 		}
 
-		if( monome->next_event(monome, &e) < 1 )
-			continue;
+		monome_sched_pump(monome);
 
-		handler = &monome->handlers[e.event_type];
-		if( !handler->cb )
-			continue;
+		if( FD_ISSET(monome->fd, &wfds) )
+			monome_io_drain(monome);
 
-		handler->cb(&e, handler->data);
+		if( FD_ISSET(monome->fd, &fds) || monome_coalesce_ready(monome) )
+			monome_event_handle_next_batch(monome, SIZE_MAX);
 	} while( 1 );
 }
 
@@ -236,6 +283,10 @@ void *m_calloc(size_t nmemb, size_t size) {
 	return calloc(nmemb, size);
 }
 
+void *m_realloc(void *ptr, size_t size) {
+	return realloc(ptr, size);
+}
+
 void *m_strdup(const char *s) {
 	return strdup(s);
 }
@@ -244,6 +295,40 @@ void m_free(void *ptr) {
 	free(ptr);
 }
 
+const void *m_map_file(const char *path, size_t *size) {
+	struct stat st;
+	void *map;
+	int fd;
+
+	if( (fd = open(path, O_RDONLY)) < 0 )
+		return NULL;
+
+	if( fstat(fd, &st) || !st.st_size ) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( map == MAP_FAILED )
+		return NULL;
+
+	*size = st.st_size;
+	return map;
+}
+
+void m_unmap_file(const void *map, size_t size) {
+	munmap((void *) map, size);
+}
+
 void m_sleep(uint_t msec) {
 	usleep(msec * 1000);
 }
+
+uint64_t m_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
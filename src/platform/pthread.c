@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "internal.h"
+#include "platform.h"
+
+struct m_thread {
+	pthread_t thread;
+};
+
+/**
+ * threads
+ */
+
+m_thread_t *m_thread_start(void *(*func)(void *), void *arg) {
+	m_thread_t *thread;
+
+	if( !(thread = m_calloc(1, sizeof(*thread))) )
+		return NULL;
+
+	if( pthread_create(&thread->thread, NULL, func, arg) ) {
+		m_free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void m_thread_join(m_thread_t *thread) {
+	pthread_join(thread->thread, NULL);
+	m_free(thread);
+}
+
+/**
+ * wakeups
+ *
+ * an eventfd where we have one, otherwise a non-blocking pipe. either way
+ * fds[0] polls readable once fds[1] has been signalled, and stays that way
+ * until it's cleared.
+ */
+
+int m_wakeup_new(int fds[2]) {
+#if defined(__linux__)
+	if( (fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 )
+		return -1;
+
+	fds[1] = fds[0];
+	return 0;
+#else
+	int i;
+
+	if( pipe(fds) )
+		return -1;
+
+	for( i = 0; i < 2; i++ ) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	return 0;
+#endif
+}
+
+void m_wakeup_free(int fds[2]) {
+	close(fds[0]);
+
+	if( fds[1] != fds[0] )
+		close(fds[1]);
+}
+
+void m_wakeup_signal(int fd) {
+	uint64_t one = 1;
+	ssize_t ret;
+
+	/* a full pipe or a saturated eventfd is already signalled */
+	do {
+#if defined(__linux__)
+		ret = write(fd, &one, sizeof(one));
+#else
+		ret = write(fd, &one, 1);
+#endif
+	} while( ret < 0 && errno == EINTR );
+}
+
+void m_wakeup_clear(int fd) {
+	uint8_t buf[64];
+
+	while( read(fd, buf, sizeof(buf)) > 0 )
+		;
+}
+
+int m_wakeup_wait(int fd, int timeout_ms) {
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN
+	};
+	int ret;
+
+	if( (ret = poll(&pfd, 1, timeout_ms)) < 0 )
+		return (errno == EINTR) ? 0 : -1;
+
+	return ret;
+}
@@ -18,6 +18,7 @@
 #undef __STRICT_ANSI__
 #endif
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
@@ -37,6 +38,9 @@
 #include <monome.h>
 #include "internal.h"
 #include "platform.h"
+#include "writer.h"
+#include "schedule.h"
+#include "coalesce.h"
 
 #define READ_TIMEOUT 25
 
@@ -155,6 +159,12 @@ int monome_platform_open(monome_t *monome, const monome_devmap_t *m,
 		.WriteTotalTimeoutMultiplier = 0
 	};
 
+	/* a trace stands in for the port, see replay.h */
+	if( monome->replay ) {
+		monome->fd = -1;
+		return 0;
+	}
+
 	if( !(devesc = m_asprintf("\\\\.\\%s", dev)) ) {
 		fprintf(stderr, "libmonome: could not open %s: out of memory\n", dev);
 		return 1;
@@ -193,6 +203,7 @@ int monome_platform_open(monome_t *monome, const monome_devmap_t *m,
 	PurgeComm(hser, PURGE_RXCLEAR | PURGE_TXCLEAR);
 
 	monome->fd = _open_osfhandle((intptr_t) hser, _O_RDWR | _O_BINARY);
+	monome->link_rate = MONOME_LINK_RATE(m->quirks);
 	return 0;
 
 err_commstate:
@@ -205,6 +216,9 @@ err_open:
 }
 
 int monome_platform_close(monome_t *monome) {
+	if( monome->replay )
+		return 0;
+
 	return !!_close(monome->fd);
 }
 
@@ -213,17 +227,13 @@ ssize_t monome_platform_write(monome_t *monome, const uint8_t *buf, size_t nbyte
 	OVERLAPPED ov = {0, 0, {{0, 0}}};
 	DWORD written = 0;
 
-	if( !(ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) ) {
-		fprintf(stderr,
-				"monome_plaform_write(): could not allocate event (%ld)\n",
-				GetLastError());
+	/* failures are counted by the io layer, see monome_get_tx_stats() */
+	if( !(ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) )
 		return -1;
-	}
 
 	if( !WriteFile(hres, buf, nbyte, &written, &ov) ) {
 		if( GetLastError() != ERROR_IO_PENDING ) {
-			fprintf(stderr, "monome_platform_write(): write failed (%ld)\n",
-					GetLastError());
+			CloseHandle(ov.hEvent);
 			return -1;
 		}
 
@@ -286,6 +296,26 @@ start:
 	return read_total;
 }
 
+ssize_t monome_platform_read_nonblock(monome_t *monome, uint8_t *buf,
+                                      size_t nbyte) {
+	HANDLE hres = (HANDLE) _get_osfhandle(monome->fd);
+	COMSTAT status;
+	DWORD errors;
+
+	/* ReadFile() would sit out the comm timeout when nothing is queued,
+	   so only ask for what the driver already has. */
+	if( !ClearCommError(hres, &errors, &status) )
+		return -1;
+
+	if( !status.cbInQue )
+		return 0;
+
+	if( nbyte > status.cbInQue )
+		nbyte = status.cbInQue;
+
+	return monome_platform_read(monome, buf, nbyte);
+}
+
 char *monome_platform_get_dev_serial(const char *path) {
 	HDEVINFO hdevinfo;
 	SP_DEVINFO_DATA devinfo;
@@ -328,6 +358,38 @@ char *monome_platform_get_dev_serial(const char *path) {
 	return serial;
 }
 
+int monome_platform_enumerate(monome_platform_found_t found, void *arg) {
+	HDEVINFO hdevinfo;
+	SP_DEVINFO_DATA devinfo;
+	char port_name[MAX_DEVICE_ID_LEN];
+	char instance_id[MAX_DEVICE_ID_LEN];
+	char *serial;
+	int di;
+
+	hdevinfo = SetupDiGetClassDevs(&GUID_DEVINTERFACE_COMPORT, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+
+	if (hdevinfo == INVALID_HANDLE_VALUE)
+		return -1;
+
+	devinfo.cbSize = sizeof(SP_DEVINFO_DATA);
+
+	for (di = 0; SetupDiEnumDeviceInfo(hdevinfo, di, &devinfo); di++) {
+		if (!m_get_device_port_name(port_name, sizeof(port_name), hdevinfo, &devinfo))
+			continue;
+
+		if (!SetupDiGetDeviceInstanceId(hdevinfo, &devinfo, instance_id, sizeof(instance_id), NULL))
+			continue;
+
+		if ((serial = m_get_serial_from_instance_id(instance_id))) {
+			found(port_name, serial, arg);
+			free(serial);
+		}
+	}
+
+	SetupDiDestroyDeviceInfoList(hdevinfo);
+	return 0;
+}
+
 int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	HANDLE hres = (HANDLE) _get_osfhandle(monome->fd);
 	OVERLAPPED ov = {0, 0, {{0, 0}}};
@@ -383,6 +445,87 @@ int monome_platform_wait_for_input(monome_t *monome, uint_t msec) {
 	return result;
 }
 
+int monome_platform_wait_for_output(monome_t *monome, uint_t msec) {
+	return 0;
+}
+
+/* comm events are armed afresh on every wait, so there's no per-group
+   state to keep. */
+
+int monome_platform_poll_group_init(monome_poll_group_t *group) {
+	group->fd = -1;
+	return 0;
+}
+
+void monome_platform_poll_group_free(monome_poll_group_t *group) {
+}
+
+int monome_platform_poll_group_add(monome_poll_group_t *group,
+                                   monome_t *monome) {
+	return 0;
+}
+
+void monome_platform_poll_group_remove(monome_poll_group_t *group,
+                                      monome_t *monome) {
+}
+
+/* overlapped writes always run to completion, so nothing is ever left
+   pending for the group to wait on */
+void monome_platform_poll_group_want_output(monome_poll_group_t *group,
+                                            monome_t *monome, int want) {
+}
+
+/* there's no device monitor here yet, so hotplug can't be enabled */
+
+int monome_platform_poll_group_watch(monome_poll_group_t *group, int fd) {
+	return -1;
+}
+
+void monome_platform_poll_group_unwatch(monome_poll_group_t *group, int fd) {
+}
+
+monome_platform_hotplug_t *monome_platform_hotplug_new(int *fd) {
+	return NULL;
+}
+
+void monome_platform_hotplug_free(monome_platform_hotplug_t *monitor) {
+}
+
+int monome_platform_hotplug_next(monome_platform_hotplug_t *monitor,
+                                 char **path, int *arrived) {
+	return 0;
+}
+
+int monome_platform_poll_group_ready(monome_poll_group_t *group,
+                                     int timeout_ms) {
+	monome_t *monome;
+	COMSTAT status;
+	DWORD errors;
+	unsigned int i;
+	int nready;
+
+	/* there's nothing to block on across several comm ports short of
+	   arming overlapped events, so poll the driver queues instead */
+	for( ;; ) {
+		for( nready = 0, i = 0; i < group->count; i++ ) {
+			monome = group->monomes[i];
+
+			if( !ClearCommError((HANDLE) _get_osfhandle(monome->fd), &errors,
+			                    &status) )
+				return -1;
+
+			monome->poll_ready = !!status.cbInQue;
+			nready += monome->poll_ready;
+		}
+
+		if( nready || timeout_ms <= 0 )
+			return nready;
+
+		m_sleep(1);
+		timeout_ms--;
+	}
+}
+
 int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 	HANDLE handles[MAXIMUM_WAIT_OBJECTS];
 	DWORD event_masks[MAXIMUM_WAIT_OBJECTS];
@@ -391,7 +534,7 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 	HANDLE hres;
 	DWORD wait_result, wait_timeout;
 	unsigned int i;
-	int dispatched;
+	int dispatched = -1;
 
 	if( !group || !group->count )
 		return -1;
@@ -434,6 +577,12 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 		}
 	}
 
+	/* wake up in time to release paced output, see schedule.h */
+	timeout_ms = monome_sched_group_timeout(group, timeout_ms);
+
+	/* and input held back by coalescing, see coalesce.h */
+	timeout_ms = monome_coalesce_group_timeout(group, timeout_ms);
+
 	wait_timeout = (timeout_ms < 0) ? INFINITE : (DWORD) timeout_ms;
 	wait_result = WaitForMultipleObjects(group->count, handles, FALSE, wait_timeout);
 
@@ -451,7 +600,7 @@ int monome_poll_group_wait(monome_poll_group_t *group, int timeout_ms) {
 	dispatched = 0;
 	for( i = 0; i < group->count; i++ ) {
 		if( WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0 ) {
-			int ret = monome_event_handle_next(group->monomes[i]);
+			int ret = monome_event_handle_next_batch(group->monomes[i], SIZE_MAX);
 			if( ret > 0 )
 				dispatched += ret;
 		}
@@ -474,35 +623,97 @@ err_cleanup:
 		SetCommMask(hres, old_comm_masks[i]);
 	}
 
+	if( dispatched >= 0 )
+		dispatched += monome_coalesce_group_dispatch(group);
+
+	monome_sched_group_pump(group);
 	return dispatched;
 }
 
+/**
+ * threaded input and output aren't supported here yet
+ */
+
+int monome_writer_start(monome_t *monome, size_t capacity) {
+	return MONOME_ERROR_UNSUPPORTED;
+}
+
+int monome_writer_stop(monome_t *monome) {
+	return MONOME_ERROR_UNSUPPORTED;
+}
+
+ssize_t monome_writer_push(monome_writer_t *writer, const uint8_t *buf,
+                           size_t nbyte) {
+	return -1;
+}
+
+monome_event_queue_t *monome_event_queue_new(monome_poll_group_t *group,
+                                             size_t capacity) {
+	return NULL;
+}
+
+void monome_event_queue_free(monome_event_queue_t *queue) {
+}
+
+int monome_event_queue_pop(monome_event_queue_t *queue, monome_event_t *e) {
+	return -1;
+}
+
+size_t monome_event_queue_pop_batch(monome_event_queue_t *queue,
+                                    monome_event_t *events, size_t max) {
+	return 0;
+}
+
+size_t monome_event_queue_pop_batch_ts(monome_event_queue_t *queue,
+                                       monome_event_t *events,
+                                       uint64_t *timestamps, size_t max) {
+	return 0;
+}
+
+int monome_event_queue_get_fd(monome_event_queue_t *queue) {
+	return -1;
+}
+
+int monome_event_queue_wait(monome_event_queue_t *queue, int timeout_ms) {
+	return -1;
+}
+
+size_t monome_event_queue_get_dropped(monome_event_queue_t *queue) {
+	return 0;
+}
+
 void monome_poll_group_loop(monome_poll_group_t *group) {
 	while( monome_poll_group_wait(group, -1) >= 0 )
 		;
 }
 
 void monome_event_loop(monome_t *monome) {
-	monome_callback_t *handler;
-	monome_event_t e;
-
-	e.monome = monome;
+	int ms;
 
 	do {
-		if (monome_platform_wait_for_input(monome, INFINITE) < 0) {
+		/* wake up in time to release paced output, see schedule.h */
+		ms = monome_sched_next_ms(monome);
+
+		/* and input held back by coalescing, see coalesce.h */
+		ms = monome_coalesce_timeout(monome, ms);
+
+		if (monome_platform_wait_for_input(monome,
+		        (ms < 0) ? INFINITE : (uint_t) ms) < 0) {
 			fprintf(stderr, "libmonome: error waiting for input\n");
 			break;
 		}
 
-		if (monome->next_event(monome, &e) < 1)
-			continue;
+		monome_sched_pump(monome);
+		monome_event_handle_next_batch(monome, SIZE_MAX);
+	} while (1);
+}
 
-		handler = &monome->handlers[e.event_type];
-		if (!handler->cb)
-			continue;
+/* no threads here yet, so callers fall back to doing the work themselves */
+m_thread_t *m_thread_start(void *(*func)(void *), void *arg) {
+	return NULL;
+}
 
-		handler->cb(&e, handler->data);
-	} while (1);
+void m_thread_join(m_thread_t *thread) {
 }
 
 void *m_malloc(size_t size) {
@@ -513,6 +724,10 @@ void *m_calloc(size_t nmemb, size_t size) {
 	return calloc(nmemb, size);
 }
 
+void *m_realloc(void *ptr, size_t size) {
+	return realloc(ptr, size);
+}
+
 void *m_strdup(const char *s) {
 	return _strdup(s);
 }
@@ -521,6 +736,50 @@ void m_free(void *ptr) {
 	free(ptr);
 }
 
+const void *m_map_file(const char *path, size_t *size) {
+	LARGE_INTEGER len;
+	HANDLE file, mapping;
+	void *map = NULL;
+
+	file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+	                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	if( !GetFileSizeEx(file, &len) || !len.QuadPart
+	    || (uint64_t) len.QuadPart > SIZE_MAX )
+		goto out;
+
+	if( !(mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL)) )
+		goto out;
+
+	if( (map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) )
+		*size = (size_t) len.QuadPart;
+
+	CloseHandle(mapping);
+out:
+	CloseHandle(file);
+	return map;
+}
+
+void m_unmap_file(const void *map, size_t size) {
+	(void) size;
+	UnmapViewOfFile(map);
+}
+
 void m_sleep(uint_t msec) {
 	Sleep(msec);
 }
+
+uint64_t m_now_ns(void) {
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if( !freq.QuadPart )
+		QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&now);
+	return (uint64_t) ((now.QuadPart / freq.QuadPart) * 1000000000
+		+ ((now.QuadPart % freq.QuadPart) * 1000000000) / freq.QuadPart);
+}
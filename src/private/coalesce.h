@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * input coalescing (coalesce.c)
+ *
+ * once monome_set_coalescing() has been called, monome_event_next_batch()
+ * decodes through monome->coalesce. everything the protocol has buffered
+ * is decoded at once, encoder deltas and tilt samples are folded together
+ * per encoder or sensor, and the result is handed out from there. with a
+ * rate set, what arrives too soon after the last event is held back until
+ * the interval has passed. a folded event keeps the read time of the
+ * first event folded into it, so its timestamp shows how long the input
+ * was held.
+ */
+
+int monome_coalesce_next(monome_t *monome, monome_event_t *events,
+                         uint64_t *stamps, size_t max);
+
+/* there are events ready to be handed out without reading the device */
+int monome_coalesce_ready(monome_t *monome);
+
+/* shorten a wait so that it ends when a held event is due. `timeout_ms`
+   is -1 for none, as is the return value. */
+int monome_coalesce_timeout(monome_t *monome, int timeout_ms);
+int monome_coalesce_group_timeout(monome_poll_group_t *group, int timeout_ms);
+
+/* after a poll group wait, dispatch whatever became due on devices that
+   had no input. returns the number of events dispatched. */
+int monome_coalesce_group_dispatch(monome_poll_group_t *group);
+
+void monome_coalesce_free(monome_t *monome);
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * device descriptor cache (descriptor.c)
+ *
+ * once enabled, monome_open() remembers what it learned about each tty it
+ * opened: the serial udev reported, the protocol, and what the device
+ * said about itself. entries are looked up by path, and only count for
+ * the serial they were stored with.
+ *
+ * reopening a mext device skips the serial lookup and waiting for its
+ * handshake. the queries still go out, and the answers are checked
+ * against the cache as the app reads events (see mext_handler_system()).
+ * series and 40h devices never answer anything that could be checked, so
+ * their serial is always looked up, and must match the entry's.
+ */
+
+struct monome_descriptor {
+	char *devpath;
+	char *serial;
+	char *proto;
+	char *friendly;
+	int rows, cols;
+};
+
+/* whether an entry knows the device's size. one added by enumeration may
+   not, and a mext device opened with it still does the full handshake. */
+#define DESCRIPTOR_HAS_SIZE(d) ((d)->rows && (d)->cols)
+
+/* the entry for `devpath`, or NULL if there isn't one or the cache is
+   off. only valid until the cache next changes. */
+const monome_descriptor_t *monome_descriptor_lookup(const char *devpath);
+
+/* remember (or refresh) what an open device is, keyed by monome->device */
+void monome_descriptor_store(monome_t *monome);
+
+/* what monome_enumerate() found, unless there's an entry for it already */
+void monome_descriptor_add(const char *devpath, const char *serial,
+                           const char *proto, const char *friendly,
+                           int rows, int cols);
+
+/* the device at `devpath` isn't what the cache said it was */
+void monome_descriptor_forget(const char *devpath);
+
+/**
+ * the answers that check an entry are decoded on whichever thread reads
+ * the device, which may be an event queue's reader. neither the cache nor
+ * the device's size and name may change under the app's thread, so the
+ * protocol only keeps the answers in monome->reported and records the
+ * verdict with monome_descriptor_check(). monome_descriptor_settle()
+ * acts on it from the app's thread: when it reads events itself, when an
+ * event queue is freed, and when the device is closed.
+ */
+
+typedef enum {
+	DESCRIPTOR_UNCHECKED = 0,
+	DESCRIPTOR_CONFIRMED,
+	DESCRIPTOR_MISMATCHED
+} monome_descriptor_check_t;
+
+void monome_descriptor_check(monome_t *monome, monome_descriptor_check_t check);
+
+/* store the entry for `monome`, or forget it and take what the device
+   reported, if its answers said to */
+void monome_descriptor_settle(monome_t *monome);
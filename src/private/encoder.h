@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * picks the fewest-bytes sequence of led commands that takes a grid from
+ * one set of levels to another, given a protocol's monome_led_cost_t.
+ *
+ * levels are rows*cols, row-major. `prev` is what the device is showing,
+ * or NULL if that isn't known (everything is treated as changed).
+ */
+
+typedef struct monome_encoder_plan {
+	/* start with led_all/level_all to `all_level`, then diff each quad
+	   against that instead of against `prev` */
+	int use_all;
+	uint_t all_level;
+
+	size_t bytes;
+} monome_encoder_plan_t;
+
+/* the device's cost model, or a level-commands-only default for protocols
+   that don't fill one in */
+const monome_led_cost_t *monome_encoder_cost(const monome_t *monome);
+
+size_t monome_encoder_plan(const monome_led_cost_t *cost,
+                           const uint8_t *next, const uint8_t *prev,
+                           uint_t rows, uint_t cols,
+                           monome_encoder_plan_t *plan);
+
+/* send a plan made by monome_encoder_plan() with the same arguments and
+   the device's monome_encoder_cost() */
+int monome_encoder_send(monome_t *monome, const monome_encoder_plan_t *plan,
+                        const uint8_t *next, const uint8_t *prev,
+                        uint_t rows, uint_t cols);
+
+/**
+ * the same for a single arc ring of MONOME_RING_LEDS levels, choosing
+ * between ring_set, ring_range, ring_all and ring_map.
+ */
+
+typedef struct monome_ring_plan {
+	/* send the whole ring as one ring_map */
+	int use_map;
+
+	/* start with ring_all to `all_level`, then diff against that */
+	int use_all;
+	uint_t all_level;
+
+	size_t bytes;
+} monome_ring_plan_t;
+
+size_t monome_encoder_ring_plan(const monome_led_cost_t *cost,
+                                const uint8_t *next, const uint8_t *prev,
+                                monome_ring_plan_t *plan);
+
+int monome_encoder_ring_send(monome_t *monome, uint_t ring,
+                             const monome_ring_plan_t *plan,
+                             const uint8_t *next, const uint8_t *prev);
@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * hotplug (hotplug.c)
+ *
+ * once monome_poll_group_enable_hotplug() has been called, the group also
+ * watches the platform's device monitor. its fd is registered with the
+ * group's readiness backend alongside the members, with no device of its
+ * own (see monome_platform_poll_group_watch()).
+ *
+ * the waits don't act on what they see straight away. they note that the
+ * monitor is readable, or that a member's fd hung up (monome->poll_hup),
+ * and call monome_hotplug_process() once they're done with the ready list,
+ * so that a device closed by the app's callback isn't touched again.
+ */
+
+struct monome_hotplug {
+	monome_hotplug_callback_t cb;
+	void *data;
+
+	struct monome_platform_hotplug *monitor;
+	int fd;
+
+	/* the monitor fd was readable on the last wait */
+	int pending;
+};
+
+/* open what arrived and hand over what left. returns the number of
+   callbacks made. */
+int monome_hotplug_process(monome_poll_group_t *group);
+
+void monome_hotplug_free(monome_poll_group_t *group);
@@ -19,6 +19,7 @@
 #define MONOME_INTERNAL_H
 
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include <sys/types.h>
@@ -27,11 +28,34 @@
 
 typedef unsigned int uint_t;
 
+/* large enough to hold many complete messages from any protocol, so that
+   one read() can pull in everything the kernel has buffered for us */
+#define MONOME_RX_BUF_SIZE 512
+
+/* output is collected here while deferred, so a full 256 redraw (eight
+   35-byte level maps) fits several times over before we have to flush */
+#define MONOME_TX_BUF_SIZE 1024
+
+/* output the device wouldn't take yet waits here. it has to hold at least
+   the tail of the largest single write we make (a full transmit buffer). */
+#define MONOME_TXQ_SIZE 4096
+
+/* how many events monome_event_handle_next_batch() decodes at a time */
+#define MONOME_EVENT_BATCH_SIZE 32
+
+/* whether monome_set_event_mask() lets events of `type` through */
+#define MONOME_EVENT_WANTED(monome, type) \
+	(!((monome)->event_ignore & MONOME_EVENT_MASK(type)))
+
 typedef enum {
 	NO_QUIRKS        = 0,
 	QUIRK_57600_BAUD = 0x1,
 } monome_device_quirks_t;
 
+/* bytes per second a serial link carries at 8N1 (ten bits a byte) */
+#define MONOME_LINK_RATE(quirks) \
+	((((quirks) & QUIRK_57600_BAUD) ? 57600 : 115200) / 10)
+
 typedef struct monome_callback monome_callback_t;
 typedef struct monome_rotspec monome_rotspec_t;
 typedef struct monome_devmap monome_devmap_t;
@@ -40,6 +64,22 @@ typedef struct monome_led_functions monome_led_functions_t;
 typedef struct monome_led_level_functions monome_led_level_functions_t;
 typedef struct monome_led_ring_functions monome_led_ring_functions_t;
 typedef struct monome_tilt_functions monome_tilt_functions_t;
+typedef struct monome_led_cost monome_led_cost_t;
+typedef struct monome_writer monome_writer_t;
+typedef struct monome_sched monome_sched_t;
+typedef struct monome_coalesce monome_coalesce_t;
+typedef struct monome_descriptor monome_descriptor_t;
+typedef struct monome_hotplug monome_hotplug_t;
+typedef struct monome_stats_block monome_stats_block_t;
+typedef struct monome_trace monome_trace_t;
+typedef struct monome_replay monome_replay_t;
+typedef struct monome_sched_rect monome_sched_rect_t;
+
+/* a span of leds, [x0, x1) by [y0, y1), in the coordinates the led calls
+   take. an empty rect (x1 <= x0) covers nothing. */
+struct monome_sched_rect {
+	uint16_t x0, y0, x1, y1;
+};
 
 typedef void (*monome_coord_cb_t)(monome_t *, uint_t *x, uint_t *y);
 typedef void (*monome_map_cb_t)(monome_t *, uint8_t *data);
@@ -117,6 +157,40 @@ struct monome_tilt_functions {
 	int (*disable)(monome_t *monome, uint_t sensor);
 };
 
+/* wire cost, in bytes, of each grid led command a protocol can send when
+   aimed at a single 8x8 quad. zero means the protocol can't do that (e.g.
+   series rows always span the whole device). the plain on/off commands are
+   only considered for leds at level 0 or 15. */
+struct monome_led_cost {
+	uint8_t set, level_set;
+	uint8_t row, level_row;
+	uint8_t col, level_col;
+	uint8_t map, level_map;
+	uint8_t all, level_all;
+
+	/* arc rings. a zero ring_range means ranges aren't used. */
+	uint8_t ring_set, ring_all, ring_map, ring_range;
+
+	/* the device is on/off only and levels go through reduce_level_to_bit() */
+	uint8_t monobright;
+};
+
+typedef enum {
+	SCHED_NONE = 0,
+	SCHED_GRID,
+	SCHED_GRID_INTENSITY,
+	SCHED_RING,
+	SCHED_RING_INTENSITY
+} monome_sched_kind_t;
+
+/* what the led call in progress may change (`touches`) and what it's
+   certain to overwrite (`covers`). see schedule.h. */
+typedef struct {
+	monome_sched_kind_t kind;
+	monome_sched_rect_t touches, covers;
+	uint32_t call;
+} monome_sched_key_t;
+
 struct monome {
 #if !defined(EMBED_PROTOS)
 	/* handle for the loaded protocol module */
@@ -131,20 +205,164 @@ struct monome {
 
 	int fd;
 
+	/* bytes per second the link to the device carries, or 0 if unknown.
+	   set by monome_platform_open(). */
+	int link_rate;
+
+	/* milliseconds the protocol's open() may spend waiting for the device
+	   to identify itself. set by monome_open(). */
+	uint_t open_timeout;
+
+	/* what the descriptor cache knows about the device being opened, or
+	   NULL. only set while the protocol's open() runs. see descriptor.h */
+	const monome_descriptor_t *descriptor;
+
+	/* what the device's answers made of the entry it was opened from, a
+	   monome_descriptor_check_t. see monome_descriptor_settle(). */
+	atomic_int descriptor_check;
+
+	/* what the device said about itself while its entry was being
+	   checked. written by whichever thread decodes the answers, and only
+	   read once descriptor_check has been set. */
+	struct {
+		char friendly[33];
+		int rows, cols;
+	} reported;
+
+	/* bytes read from the device but not yet decoded. data between `start`
+	   and `end` is pending, and anything before `start` has been consumed.
+	   `read_ns` is when the last read() returned, which is when every
+	   message still in the buffer was completed, since the buffer is only
+	   read into once it holds no whole message. */
+	struct {
+		uint8_t buf[MONOME_RX_BUF_SIZE];
+		size_t start, end;
+		uint64_t read_ns;
+	} rx;
+
+	/* encoded output that hasn't been handed to the platform yet. bytes
+	   collect here while the device is deferred (see monome_set_deferred())
+	   or while a single call emits more than one message (depth > 0). */
+	struct {
+		uint8_t buf[MONOME_TX_BUF_SIZE];
+		size_t len;
+		int deferred;
+		int depth;
+
+		/* every grid led the buffered messages may change, so that an
+		   urgent call can tell whether it's safe to jump ahead of them */
+		monome_sched_rect_t touched;
+
+		/* set during an urgent led call that's going straight out */
+		int urgent;
+	} tx;
+
+	/* bytes handed to the platform that didn't fit in the tty's output
+	   buffer, waiting for it to drain. see monome_io_send(). */
+	struct {
+		uint8_t buf[MONOME_TXQ_SIZE];
+		size_t start, end;
+		int want_output;
+	} txq;
+
+	monome_tx_stats_t tx_stats;
+
+	/* performance counters, allocated by monome_set_stats(). see stats.h */
+	monome_stats_block_t *stats;
+
+	/* sees every chunk read from or written to the device. see
+	   monome_set_wire_tap() */
+	struct {
+		monome_wire_tap_t cb;
+		void *data;
+	} tap;
+
+	/* a trace being written, see monome_record_start() and trace.h */
+	monome_trace_t *record;
+
+	/* set if the device is a trace being replayed rather than a tty. see
+	   replay.h */
+	monome_replay_t *replay;
+
+	/* paced led output, allocated by monome_set_output_rate(). see schedule.h */
+	monome_sched_t *sched;
+	monome_sched_key_t sched_key;
+
+	/* input coalescing, allocated by monome_set_coalescing(). see
+	   coalesce.h */
+	monome_coalesce_t *coalesce;
+
+	/* event types to drop as they're decoded, the complement of the mask
+	   given to monome_set_event_mask(), so that zeroed memory means
+	   everything is delivered */
+	uint_t event_ignore;
+
+	/* tilt sensors the app has enabled, which are switched off on the
+	   device while MONOME_TILT is masked */
+	uint_t tilt_enabled;
+
 	monome_callback_t handlers[MONOME_EVENT_MAX];
 	monome_rotate_t rotation;
 
+	/* the event a handler is being called for, and when it was read. see
+	   monome_event_get_timestamp() */
+	const monome_event_t *dispatching;
+	uint64_t dispatching_ns;
+
 	int  (*open)(monome_t *monome, const char *dev, const char *serial,
 				 const monome_devmap_t *, va_list args);
 	int  (*close)(monome_t *monome);
 	void (*free)(monome_t *monome);
 
-	int  (*next_event)(monome_t *monome, monome_event_t *event);
+	/* decode up to `max` events. stamps[i], if `stamps` isn't NULL, is
+	   when the input for events[i] was read, from m_now_ns(). */
+	int  (*next_events)(monome_t *monome, monome_event_t *events,
+	                    uint64_t *stamps, size_t max);
 
 	monome_led_functions_t *led;
 	monome_led_level_functions_t *led_level;
 	monome_led_ring_functions_t *led_ring;
 	monome_tilt_functions_t *tilt;
+
+	/* filled in by the protocol. see encoder.h */
+	monome_led_cost_t led_cost;
+
+	/* if set, output goes to a writer thread. see writer.h */
+	monome_writer_t *writer;
+
+	/* set by monome_platform_poll_group_ready() when the fd has input, and
+	   cleared by monome_poll_group_process() once it's drained */
+	int poll_ready;
+
+	/* set by a poll group wait when the fd hangs up while the group is
+	   watching for hotplug. the device is then handed to the app as
+	   departed, see hotplug.h */
+	int poll_hup;
+
+	/* the poll group the device was last added to, which watches for the
+	   fd to become writable while anything is waiting in txq */
+	monome_poll_group_t *group;
+};
+
+/* a retained varibright framebuffer. `shadow` is what we believe the
+   device is currently showing, and is only meaningful while `valid`. */
+struct monome_frame {
+	monome_t *monome;
+	int rows, cols;
+
+	uint8_t *levels;
+	uint8_t *shadow;
+	int valid;
+};
+
+/* the same for arc rings: `rings` rows of MONOME_RING_LEDS levels */
+struct monome_ring_frame {
+	monome_t *monome;
+	uint_t rings;
+
+	uint8_t *levels;
+	uint8_t *shadow;
+	int valid;
 };
 
 #define MONOME_POLL_GROUP_INITIAL_CAP 4
@@ -153,6 +371,23 @@ struct monome_poll_group {
 	monome_t **monomes;
 	unsigned int count;
 	unsigned int capacity;
+
+	/* platform readiness backend, see monome_platform_poll_group_init().
+	   on linux `fd` is an epoll instance with every member registered and
+	   `ready` is its event array, `ready_cap` entries long. */
+	int fd;
+	void *ready;
+	unsigned int ready_cap;
+
+	/* where monome_poll_group_process() picks up next */
+	unsigned int cursor;
+
+	/* set while an event queue's reader thread is waiting on the group.
+	   pending output is then left to the app's own thread, see queue.c. */
+	int threaded;
+
+	/* see monome_poll_group_enable_hotplug() */
+	monome_hotplug_t *hotplug;
 };
 
 #endif /* defined MONOME_INTERNAL_H */
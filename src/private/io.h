@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * buffered device i/o shared by the serial protocols
+ */
+
+#define RX_PENDING(monome) ((monome)->rx.end - (monome)->rx.start)
+#define RX_DATA(monome)    (&(monome)->rx.buf[(monome)->rx.start])
+
+/* decode one message from the front of `data`. returns the number of
+   bytes it took up, or 0 if `nbyte` doesn't cover a whole message yet.
+   sets *produced if the message became an event in `e`. */
+typedef size_t (*monome_io_decode_func_t)(monome_t *monome,
+                                          const uint8_t *data, size_t nbyte,
+                                          monome_event_t *e, int *produced);
+
+ssize_t monome_io_fill(monome_t *monome);
+void monome_io_consume(monome_t *monome, size_t nbyte);
+
+int monome_io_next_events(monome_t *monome, monome_io_decode_func_t decode,
+                          monome_event_t *events, uint64_t *stamps,
+                          size_t max);
+
+#define TXQ_PENDING(monome) ((monome)->txq.end - (monome)->txq.start)
+#define TXQ_DATA(monome)    (&(monome)->txq.buf[(monome)->txq.start])
+
+ssize_t monome_io_write(monome_t *monome, const uint8_t *buf, size_t nbyte);
+int monome_io_flush(monome_t *monome);
+
+/* hand bytes to the platform without blocking, queueing what doesn't fit.
+   returns nbyte once it's all sent or queued, -1 if it was dropped. */
+ssize_t monome_io_send(monome_t *monome, const uint8_t *buf, size_t nbyte);
+
+/* write out as much of the pending queue as the device will take. returns
+   1 if some is still pending, 0 once it's empty, or -1 on error. */
+int monome_io_drain(monome_t *monome);
+
+/* keep draining for up to `msec` while the device accepts output */
+int monome_io_drain_wait(monome_t *monome, uint_t msec);
+
+/* called by the poll group backends when the fd has become writable */
+void monome_io_output_ready(monome_poll_group_t *group, monome_t *monome);
+
+/* bracket calls which emit several messages so that they leave in a
+   single write(), whether or not the device is deferred */
+void monome_io_begin(monome_t *monome);
+int monome_io_end(monome_t *monome);
@@ -18,6 +18,13 @@
 
 char *monome_platform_get_dev_serial(const char *device);
 
+/* calls `found` with the path and serial of every serial device attached,
+   monome or not. returns 0, or -1 if they couldn't be listed. */
+typedef void (*monome_platform_found_t)(const char *path, const char *serial,
+                                        void *arg);
+
+int monome_platform_enumerate(monome_platform_found_t found, void *arg);
+
 monome_t *monome_platform_load_protocol(const char *proto);
 void monome_platform_free(monome_t *monome);
 
@@ -25,13 +32,78 @@ int monome_platform_open(monome_t *monome, const monome_devmap_t *m,
                          const char *dev);
 int monome_platform_close(monome_t *monome);
 
+/* one write(). returns how many bytes went out, which may be fewer than
+   asked for (or 0) if the device's output buffer is full, or -1 on error. */
 ssize_t monome_platform_write(monome_t *monome, const uint8_t *buf, size_t nbyte);
 ssize_t monome_platform_read(monome_t *monome, uint8_t *buf, size_t nbyte);
+ssize_t monome_platform_read_nonblock(monome_t *monome, uint8_t *buf,
+                                      size_t nbyte);
 
 int monome_platform_wait_for_input(monome_t *monome, uint_t msec);
 
+/* like wait_for_input: 0 once the fd is writable, 1 on timeout, -1 on
+   error. */
+int monome_platform_wait_for_output(monome_t *monome, uint_t msec);
+
+int monome_platform_poll_group_init(monome_poll_group_t *group);
+void monome_platform_poll_group_free(monome_poll_group_t *group);
+int monome_platform_poll_group_add(monome_poll_group_t *group,
+                                   monome_t *monome);
+void monome_platform_poll_group_remove(monome_poll_group_t *group,
+                                      monome_t *monome);
+
+/* start or stop watching a member for writability. once it's writable the
+   backend calls monome_io_output_ready(). */
+void monome_platform_poll_group_want_output(monome_poll_group_t *group,
+                                            monome_t *monome, int want);
+
+/* sets poll_ready on every member with input waiting, waiting up to
+   `timeout_ms` for there to be some (0 doesn't block). returns how many
+   there were, or -1 on error. */
+int monome_platform_poll_group_ready(monome_poll_group_t *group,
+                                     int timeout_ms);
+
+/* watch an fd that isn't a member's, the hotplug monitor's, alongside the
+   members. there's at most one. the waits set group->hotplug->pending when
+   it's readable. returns -1 where that isn't supported. */
+int monome_platform_poll_group_watch(monome_poll_group_t *group, int fd);
+void monome_platform_poll_group_unwatch(monome_poll_group_t *group, int fd);
+
+/* device arrival and removal notifications (linux_libudev.c). _new()
+   returns NULL where there's no way to get them, and sets `fd` to poll for
+   them otherwise. _next() returns 1 with the tty's path (to be freed) and
+   whether it arrived or left, or 0 once there's nothing left to read. */
+typedef struct monome_platform_hotplug monome_platform_hotplug_t;
+
+monome_platform_hotplug_t *monome_platform_hotplug_new(int *fd);
+void monome_platform_hotplug_free(monome_platform_hotplug_t *monitor);
+int monome_platform_hotplug_next(monome_platform_hotplug_t *monitor,
+                                 char **path, int *arrived);
+
 void *m_malloc(size_t size);
 void *m_calloc(size_t nmemb, size_t size);
+void *m_realloc(void *ptr, size_t size);
 void *m_strdup(const char *s);
 void m_free(void *ptr);
 void m_sleep(uint_t msec);
+
+/* a whole file, mapped read-only. NULL if it can't be, or is empty. */
+const void *m_map_file(const char *path, size_t *size);
+void m_unmap_file(const void *map, size_t size);
+
+/* monotonic clock, for measuring intervals only */
+uint64_t m_now_ns(void);
+
+/* threads and cross-thread wakeups (platform/pthread.c). m_thread_start()
+   returns NULL where there's no thread support. */
+typedef struct m_thread m_thread_t;
+
+m_thread_t *m_thread_start(void *(*func)(void *), void *arg);
+void m_thread_join(m_thread_t *thread);
+
+/* fds[0] becomes readable once fds[1] is signalled, until it's cleared */
+int m_wakeup_new(int fds[2]);
+void m_wakeup_free(int fds[2]);
+void m_wakeup_signal(int fd);
+void m_wakeup_clear(int fd);
+int m_wakeup_wait(int fd, int timeout_ms);
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "internal.h"
+
+/**
+ * trace replay (replay.c)
+ *
+ * a device opened with monome_open_replay() reads the inbound records of
+ * a trace instead of a tty, and whatever is written to it goes nowhere.
+ * the protocol opens it as it would a tty, but the platform leaves it
+ * alone, and mext takes its id and size from the trace instead of waiting
+ * to be told. the trace is mapped into memory, so reads are copies.
+ */
+
+typedef struct monome_replay monome_replay_t;
+
+/* map the trace at `path`, filling in `header`. NULL if it can't be read
+   or isn't a trace. */
+monome_replay_t *monome_replay_new(const char *path, uint_t flags,
+                                   monome_trace_header_t *header);
+
+/* stands in for monome_platform_read_nonblock(). waits for the next
+   record to be due unless replaying as fast as possible, and returns -1
+   once there are no more. */
+ssize_t monome_replay_read(monome_t *monome, uint8_t *buf, size_t nbyte);
+
+void monome_replay_free(monome_replay_t *replay);
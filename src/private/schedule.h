@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "internal.h"
+
+/**
+ * paced led output (schedule.c)
+ *
+ * the public led calls describe which leds they're about to change with
+ * monome_sched_begin(). while an output rate is set, the messages the
+ * protocol writes for them wait in monome->sched instead of going out.
+ * they're released no faster than the link drains, and once a later call
+ * overwrites every led a waiting message touches, that message is dropped.
+ */
+
+#define SCHED_RECT(x0, y0, x1, y1) \
+	((monome_sched_rect_t) { (x0), (y0), (x1), (y1) })
+
+/* everything, for led_all and friends */
+#define SCHED_RECT_ALL SCHED_RECT(0, 0, 0xFFFF, 0xFFFF)
+
+/* arc rings are laid out as rows of this many leds */
+#define SCHED_RING_LEDS 64
+
+void monome_sched_begin(monome_t *monome, monome_sched_kind_t kind,
+                        monome_sched_rect_t touches,
+                        monome_sched_rect_t covers);
+
+/* returns `ret`, so that a call can end with
+   `return monome_sched_end(monome, monome->led->set(...));` */
+int monome_sched_end(monome_t *monome, int ret);
+
+/* ask for the led call in progress to go out ahead of anything waiting,
+   which it will unless it touches leds that waiting messages might also
+   change. call between monome_sched_begin() and the protocol call. */
+void monome_sched_urgent(monome_t *monome);
+
+/* an urgent message went straight out; count it against the rate */
+void monome_sched_charge(monome_t *monome, size_t nbyte);
+
+/* the led call in progress is adding to monome->tx. remember what it
+   touches until the buffer is flushed. */
+void monome_sched_note_buffered(monome_t *monome);
+
+/* take a message written during a call. returns nbyte, or -1 on error. */
+ssize_t monome_sched_push(monome_t *monome, const uint8_t *buf, size_t nbyte);
+
+/* send whatever the rate allows. returns 0, or -1 on a write error. */
+int monome_sched_pump(monome_t *monome);
+
+/* milliseconds until monome_sched_pump() can send more, or -1 if nothing
+   is waiting */
+int monome_sched_next_ms(monome_t *monome);
+
+/* bytes waiting to be released */
+size_t monome_sched_pending(monome_t *monome);
+
+/* poll group helpers: shorten a wait so that it ends when some member's
+   output is due, and pump every member afterwards */
+int monome_sched_group_timeout(monome_poll_group_t *group, int timeout_ms);
+void monome_sched_group_pump(monome_poll_group_t *group);
+
+/* send everything that's waiting, whatever the rate. returns 0, or -1 on
+   a write error. */
+int monome_sched_flush(monome_t *monome);
+
+void monome_sched_free(monome_t *monome);
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/**
+ * performance counters (stats.c)
+ *
+ * monome->stats is NULL until monome_set_stats() switches them on, and
+ * every hook below is a single test of that pointer otherwise. counters
+ * may be bumped from an event queue's reader thread or a writer thread
+ * while the app reads them, so they're relaxed atomics where the compiler
+ * has them. nothing here orders anything else.
+ */
+
+#if !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+
+typedef _Atomic uint64_t m_counter_t;
+
+#define COUNTER_ADD(c, n) \
+	atomic_fetch_add_explicit(&(c), (n), memory_order_relaxed)
+#define COUNTER_GET(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#define COUNTER_SET(c, n) \
+	atomic_store_explicit(&(c), (n), memory_order_relaxed)
+#else
+typedef volatile uint64_t m_counter_t;
+
+#define COUNTER_ADD(c, n) ((c) += (n))
+#define COUNTER_GET(c) (c)
+#define COUNTER_SET(c, n) ((c) = (n))
+#endif
+
+/* the public monome_stats_t, field for field */
+struct monome_stats_block {
+	m_counter_t bytes_in, bytes_out;
+	m_counter_t messages_in, messages_out;
+	m_counter_t messages_in_by_header[256];
+	m_counter_t messages_out_by_header[256];
+
+	m_counter_t reads, writes;
+	m_counter_t short_writes, write_again;
+
+	m_counter_t resyncs;
+	m_counter_t events_dispatched, events_dropped;
+
+	m_counter_t read_to_callback[MONOME_STATS_BUCKETS];
+	m_counter_t callback_duration[MONOME_STATS_BUCKETS];
+};
+
+#define STATS_ADD(monome, field, n) do { \
+	if( (monome)->stats ) \
+		COUNTER_ADD((monome)->stats->field, (n)); \
+} while( 0 )
+
+/* a read() of the device, which returned `bytes` */
+void monome_stats_read(monome_t *monome, ssize_t bytes);
+
+/* a write() of `nbyte` bytes, of which `written` went out */
+void monome_stats_write(monome_t *monome, size_t nbyte, ssize_t written);
+
+/* a message starting with `header`, from an led call or off the wire */
+void monome_stats_message_out(monome_t *monome, uint8_t header);
+void monome_stats_message_in(monome_t *monome, uint8_t header);
+
+/* call the app's handler for `e`, which was read at `stamp` (or 0 if
+   unknown), timing it when stats are on. returns 1 if it was called. */
+int monome_stats_dispatch(monome_t *monome, const monome_event_t *e,
+                          uint64_t stamp);
+
+void monome_stats_free(monome_t *monome);
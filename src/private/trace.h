@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "internal.h"
+
+/**
+ * wire traces (trace.c)
+ *
+ * a trace is what monome_record_start() saw go over the wire: a header
+ * describing the device, then one record per chunk read or written.
+ * integers are little-endian. the header is
+ *
+ *   0    magic, TRACE_MAGIC
+ *   8    version (16 bits)
+ *   10   rows, cols (16 bits each), then 2 bytes of padding
+ *   16   link rate in bytes per second, 0 if unknown (32 bits), then 4
+ *        bytes of padding
+ *   24   protocol, serial and friendly name, NUL-padded to 16, 32 and 40
+ *        bytes
+ *
+ * and a record is
+ *
+ *   direction   1 byte, a monome_wire_direction_t
+ *   delta       varint, ns since the previous record in that direction
+ *               (or since the recording started)
+ *   length      varint
+ *   bytes       `length` of them
+ *
+ * varints are LEB128: seven bits at a time, lowest first, with the top bit
+ * set on every byte but the last. each direction is only ever recorded
+ * from one thread, so timing them separately needs no locking, and every
+ * record goes to the file in a single fwrite().
+ */
+
+#define TRACE_MAGIC "MONOTRCE"
+#define TRACE_VERSION 1
+
+#define TRACE_HEADER_SIZE 112
+
+/* a write bigger than this is recorded as several records */
+#define TRACE_CHUNK_MAX MONOME_TXQ_SIZE
+
+typedef struct {
+	uint_t version;
+	uint_t rows, cols;
+	uint_t link_rate;        /* bytes per second, or 0 if unknown */
+	char proto[16];
+	char serial[32];
+	char friendly[40];
+} monome_trace_header_t;
+
+typedef struct {
+	monome_wire_direction_t direction;
+	uint64_t ns;             /* since the recording started */
+	const uint8_t *data;
+	size_t nbyte;
+} monome_trace_record_t;
+
+/* walks the records of a trace held in memory */
+typedef struct {
+	const uint8_t *buf;
+	size_t len, pos;
+	uint64_t last[2];
+} monome_trace_cursor_t;
+
+/* parse the header at the start of `buf`, and point `cursor` at the first
+   record. returns 0, or -1 if it isn't a trace we understand. */
+int monome_trace_open(const uint8_t *buf, size_t len,
+                      monome_trace_header_t *header,
+                      monome_trace_cursor_t *cursor);
+
+/* returns 1 with the next record, 0 at the end, or -1 if the trace is cut
+   short or corrupt */
+int monome_trace_next(monome_trace_cursor_t *cursor,
+                      monome_trace_record_t *record);
+
+/* recording, see monome_record_start() */
+typedef struct monome_trace monome_trace_t;
+
+void monome_trace_record(monome_t *monome, monome_wire_direction_t direction,
+                         uint64_t ns, const uint8_t *buf, size_t nbyte);
+void monome_trace_stop(monome_t *monome);
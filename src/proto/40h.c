@@ -24,6 +24,7 @@
 #include "platform.h"
 #include "rotation.h"
 #include "monobright.h"
+#include "io.h"
 
 #include "40h.h"
 
@@ -32,7 +33,7 @@
  */
 
 static int monome_write(monome_t *monome, const uint8_t *buf, ssize_t bufsize) {
-	if( monome_platform_write(monome, buf, bufsize) == bufsize )
+	if( monome_io_write(monome, buf, bufsize) == bufsize )
 		return 0;
 
 	return -1;
@@ -83,11 +84,14 @@ static int proto_40h_led_all(monome_t *monome, uint_t status) {
 	uint_t i;
 	uint8_t buf[2] = {0, (status) ? 0xFF : 0};
 
+	monome_io_begin(monome);
+
 	for( i = 0; i < 8; i++ ) {
 		buf[0] = PROTO_40h_LED_ROW | (i & 0xF);
 		monome_write(monome, buf, sizeof(buf));
 	}
 
+	monome_io_end(monome);
 	return sizeof(buf) * i;
 }
 
@@ -129,9 +133,12 @@ static int proto_40h_led_map(monome_t *monome, uint_t x_off, uint_t y_off,
 	memcpy(buf, data, 8);
 	ROTSPEC(monome).map_cb(monome, buf);
 
+	monome_io_begin(monome);
+
 	for( i = 0; i < 8; i++ )
 		ret += proto_40h_led_col_row(monome, PROTO_40h_LED_ROW, i, &buf[i]);
 
+	monome_io_end(monome);
 	return ret;
 }
 
@@ -234,14 +241,8 @@ static monome_tilt_functions_t proto_40h_tilt_functions = {
  * module interface
  */
 
-static int proto_40h_next_event(monome_t *monome, monome_event_t *e) {
-	uint8_t buf[2] = {0, 0};
-	ssize_t read;
-
-	read = monome_platform_read(monome, buf, sizeof(buf));
-	if (read < sizeof(buf))
-		return read;
-
+static int proto_40h_decode_event(monome_t *monome, const uint8_t *buf,
+                                  monome_event_t *e) {
 	switch( buf[0] ) {
 	case PROTO_40h_BUTTON_DOWN:
 	case PROTO_40h_BUTTON_UP:
@@ -277,6 +278,22 @@ tilt_common: /* I SAID SHUT UP */
 	return 0;
 }
 
+static size_t proto_40h_decode(monome_t *monome, const uint8_t *buf,
+                               size_t nbyte, monome_event_t *e, int *produced) {
+	/* every 40h message is two bytes */
+	if( nbyte < 2 )
+		return 0;
+
+	*produced = proto_40h_decode_event(monome, buf, e);
+	return 2;
+}
+
+static int proto_40h_next_events(monome_t *monome, monome_event_t *events,
+                                 uint64_t *stamps, size_t max) {
+	return monome_io_next_events(monome, proto_40h_decode, events, stamps,
+	                             max);
+}
+
 static int proto_40h_open(monome_t *monome, const char *dev,
 						  const char *serial, const monome_devmap_t *m,
 						  va_list args) {
@@ -311,13 +328,24 @@ monome_t *monome_protocol_new(void) {
 	monome->close = proto_40h_close;
 	monome->free = proto_40h_free;
 
-	monome->next_event = proto_40h_next_event;
+	monome->next_events = proto_40h_next_events;
 
 	monome->led = &proto_40h_led_functions;
 	monome->led_level = &proto_40h_led_level_functions;
 	monome->led_ring = NULL;
 	monome->tilt = &proto_40h_tilt_functions;
 
+	/* every message is two bytes. there's no native clear or frame, so
+	   both of those are eight row messages. */
+	monome->led_cost = (monome_led_cost_t) {
+		.set = 2, .level_set = 2,
+		.row = 2, .level_row = 2,
+		.col = 2, .level_col = 2,
+		.map = 16, .level_map = 16,
+		.all = 16, .level_all = 16,
+		.monobright = 1
+	};
+
 	MONOME_40H_T(monome)->tilt.x = 0;
 	MONOME_40H_T(monome)->tilt.y = 0;
 
@@ -23,6 +23,9 @@
 #include "internal.h"
 #include "platform.h"
 #include "rotation.h"
+#include "io.h"
+#include "descriptor.h"
+#include "stats.h"
 
 #include "mext.h"
 
@@ -39,29 +42,7 @@ static ssize_t mext_write_msg(monome_t *monome, mext_msg_t *msg) {
 	payload_length = outgoing_payload_lengths[msg->addr][msg->cmd];
 	msg->header = ((msg->addr & 0xF ) << 4) | (msg->cmd & 0xF);
 
-	return monome_platform_write(monome, &msg->header, 1 + payload_length);
-}
-
-static ssize_t mext_read_msg(monome_t *monome, mext_msg_t *msg) {
-	size_t payload_length;
-	ssize_t read;
-
-	if ((read = monome_platform_read(monome, &msg->header, 1)) <= 0)
-		return read;
-
-	msg->addr = msg->header >> 4;
-	msg->cmd  = msg->header & 0xF;
-
-	payload_length = incoming_payload_lengths[msg->addr][msg->cmd];
-
-	if( !payload_length )
-		return 1;
-
-	if( monome_platform_read(monome, (uint8_t *) &msg->payload, payload_length)
-		!= payload_length )
-		return -1;
-
-	return 1 + payload_length;
+	return monome_io_write(monome, &msg->header, 1 + payload_length);
 }
 
 static ssize_t mext_simple_cmd(monome_t *monome, mext_cmd_t cmd) {
@@ -179,6 +160,8 @@ static int mext_led_map(monome_t *monome, uint_t x_off, uint_t y_off,
 
 static int mext_led_row(monome_t *monome, uint_t x_off, uint_t y,
                         size_t count, const uint8_t *data) {
+	monome_io_begin(monome);
+
 	if( ROTSPEC(monome).flags & ROW_REVBITS ) {
 		for( ; count--; x_off += 8, data++ )
 			mext_led_row_col(
@@ -189,11 +172,14 @@ static int mext_led_row(monome_t *monome, uint_t x_off, uint_t y,
 				monome, CMD_LED_ROW, x_off, y, *data);
 	}
 
+	monome_io_end(monome);
 	return 1;
 }
 
 static int mext_led_col(monome_t *monome, uint_t x, uint_t y_off,
                         size_t count, const uint8_t *data) {
+	monome_io_begin(monome);
+
 	if( ROTSPEC(monome).flags & COL_REVBITS ) {
 		for( ; count--; y_off += 8, data++ )
 			mext_led_row_col(
@@ -204,6 +190,7 @@ static int mext_led_col(monome_t *monome, uint_t x, uint_t y_off,
 				monome, CMD_LED_COLUMN, x, y_off, *data);
 	}
 
+	monome_io_end(monome);
 	return 1;
 }
 
@@ -283,21 +270,27 @@ static int mext_led_level_map(monome_t *monome, uint_t x_off, uint_t y_off,
 
 static int mext_led_level_row(monome_t *monome, uint_t x_off, uint_t row,
                               size_t count, const uint8_t *data) {
+	monome_io_begin(monome);
+
 	for( count >>= 3; count--; x_off += 8, data += 8 )
 		mext_led_level_row_col(
 			monome, CMD_LED_LEVEL_ROW, ROTSPEC(monome).flags & ROW_REVBITS,
 			x_off, row, data);
 
+	monome_io_end(monome);
 	return 1;
 }
 
 static int mext_led_level_col(monome_t *monome, uint_t col, uint_t y_off,
                               size_t count, const uint8_t *data) {
+	monome_io_begin(monome);
+
 	for( count >>= 3; count--; y_off += 8, data += 8 )
 		mext_led_level_row_col(
 			monome, CMD_LED_LEVEL_COLUMN, ROTSPEC(monome).flags & COL_REVBITS,
 			col, y_off, data);
 
+	monome_io_end(monome);
 	return 1;
 }
 
@@ -454,6 +447,23 @@ static int mext_handler_noop(struct mext *self, const struct mext_msg *msg,
 	return 0;
 }
 
+/* every answer to the queries mext_open() sent from a cache entry is in.
+   they may have been decoded on an event queue's reader, which mustn't
+   change what the app's thread is reading, so a device that isn't what
+   the entry said only takes effect in monome_descriptor_settle(). */
+static void mext_cache_checked(struct mext *self) {
+	monome_t *monome = MONOME_T(self);
+
+	if( strcmp(self->id, monome->reported.friendly)
+	    || monome->cols != monome->reported.cols
+	    || monome->rows != monome->reported.rows )
+		monome_descriptor_check(monome, DESCRIPTOR_MISMATCHED);
+	else
+		monome_descriptor_check(monome, DESCRIPTOR_CONFIRMED);
+
+	self->validating = 0;
+}
+
 static int mext_handler_system(struct mext *self, const struct mext_msg *msg,
 		monome_event_t *e) {
 	switch( msg->cmd ) {
@@ -462,10 +472,16 @@ static int mext_handler_system(struct mext *self, const struct mext_msg *msg,
 		break;
 
 	case CMD_SYSTEM_ID:
-		strncpy(self->id, (char *) msg->payload.id, 32);
-		self->id[32] = '\0'; /* just in case */
-
-		MONOME_T(self)->friendly = self->id;
+		if( self->validating ) {
+			strncpy(MONOME_T(self)->reported.friendly,
+			        (char *) msg->payload.id, 32);
+			MONOME_T(self)->reported.friendly[32] = '\0';
+		} else {
+			strncpy(self->id, (char *) msg->payload.id, 32);
+			self->id[32] = '\0'; /* just in case */
+
+			MONOME_T(self)->friendly = self->id;
+		}
 
 		self->need_responses &= ~MEXT_NEED_ID;
 		break;
@@ -474,8 +490,13 @@ static int mext_handler_system(struct mext *self, const struct mext_msg *msg,
 		break;
 
 	case CMD_SYSTEM_GRIDSZ:
-		MONOME_T(self)->cols = msg->payload.gridsz.x;
-		MONOME_T(self)->rows = msg->payload.gridsz.y;
+		if( self->validating ) {
+			MONOME_T(self)->reported.cols = msg->payload.gridsz.x;
+			MONOME_T(self)->reported.rows = msg->payload.gridsz.y;
+		} else {
+			MONOME_T(self)->cols = msg->payload.gridsz.x;
+			MONOME_T(self)->rows = msg->payload.gridsz.y;
+		}
 
 		self->need_responses &= ~MEXT_NEED_GRID_SIZE;
 		break;
@@ -490,6 +511,9 @@ static int mext_handler_system(struct mext *self, const struct mext_msg *msg,
 		break;
 	}
 
+	if( self->validating && !self->need_responses )
+		mext_cache_checked(self);
+
 	return 0;
 }
 
@@ -562,32 +586,175 @@ static mext_handler_t subsystem_event_handlers[16] = {
 	[SS_TILT]     = mext_handler_tilt
 };
 
+/* the events each subsystem produces, so that masked ones can be skipped
+   without being decoded */
+static const uint_t subsystem_events[16] = {
+	[SS_KEY_GRID] = MONOME_EVENT_MASK(MONOME_BUTTON_UP)
+	              | MONOME_EVENT_MASK(MONOME_BUTTON_DOWN),
+	[SS_ENCODER]  = MONOME_EVENT_MASK(MONOME_ENCODER_DELTA)
+	              | MONOME_EVENT_MASK(MONOME_ENCODER_KEY_UP)
+	              | MONOME_EVENT_MASK(MONOME_ENCODER_KEY_DOWN),
+	[SS_TILT]     = MONOME_EVENT_MASK(MONOME_TILT)
+};
+
 /**
  * device control functions
  */
 
-static int mext_next_event(monome_t *monome, monome_event_t *e) {
+/* decode a single message out of the receive buffer. anything short of a
+   whole message is left where it is until the next monome_io_fill(). */
+static size_t mext_decode_msg(monome_t *monome, const uint8_t *data,
+                              size_t nbyte, monome_event_t *e, int *produced) {
 	SELF_FROM(monome);
 	mext_msg_t msg = {0, 0};
-	ssize_t status;
+	size_t payload_length;
+
+	msg.header = data[0];
+	msg.addr = msg.header >> 4;
+	msg.cmd  = msg.header & 0xF;
+
+	payload_length = incoming_payload_lengths[msg.addr][msg.cmd];
+
+	if( nbyte < 1 + payload_length )
+		return 0;
+
+	/* every message we know of has a payload, so this byte isn't the
+	   start of one. skip it and try the next. */
+	if( !payload_length ) {
+		STATS_ADD(monome, resyncs, 1);
+		*produced = 0;
+		return 1;
+	}
+
+	monome_stats_message_in(monome, msg.header);
+
+	/* nobody wants anything this subsystem has to say */
+	if( subsystem_events[msg.addr]
+	    && !(subsystem_events[msg.addr] & ~monome->event_ignore) ) {
+		STATS_ADD(monome, events_dropped, 1);
+		*produced = 0;
+		return 1 + payload_length;
+	}
+
+	memcpy(&msg.payload, data + 1, payload_length);
 
-	while ((status = mext_read_msg(monome, &msg)) > 0) {
-		if (msg.addr == SS_SYSTEM) {
-			subsystem_event_handlers[0](self, &msg, e);
+	/* system messages never propagate, their handler just updates our
+	   state */
+	*produced = subsystem_event_handlers[msg.addr](self, &msg, e);
+	return 1 + payload_length;
+}
+
+static int mext_next_events(monome_t *monome, monome_event_t *events,
+                            uint64_t *stamps, size_t max) {
+	SELF_FROM(monome);
+	monome_event_t *e;
+	size_t count = 0, i;
+	int ret;
+
+	/* anything that came in while we were opening goes first */
+	while( self->early_count && count < max ) {
+		i = self->early_start++;
+		e = &self->early[i];
+		self->early_count--;
+
+		if( !MONOME_EVENT_WANTED(monome, e->event_type) ) {
+			STATS_ADD(monome, events_dropped, 1);
 			continue;
 		}
 
-		if(subsystem_event_handlers[msg.addr](self, &msg, e))
-			return 1;
+		if( stamps )
+			stamps[count] = self->early_stamps[i];
+
+		events[count++] = *e;
 	}
 
-	return status;
+	if( count == max )
+		return count;
+
+	ret = monome_io_next_events(monome, mext_decode_msg, &events[count],
+	                            stamps ? &stamps[count] : NULL, max - count);
+
+	if( ret < 0 )
+		return count ? (int) count : ret;
+
+	return count + ret;
+}
+
+/* resend whatever hasn't been answered this often, in case the device
+   wasn't listening yet */
+#define MEXT_QUERY_RETRY_MS 250
+
+#define NS_PER_MS 1000000ULL
+
+/* every query still waiting for an answer, in a single write */
+static void mext_send_queries(monome_t *monome) {
+	SELF_FROM(monome);
+
+	monome_io_begin(monome);
+
+	if( self->need_responses & MEXT_NEED_QUERY )
+		mext_simple_cmd(monome, CMD_SYSTEM_QUERY);
+	if( self->need_responses & MEXT_NEED_ID )
+		mext_simple_cmd(monome, CMD_SYSTEM_GET_ID);
+	if( self->need_responses & MEXT_NEED_GRID_SIZE )
+		mext_simple_cmd(monome, CMD_SYSTEM_GET_GRIDSZ);
+
+	monome_io_end(monome);
+}
+
+static void mext_keep_early(mext_t *self, const monome_event_t *events,
+                            const uint64_t *stamps, int count) {
+	int i;
+
+	for( i = 0; i < count && self->early_count < MEXT_EARLY_EVENTS; i++ ) {
+		self->early_stamps[self->early_count] = stamps[i];
+		self->early[self->early_count++] = events[i];
+	}
+}
+
+/* ask for everything at once and take the answers as they come, until
+   they're all in or `timeout` ms have passed */
+static int mext_handshake(monome_t *monome, uint_t timeout) {
+	SELF_FROM(monome);
+	monome_event_t events[MONOME_EVENT_BATCH_SIZE];
+	uint64_t stamps[MONOME_EVENT_BATCH_SIZE];
+	uint64_t now, deadline, retry, until;
+	int count;
+
+	now = m_now_ns();
+	deadline = now + (uint64_t) timeout * NS_PER_MS;
+	retry = now;
+
+	while( self->need_responses ) {
+		if( (now = m_now_ns()) >= deadline )
+			return -1;
+
+		if( now >= retry ) {
+			mext_send_queries(monome);
+			retry = now + (MEXT_QUERY_RETRY_MS * NS_PER_MS);
+		}
+
+		until = (retry < deadline) ? retry : deadline;
+
+		if( monome_platform_wait_for_input(monome,
+		        (until - now + NS_PER_MS - 1) / NS_PER_MS) < 0 )
+			return -1;
+
+		while( (count = monome_io_next_events(monome, mext_decode_msg,
+		                                      events, stamps,
+		                                      MONOME_EVENT_BATCH_SIZE)) > 0 )
+			mext_keep_early(self, events, stamps, count);
+
+		if( count < 0 )
+			return -1;
+	}
+
+	return 0;
 }
 
 static int mext_open(monome_t *monome, const char *dev, const char *serial,
                      const monome_devmap_t *m, va_list args) {
 	SELF_FROM(monome);
-	monome_event_t e;
 
 	if( monome_platform_open(monome, m, dev) )
 		return -1;
@@ -595,23 +762,31 @@ static int mext_open(monome_t *monome, const char *dev, const char *serial,
 	monome->serial = serial;
 	monome->friendly = m->friendly;
 
-#define QUERY_IF_NEEDED(resp, cmd)											\
-	do {																	\
-		if( self->need_responses & resp )									\
-			mext_simple_cmd(monome, cmd);									\
-	} while( 0 )
+	/* the cache already knows the answers. ask anyway and check them as
+	   they come in, but don't wait for them. */
+	if( monome->descriptor && DESCRIPTOR_HAS_SIZE(monome->descriptor) ) {
+		strncpy(self->id, monome->descriptor->friendly, 32);
+		self->id[32] = '\0';
 
-	do {
-		QUERY_IF_NEEDED(MEXT_NEED_QUERY, CMD_SYSTEM_QUERY);
-		QUERY_IF_NEEDED(MEXT_NEED_ID, CMD_SYSTEM_GET_ID);
-		QUERY_IF_NEEDED(MEXT_NEED_GRID_SIZE, CMD_SYSTEM_GET_GRIDSZ);
+		monome->friendly = self->id;
+		monome->rows = monome->descriptor->rows;
+		monome->cols = monome->descriptor->cols;
 
-		if (monome_platform_wait_for_input(monome, 250) < 0
-				|| mext_next_event(monome, &e) < 0)
-			return -1;
-	} while( self->need_responses );
+		/* a trace being replayed has nothing to check against */
+		if( monome->replay ) {
+			self->need_responses = 0;
+			return 0;
+		}
 
-#undef QUERY_IF_NEEDED
+		self->validating = 1;
+		mext_send_queries(monome);
+		return 0;
+	}
+
+	if( mext_handshake(monome, monome->open_timeout) ) {
+		monome_platform_close(monome);
+		return -1;
+	}
 
 	return 0;
 }
@@ -626,6 +801,34 @@ static void mext_free(monome_t *monome) {
 	m_free(self);
 }
 
+/* every grid led command is one header byte plus its payload */
+#define LED_CMD_COST(cmd) (1 + outgoing_payload_lengths[SS_LED_GRID][cmd])
+#define RING_CMD_COST(cmd) (1 + outgoing_payload_lengths[SS_LED_RING][cmd])
+
+static void mext_init_led_cost(monome_t *monome) {
+	monome_led_cost_t *cost = &monome->led_cost;
+
+	cost->set       = LED_CMD_COST(CMD_LED_ON);
+	cost->level_set = LED_CMD_COST(CMD_LED_LEVEL_SET);
+	cost->row       = LED_CMD_COST(CMD_LED_ROW);
+	cost->level_row = LED_CMD_COST(CMD_LED_LEVEL_ROW);
+	cost->col       = LED_CMD_COST(CMD_LED_COLUMN);
+	cost->level_col = LED_CMD_COST(CMD_LED_LEVEL_COLUMN);
+	cost->map       = LED_CMD_COST(CMD_LED_MAP);
+	cost->level_map = LED_CMD_COST(CMD_LED_LEVEL_MAP);
+	cost->all       = LED_CMD_COST(CMD_LED_ALL_ON);
+	cost->level_all = LED_CMD_COST(CMD_LED_LEVEL_ALL);
+	cost->monobright = 0;
+
+	cost->ring_set   = RING_CMD_COST(CMD_LED_RING_SET);
+	cost->ring_all   = RING_CMD_COST(CMD_LED_RING_ALL);
+	cost->ring_map   = RING_CMD_COST(CMD_LED_RING_MAP);
+	cost->ring_range = RING_CMD_COST(CMD_LED_RING_RANGE);
+}
+
+#undef RING_CMD_COST
+#undef LED_CMD_COST
+
 #if defined(EMBED_PROTOS)
 monome_t *monome_protocol_mext_new(void) {
 #else
@@ -641,7 +844,7 @@ monome_t *monome_protocol_new(void) {
 	monome->close = mext_close;
 	monome->free  = mext_free;
 
-	monome->next_event = mext_next_event;
+	monome->next_events = mext_next_events;
 
 	monome->led = &mext_led_functions;
 	monome->led_level = &mext_led_level_functions;
@@ -651,5 +854,7 @@ monome_t *monome_protocol_new(void) {
 	self->need_responses =
 		MEXT_NEED_QUERY | MEXT_NEED_ID | MEXT_NEED_GRID_SIZE;
 
+	mext_init_led_cost(monome);
+
 	return monome;
 }
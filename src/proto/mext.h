@@ -197,11 +197,25 @@ typedef enum {
 	MEXT_NEED_GRID_SIZE = 1 << 2
 } mext_need_responses_t;
 
+/* how many key, encoder and tilt events that arrive while mext_open() is
+   waiting for the handshake are kept for the app */
+#define MEXT_EARLY_EVENTS 32
+
 struct mext {
 	monome_t monome;
 
 	mext_need_responses_t need_responses;
 	char id[33];
+
+	/* events decoded during the handshake, handed out first by
+	   mext_next_events() */
+	monome_event_t early[MEXT_EARLY_EVENTS];
+	uint64_t early_stamps[MEXT_EARLY_EVENTS];
+	size_t early_start, early_count;
+
+	/* opened from the descriptor cache without waiting for the answers
+	   to the handshake. they're checked against it when they arrive. */
+	int validating;
 };
 
 struct mext_point {
@@ -24,6 +24,7 @@
 #include <monome.h>
 #include "platform.h"
 #include "internal.h"
+#include "stats.h"
 
 #include "osc.h"
 
@@ -201,15 +202,34 @@ static monome_led_ring_functions_t proto_osc_led_ring_functions = {
  * module interface
  */
 
-static int proto_osc_next_event(monome_t *monome, monome_event_t *e) {
+static int proto_osc_next_events(monome_t *monome, monome_event_t *events,
+                                 uint64_t *stamps, size_t max) {
 	SELF_FROM(monome);
+	size_t count = 0;
 
-	self->e_ptr = e;
-	self->have_event = 0;
+	while( count < max ) {
+		self->e_ptr = &events[count];
+		self->have_event = 0;
 
-	lo_server_recv_noblock(self->server, 0);
+		if( !lo_server_recv_noblock(self->server, 0) )
+			break;
 
-	return self->have_event;
+		if( !self->have_event )
+			continue;
+
+		if( !MONOME_EVENT_WANTED(monome, events[count].event_type) ) {
+			STATS_ADD(monome, events_dropped, 1);
+			continue;
+		}
+
+		if( stamps )
+			stamps[count] = m_now_ns();
+
+		count++;
+	}
+
+	self->e_ptr = NULL;
+	return count;
 }
 
 static int proto_osc_open(monome_t *monome, const char *dev,
@@ -315,7 +335,7 @@ monome_t *monome_protocol_new(void) {
 	monome->close      = proto_osc_close;
 	monome->free       = proto_osc_free;
 
-	monome->next_event = proto_osc_next_event;
+	monome->next_events = proto_osc_next_events;
 
 	monome->led = &proto_osc_led_functions;
 	monome->led_level = NULL;
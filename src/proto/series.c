@@ -24,6 +24,7 @@
 #include "platform.h"
 #include "rotation.h"
 #include "monobright.h"
+#include "io.h"
 
 #include "series.h"
 
@@ -33,7 +34,7 @@
 
 static int monome_write(monome_t *monome, const uint8_t *buf,
 						ssize_t bufsize) {
-    if( monome_platform_write(monome, buf, bufsize) == bufsize )
+	if( monome_io_write(monome, buf, bufsize) == bufsize )
 		return 0;
 
 	return -1;
@@ -348,14 +349,8 @@ static monome_tilt_functions_t proto_series_tilt_functions = {
  * module interface
  */
 
-static int proto_series_next_event(monome_t *monome, monome_event_t *e) {
-	uint8_t buf[2] = {0, 0};
-	ssize_t read;
-
-	read = monome_platform_read(monome, buf, sizeof(buf));
-	if (read < sizeof(buf))
-		return read;
-
+static int proto_series_decode_event(monome_t *monome, const uint8_t *buf,
+                                     monome_event_t *e) {
 	switch( buf[0] ) {
 	case PROTO_SERIES_BUTTON_DOWN:
 	case PROTO_SERIES_BUTTON_UP:
@@ -389,6 +384,37 @@ tilt_common: /* I SAID SHUT UP */
 	return 0;
 }
 
+static size_t proto_series_decode(monome_t *monome, const uint8_t *buf,
+                                  size_t nbyte, monome_event_t *e,
+                                  int *produced) {
+	/* every series message is two bytes */
+	if( nbyte < 2 )
+		return 0;
+
+	*produced = proto_series_decode_event(monome, buf, e);
+	return 2;
+}
+
+static int proto_series_next_events(monome_t *monome, monome_event_t *events,
+                                    uint64_t *stamps, size_t max) {
+	return monome_io_next_events(monome, proto_series_decode, events, stamps,
+	                             max);
+}
+
+static void proto_series_init_led_cost(monome_t *monome) {
+	monome_led_cost_t *cost = &monome->led_cost;
+
+	/* levels are emulated with the on/off commands, so they cost the same.
+	   a row or column message always covers the whole device, which only
+	   lines up with a single quad on an 8-wide (or 8-tall) grid. */
+	cost->set = cost->level_set = 2;
+	cost->row = cost->level_row = (monome->cols > 8) ? 0 : 2;
+	cost->col = cost->level_col = (monome->rows > 8) ? 0 : 2;
+	cost->map = cost->level_map = 9;
+	cost->all = cost->level_all = 1;
+	cost->monobright = 1;
+}
+
 static int proto_series_open(monome_t *monome, const char *dev,
 							 const char *serial, const monome_devmap_t *m,
 							 va_list args) {
@@ -397,6 +423,8 @@ static int proto_series_open(monome_t *monome, const char *dev,
 	monome->serial = serial;
 	monome->friendly = m->friendly;
 
+	proto_series_init_led_cost(monome);
+
 	return monome_platform_open(monome, m, dev);
 }
 
@@ -421,7 +449,7 @@ monome_t *monome_protocol_new(void) {
 	monome->open = proto_series_open;
 	monome->close = proto_series_close;
 	monome->free = proto_series_free;
-	monome->next_event = proto_series_next_event;
+	monome->next_events = proto_series_next_events;
 
 	monome->led = &proto_series_led_functions;
 	monome->led_level = &proto_series_led_level_functions;
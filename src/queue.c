@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "io.h"
+#include "coalesce.h"
+#include "descriptor.h"
+
+#define QUEUE_DEFAULT_CAPACITY 1024
+
+/* how long the reader sleeps between checks for monome_event_queue_free() */
+#define QUEUE_POLL_MS 50
+
+/* keeps the producer's and consumer's indices on separate cache lines */
+#define CACHE_LINE 64
+
+/* an event and when its input was read */
+typedef struct {
+	monome_event_t e;
+	uint64_t stamp;
+} queue_slot_t;
+
+/**
+ * a single-producer, single-consumer ring of decoded events. the reader
+ * thread is the only writer of `tail` and the application the only writer
+ * of `head`; each side keeps a stale copy of the other's index and only
+ * reloads it when the ring looks full (or empty).
+ */
+struct monome_event_queue {
+	monome_poll_group_t *group;
+	m_thread_t *reader;
+	int wake[2];
+
+	queue_slot_t *slots;
+	size_t mask;
+
+	atomic_int stop;
+	atomic_int failed;
+	atomic_size_t dropped;
+
+	/* consumer */
+	char pad0[CACHE_LINE];
+	atomic_size_t head;
+	size_t tail_cache;
+
+	/* producer */
+	char pad1[CACHE_LINE];
+	atomic_size_t tail;
+	size_t head_cache;
+	char pad2[CACHE_LINE];
+};
+
+/**
+ * producer (reader thread)
+ */
+
+static int queue_push(monome_event_queue_t *q, const monome_event_t *e,
+                      uint64_t stamp) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if( tail - q->head_cache > q->mask ) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+
+		if( tail - q->head_cache > q->mask ) {
+			atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+			return -1;
+		}
+	}
+
+	q->slots[tail & q->mask].e = *e;
+	q->slots[tail & q->mask].stamp = stamp;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return 0;
+}
+
+static void *queue_reader(void *arg) {
+	monome_event_t events[MONOME_EVENT_BATCH_SIZE];
+	uint64_t stamps[MONOME_EVENT_BATCH_SIZE];
+	monome_event_queue_t *q = arg;
+	monome_poll_group_t *group = q->group;
+	monome_t *monome;
+	unsigned int i;
+	int j, count, pushed;
+
+	while( !atomic_load_explicit(&q->stop, memory_order_acquire) ) {
+		if( monome_platform_poll_group_ready(group, QUEUE_POLL_MS) < 0 )
+			goto err;
+
+		pushed = 0;
+
+		for( i = 0; i < group->count; i++ ) {
+			monome = group->monomes[i];
+
+			if( !monome->poll_ready && !RX_PENDING(monome)
+			    && !monome_coalesce_ready(monome) )
+				continue;
+
+			do {
+				count = monome_event_next_batch_ts(monome, events, stamps,
+				                                   MONOME_EVENT_BATCH_SIZE);
+				if( count < 0 )
+					goto err;
+
+				for( j = 0; j < count; j++ )
+					pushed += !queue_push(q, &events[j], stamps[j]);
+			} while( count == MONOME_EVENT_BATCH_SIZE );
+		}
+
+		if( pushed )
+			m_wakeup_signal(q->wake[1]);
+	}
+
+	return NULL;
+
+err:
+	atomic_store_explicit(&q->failed, 1, memory_order_release);
+	m_wakeup_signal(q->wake[1]);
+	return NULL;
+}
+
+/**
+ * consumer
+ */
+
+static int queue_available(monome_event_queue_t *q) {
+	return atomic_load_explicit(&q->tail, memory_order_acquire)
+		!= atomic_load_explicit(&q->head, memory_order_relaxed);
+}
+
+size_t monome_event_queue_pop_batch(monome_event_queue_t *q,
+                                    monome_event_t *events, size_t max) {
+	return monome_event_queue_pop_batch_ts(q, events, NULL, max);
+}
+
+size_t monome_event_queue_pop_batch_ts(monome_event_queue_t *q,
+                                       monome_event_t *events,
+                                       uint64_t *timestamps, size_t max) {
+	queue_slot_t *slot;
+	size_t head, n, i;
+
+	head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if( q->tail_cache - head < max )
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if( (n = q->tail_cache - head) > max )
+		n = max;
+
+	for( i = 0; i < n; i++ ) {
+		slot = &q->slots[(head + i) & q->mask];
+		events[i] = slot->e;
+
+		if( timestamps )
+			timestamps[i] = slot->stamp;
+	}
+
+	atomic_store_explicit(&q->head, head + n, memory_order_release);
+	return n;
+}
+
+int monome_event_queue_pop(monome_event_queue_t *q, monome_event_t *e) {
+	if( monome_event_queue_pop_batch(q, e, 1) )
+		return 1;
+
+	if( atomic_load_explicit(&q->failed, memory_order_acquire)
+	    && !queue_available(q) )
+		return -1;
+
+	return 0;
+}
+
+int monome_event_queue_get_fd(monome_event_queue_t *q) {
+	return q->wake[0];
+}
+
+int monome_event_queue_wait(monome_event_queue_t *q, int timeout_ms) {
+	int ret;
+
+	/* reset first, so that anything pushed from here on signals again */
+	m_wakeup_clear(q->wake[0]);
+
+	if( queue_available(q) )
+		return 1;
+
+	if( atomic_load_explicit(&q->failed, memory_order_acquire) )
+		return -1;
+
+	if( (ret = m_wakeup_wait(q->wake[0], timeout_ms)) <= 0 )
+		return ret;
+
+	m_wakeup_clear(q->wake[0]);
+
+	if( queue_available(q) )
+		return 1;
+
+	return atomic_load_explicit(&q->failed, memory_order_acquire) ? -1 : 0;
+}
+
+size_t monome_event_queue_get_dropped(monome_event_queue_t *q) {
+	return atomic_load_explicit(&q->dropped, memory_order_relaxed);
+}
+
+/**
+ * lifecycle
+ */
+
+/* draining pending output from the reader thread would race with the
+   app's led calls, so the group stops watching for it while we're
+   running, and the app's next write or monome_flush() sends it instead */
+static void queue_watch_output(monome_poll_group_t *group, int watch) {
+	monome_t *monome;
+	unsigned int i;
+
+	group->threaded = !watch;
+
+	for( i = 0; i < group->count; i++ ) {
+		monome = group->monomes[i];
+
+		if( monome->txq.want_output )
+			monome_platform_poll_group_want_output(group, monome, watch);
+	}
+}
+
+monome_event_queue_t *monome_event_queue_new(monome_poll_group_t *group,
+                                             size_t capacity) {
+	monome_event_queue_t *q;
+	size_t size;
+
+	/* hotplug would have the reader thread opening devices and calling
+	   back into the app */
+	if( !group || !group->count || group->hotplug )
+		return NULL;
+
+	if( !capacity )
+		capacity = QUEUE_DEFAULT_CAPACITY;
+
+	for( size = 1; size < capacity; size <<= 1 )
+		;
+
+	if( !(q = m_calloc(1, sizeof(*q))) )
+		return NULL;
+
+	if( !(q->slots = m_calloc(size, sizeof(*q->slots))) )
+		goto err_slots;
+
+	if( m_wakeup_new(q->wake) )
+		goto err_wakeup;
+
+	q->group = group;
+	q->mask = size - 1;
+
+	queue_watch_output(group, 0);
+
+	atomic_init(&q->stop, 0);
+	atomic_init(&q->failed, 0);
+	atomic_init(&q->dropped, 0);
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+
+	if( !(q->reader = m_thread_start(queue_reader, q)) )
+		goto err_thread;
+
+	return q;
+
+err_thread:
+	queue_watch_output(group, 1);
+	m_wakeup_free(q->wake);
+err_wakeup:
+	m_free(q->slots);
+err_slots:
+	m_free(q);
+	return NULL;
+}
+
+void monome_event_queue_free(monome_event_queue_t *q) {
+	unsigned int i;
+
+	if( !q )
+		return;
+
+	atomic_store_explicit(&q->stop, 1, memory_order_release);
+	m_thread_join(q->reader);
+	queue_watch_output(q->group, 1);
+
+	/* the reader left any cache checks it decoded for this thread */
+	for( i = 0; i < q->group->count; i++ )
+		monome_descriptor_settle(q->group->monomes[i]);
+
+	m_wakeup_free(q->wake);
+	m_free(q->slots);
+	m_free(q);
+}
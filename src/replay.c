@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "trace.h"
+#include "replay.h"
+
+#define NS_PER_MS 1000000ULL
+
+struct monome_replay {
+	const void *map;
+	size_t size;
+	uint_t flags;
+
+	monome_trace_cursor_t cursor;
+
+	/* what's left of a record that didn't fit in the receive buffer */
+	const uint8_t *rest;
+	size_t rest_len;
+
+	/* the trace time of the first inbound record, and when it went out */
+	int started;
+	uint64_t first_ns, start_ns;
+};
+
+/* to within a millisecond, which is as fine as m_sleep() goes */
+static void wait_until(uint64_t due) {
+	uint64_t now;
+
+	while( (now = m_now_ns()) + NS_PER_MS <= due )
+		m_sleep((due - now) / NS_PER_MS);
+}
+
+monome_replay_t *monome_replay_new(const char *path, uint_t flags,
+                                   monome_trace_header_t *header) {
+	monome_replay_t *r;
+
+	if( !(r = m_calloc(1, sizeof(*r))) )
+		return NULL;
+
+	if( !(r->map = m_map_file(path, &r->size)) )
+		goto err_map;
+
+	if( monome_trace_open(r->map, r->size, header, &r->cursor) )
+		goto err_trace;
+
+	r->flags = flags;
+	return r;
+
+err_trace:
+	m_unmap_file(r->map, r->size);
+err_map:
+	m_free(r);
+	return NULL;
+}
+
+ssize_t monome_replay_read(monome_t *monome, uint8_t *buf, size_t nbyte) {
+	monome_replay_t *r = monome->replay;
+	monome_trace_record_t record;
+
+	if( !r->rest_len ) {
+		do {
+			if( monome_trace_next(&r->cursor, &record) <= 0 )
+				return -1;
+		} while( record.direction != MONOME_WIRE_IN );
+
+		if( !(r->flags & MONOME_REPLAY_FAST) ) {
+			if( !r->started ) {
+				r->started = 1;
+				r->first_ns = record.ns;
+				r->start_ns = m_now_ns();
+			} else
+				wait_until(r->start_ns + (record.ns - r->first_ns));
+		}
+
+		r->rest = record.data;
+		r->rest_len = record.nbyte;
+	}
+
+	if( nbyte > r->rest_len )
+		nbyte = r->rest_len;
+
+	memcpy(buf, r->rest, nbyte);
+	r->rest += nbyte;
+	r->rest_len -= nbyte;
+	return nbyte;
+}
+
+void monome_replay_free(monome_replay_t *r) {
+	if( !r )
+		return;
+
+	m_unmap_file(r->map, r->size);
+	m_free(r);
+}
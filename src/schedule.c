@@ -0,0 +1,453 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "io.h"
+#include "schedule.h"
+
+/* how many messages can wait at once. coalescing keeps a grid redraw well
+   under this, and if it does fill up the oldest message goes out early. */
+#define SCHED_CAPACITY 256
+
+/* big enough for any single message we send (a mext level map is 35) */
+#define SCHED_MSG_SIZE 40
+
+/* how much may go out back to back after the link has been idle: 20ms
+   worth, but never less than a couple of level maps */
+#define SCHED_BURST_MS 20
+#define SCHED_MIN_BURST 80
+
+#define NS_PER_S 1000000000LL
+
+typedef struct {
+	monome_sched_key_t key;
+	uint8_t len; /* 0 once superseded */
+	uint8_t data[SCHED_MSG_SIZE];
+} sched_msg_t;
+
+struct monome_sched {
+	int rate;
+
+	/* token bucket, in byte-nanoseconds so that integer maths keeps up with
+	   the clock. may go negative by up to one message. */
+	int64_t tokens, burst;
+	uint64_t last;
+
+	/* a ring of `count` messages starting at `head`, including superseded
+	   ones that haven't been popped yet. `bytes` counts only the live. */
+	sched_msg_t msgs[SCHED_CAPACITY];
+	size_t head, count;
+	size_t bytes;
+
+	uint32_t next_call;
+
+	/* the last call we've dropped superseded messages for */
+	uint32_t scanned;
+};
+
+/**
+ * coalescing
+ */
+
+static int rect_contains(const monome_sched_rect_t *outer,
+                         const monome_sched_rect_t *inner) {
+	if( inner->x1 <= inner->x0 || inner->y1 <= inner->y0 )
+		return 0;
+
+	return outer->x0 <= inner->x0 && inner->x1 <= outer->x1
+	    && outer->y0 <= inner->y0 && inner->y1 <= outer->y1;
+}
+
+static int rect_overlaps(const monome_sched_rect_t *a,
+                         const monome_sched_rect_t *b) {
+	return a->x0 < b->x1 && b->x0 < a->x1
+	    && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static void rect_union(monome_sched_rect_t *into,
+                       const monome_sched_rect_t *r) {
+	if( r->x1 <= r->x0 || r->y1 <= r->y0 )
+		return;
+
+	if( into->x1 <= into->x0 || into->y1 <= into->y0 ) {
+		*into = *r;
+		return;
+	}
+
+	if( r->x0 < into->x0 ) into->x0 = r->x0;
+	if( r->y0 < into->y0 ) into->y0 = r->y0;
+	if( r->x1 > into->x1 ) into->x1 = r->x1;
+	if( r->y1 > into->y1 ) into->y1 = r->y1;
+}
+
+/* whether any waiting message may change one of the leds in `key` */
+static int sched_conflicts(monome_sched_t *s, const monome_sched_key_t *key) {
+	sched_msg_t *msg;
+	size_t i;
+
+	for( i = 0; i < s->count; i++ ) {
+		msg = &s->msgs[(s->head + i) % SCHED_CAPACITY];
+
+		if( msg->len && msg->key.kind == key->kind
+		    && rect_overlaps(&msg->key.touches, &key->touches) )
+			return 1;
+	}
+
+	return 0;
+}
+
+static void sched_supersede(monome_t *monome, const monome_sched_key_t *key) {
+	monome_sched_t *s = monome->sched;
+	sched_msg_t *msg;
+	size_t i;
+
+	for( i = 0; i < s->count; i++ ) {
+		msg = &s->msgs[(s->head + i) % SCHED_CAPACITY];
+
+		if( !msg->len || msg->key.kind != key->kind
+		    || msg->key.call == key->call
+		    || !rect_contains(&key->covers, &msg->key.touches) )
+			continue;
+
+		s->bytes -= msg->len;
+		msg->len = 0;
+		monome->tx_stats.coalesced++;
+	}
+}
+
+/* squeeze out superseded messages, keeping the rest in order */
+static void sched_compact(monome_sched_t *s) {
+	sched_msg_t *src, *dst;
+	size_t i, n;
+
+	for( i = n = 0; i < s->count; i++ ) {
+		src = &s->msgs[(s->head + i) % SCHED_CAPACITY];
+		if( !src->len )
+			continue;
+
+		dst = &s->msgs[(s->head + n++) % SCHED_CAPACITY];
+		if( dst != src )
+			*dst = *src;
+	}
+
+	s->count = n;
+}
+
+/**
+ * rate limiting
+ */
+
+static void sched_refill(monome_sched_t *s) {
+	uint64_t now = m_now_ns();
+	uint64_t elapsed = now - s->last;
+
+	s->last = now;
+
+	if( elapsed > NS_PER_S )
+		elapsed = NS_PER_S;
+
+	s->tokens += (int64_t) elapsed * s->rate;
+	if( s->tokens > s->burst )
+		s->tokens = s->burst;
+}
+
+/* send waiting messages in order while the budget lasts, or all of them.
+   whatever is released goes out in as few writes as fit. */
+static int sched_release(monome_t *monome, int all) {
+	monome_sched_t *s = monome->sched;
+	uint8_t buf[MONOME_TX_BUF_SIZE];
+	sched_msg_t *msg;
+	size_t len = 0;
+
+	sched_refill(s);
+
+	/* the tty is backed up already. anything we sent now would only sit
+	   behind it, where it can no longer be superseded. */
+	if( !all && TXQ_PENDING(monome) && monome_io_drain(monome) )
+		return 0;
+
+	for( ; s->count; s->head = (s->head + 1) % SCHED_CAPACITY, s->count-- ) {
+		msg = &s->msgs[s->head];
+		if( !msg->len )
+			continue;
+
+		if( !all && s->tokens <= 0 )
+			break;
+
+		if( len + msg->len > sizeof(buf) ) {
+			if( monome_io_send(monome, buf, len) < 0 )
+				return -1;
+			len = 0;
+		}
+
+		memcpy(&buf[len], msg->data, msg->len);
+		len += msg->len;
+
+		s->tokens -= msg->len * NS_PER_S;
+		s->bytes -= msg->len;
+	}
+
+	if( !s->count )
+		s->head = 0;
+
+	if( len && monome_io_send(monome, buf, len) < 0 )
+		return -1;
+
+	return 0;
+}
+
+/**
+ * internal
+ */
+
+void monome_sched_begin(monome_t *monome, monome_sched_kind_t kind,
+                        monome_sched_rect_t touches,
+                        monome_sched_rect_t covers) {
+	monome_sched_key_t *key = &monome->sched_key;
+	uint16_t max_x, max_y;
+
+	if( monome->writer )
+		return;
+
+	/* leds off the edge of the device don't exist, so nothing needs to
+	   cover them */
+	switch( kind ) {
+	case SCHED_GRID:
+		max_x = monome_get_cols(monome);
+		max_y = monome_get_rows(monome);
+		break;
+
+	case SCHED_RING:
+		max_x = SCHED_RING_LEDS;
+		max_y = 0xFFFF;
+		break;
+
+	default:
+		max_x = max_y = 0xFFFF;
+		break;
+	}
+
+	if( touches.x1 > max_x )
+		touches.x1 = max_x;
+	if( touches.y1 > max_y )
+		touches.y1 = max_y;
+
+	key->kind = kind;
+	key->touches = touches;
+	key->covers = covers;
+	key->call = monome->sched ? ++monome->sched->next_call : 0;
+}
+
+void monome_sched_urgent(monome_t *monome) {
+	monome_sched_key_t *key = &monome->sched_key;
+
+	if( !key->kind )
+		return;
+
+	/* jumping ahead of a message that may change the same leds would
+	   leave them showing the older state, so take the bulk lane */
+	if( key->kind == SCHED_GRID
+	    && rect_overlaps(&monome->tx.touched, &key->touches) )
+		return;
+
+	if( monome->sched && sched_conflicts(monome->sched, key) )
+		return;
+
+	monome->tx.urgent = 1;
+}
+
+void monome_sched_charge(monome_t *monome, size_t nbyte) {
+	if( monome->sched )
+		monome->sched->tokens -= nbyte * NS_PER_S;
+}
+
+void monome_sched_note_buffered(monome_t *monome) {
+	if( monome->sched_key.kind == SCHED_GRID )
+		rect_union(&monome->tx.touched, &monome->sched_key.touches);
+}
+
+int monome_sched_end(monome_t *monome, int ret) {
+	if( !monome->sched_key.kind )
+		return ret;
+
+	monome->sched_key.kind = SCHED_NONE;
+	monome->tx.urgent = 0;
+
+	/* a bracketed or deferred batch is released when it's done */
+	if( !monome->tx.depth && !monome->tx.deferred )
+		monome_sched_pump(monome);
+
+	return ret;
+}
+
+ssize_t monome_sched_push(monome_t *monome, const uint8_t *buf, size_t nbyte) {
+	monome_sched_t *s = monome->sched;
+	monome_sched_key_t *key = &monome->sched_key;
+	sched_msg_t *msg;
+
+	/* can't happen with the protocols we have, but keep it in order */
+	if( nbyte > SCHED_MSG_SIZE ) {
+		if( sched_release(monome, 1) )
+			return -1;
+
+		return monome_io_send(monome, buf, nbyte);
+	}
+
+	if( s->scanned != key->call ) {
+		sched_supersede(monome, key);
+		s->scanned = key->call;
+	}
+
+	if( s->count == SCHED_CAPACITY ) {
+		sched_compact(s);
+
+		/* still full: the oldest message goes out over budget */
+		if( s->count == SCHED_CAPACITY ) {
+			msg = &s->msgs[s->head];
+			s->head = (s->head + 1) % SCHED_CAPACITY;
+			s->count--;
+			s->bytes -= msg->len;
+			s->tokens -= msg->len * NS_PER_S;
+
+			if( monome_io_send(monome, msg->data, msg->len) < 0 )
+				return -1;
+		}
+	}
+
+	msg = &s->msgs[(s->head + s->count++) % SCHED_CAPACITY];
+	msg->key = *key;
+	msg->len = nbyte;
+	memcpy(msg->data, buf, nbyte);
+
+	s->bytes += nbyte;
+	return nbyte;
+}
+
+int monome_sched_pump(monome_t *monome) {
+	/* the writer thread owns the tty now. monome_writer_start() sent
+	   everything that was waiting, and nothing new is scheduled. */
+	if( monome->writer )
+		return 0;
+
+	if( !monome->sched || !monome->sched->count )
+		return 0;
+
+	return sched_release(monome, 0);
+}
+
+int monome_sched_next_ms(monome_t *monome) {
+	monome_sched_t *s = monome->sched;
+
+	if( !s || !s->bytes )
+		return -1;
+
+	sched_refill(s);
+
+	if( s->tokens > 0 )
+		return 0;
+
+	/* -tokens / rate is in nanoseconds */
+	return (-s->tokens / s->rate) / 1000000 + 1;
+}
+
+size_t monome_sched_pending(monome_t *monome) {
+	return monome->sched ? monome->sched->bytes : 0;
+}
+
+int monome_sched_group_timeout(monome_poll_group_t *group, int timeout_ms) {
+	unsigned int i;
+	int ms;
+
+	for( i = 0; i < group->count; i++ ) {
+		ms = monome_sched_next_ms(group->monomes[i]);
+
+		if( ms >= 0 && (timeout_ms < 0 || ms < timeout_ms) )
+			timeout_ms = ms;
+	}
+
+	return timeout_ms;
+}
+
+void monome_sched_group_pump(monome_poll_group_t *group) {
+	unsigned int i;
+
+	for( i = 0; i < group->count; i++ )
+		monome_sched_pump(group->monomes[i]);
+}
+
+int monome_sched_flush(monome_t *monome) {
+	if( !monome->sched || !monome->sched->count )
+		return 0;
+
+	return sched_release(monome, 1);
+}
+
+void monome_sched_free(monome_t *monome) {
+	if( !monome->sched )
+		return;
+
+	sched_release(monome, 1);
+
+	m_free(monome->sched);
+	monome->sched = NULL;
+}
+
+/**
+ * public
+ */
+
+int monome_set_output_rate(monome_t *monome, int bytes_per_sec) {
+	monome_sched_t *s;
+	int64_t burst;
+
+	if( bytes_per_sec == MONOME_OUTPUT_RATE_LINK ) {
+		if( !monome->link_rate )
+			return MONOME_ERROR_UNSUPPORTED;
+
+		bytes_per_sec = monome->link_rate;
+	}
+
+	if( bytes_per_sec < 0 )
+		return MONOME_ERROR_INVALID_ARG;
+
+	if( !bytes_per_sec ) {
+		monome_sched_free(monome);
+		return MONOME_OK;
+	}
+
+	if( !(s = monome->sched) ) {
+		if( !(s = m_calloc(1, sizeof(*s))) )
+			return MONOME_ERROR_GENERIC;
+
+		s->last = m_now_ns();
+		monome->sched = s;
+	}
+
+	burst = (int64_t) bytes_per_sec * SCHED_BURST_MS / 1000;
+	if( burst < SCHED_MIN_BURST )
+		burst = SCHED_MIN_BURST;
+
+	s->rate = bytes_per_sec;
+	s->burst = burst * NS_PER_S;
+	s->tokens = s->burst;
+	return MONOME_OK;
+}
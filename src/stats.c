@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "stats.h"
+
+/**
+ * histograms
+ *
+ * log-linear, like HdrHistogram: each power of two is split into four
+ * buckets, so a bucket is never more than 25% wider than its floor.
+ * values under 8 ns get a bucket each, and anything past the last bucket
+ * (about 8.6 seconds) is counted in it.
+ */
+
+#define SUB_BITS 2
+#define SUB_BUCKETS (1 << SUB_BITS)
+
+static unsigned int bucket_of(uint64_t ns) {
+	unsigned int msb, bucket;
+
+	if( ns < 2 * SUB_BUCKETS )
+		return ns;
+
+	for( msb = 0; ns >> (msb + 1); msb++ )
+		;
+
+	bucket = (msb - SUB_BITS + 1) * SUB_BUCKETS
+		+ ((ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+
+	return (bucket < MONOME_STATS_BUCKETS) ? bucket : MONOME_STATS_BUCKETS - 1;
+}
+
+/**
+ * internal
+ */
+
+void monome_stats_read(monome_t *monome, ssize_t bytes) {
+	monome_stats_block_t *s = monome->stats;
+
+	if( !s )
+		return;
+
+	COUNTER_ADD(s->reads, 1);
+
+	if( bytes > 0 )
+		COUNTER_ADD(s->bytes_in, bytes);
+}
+
+void monome_stats_write(monome_t *monome, size_t nbyte, ssize_t written) {
+	monome_stats_block_t *s = monome->stats;
+
+	if( !s )
+		return;
+
+	COUNTER_ADD(s->writes, 1);
+
+	if( written <= 0 ) {
+		/* the tty's output buffer is full (EAGAIN), or it failed, which
+		   tx_stats.errors already counts */
+		if( !written )
+			COUNTER_ADD(s->write_again, 1);
+		return;
+	}
+
+	COUNTER_ADD(s->bytes_out, written);
+
+	if( written < nbyte )
+		COUNTER_ADD(s->short_writes, 1);
+}
+
+void monome_stats_message_out(monome_t *monome, uint8_t header) {
+	monome_stats_block_t *s = monome->stats;
+
+	if( !s )
+		return;
+
+	COUNTER_ADD(s->messages_out, 1);
+	COUNTER_ADD(s->messages_out_by_header[header], 1);
+}
+
+void monome_stats_message_in(monome_t *monome, uint8_t header) {
+	monome_stats_block_t *s = monome->stats;
+
+	if( !s )
+		return;
+
+	COUNTER_ADD(s->messages_in, 1);
+	COUNTER_ADD(s->messages_in_by_header[header], 1);
+}
+
+int monome_stats_dispatch(monome_t *monome, const monome_event_t *e,
+                          uint64_t stamp) {
+	monome_callback_t *handler = &monome->handlers[e->event_type];
+	monome_stats_block_t *s = monome->stats;
+	uint64_t start;
+
+	if( !handler->cb ) {
+		STATS_ADD(monome, events_dropped, 1);
+		return 0;
+	}
+
+	/* for monome_event_get_timestamp() */
+	monome->dispatching = e;
+	monome->dispatching_ns = stamp;
+
+	if( !s ) {
+		handler->cb(e, handler->data);
+		monome->dispatching = NULL;
+		return 1;
+	}
+
+	start = m_now_ns();
+
+	if( stamp && start >= stamp )
+		COUNTER_ADD(s->read_to_callback[bucket_of(start - stamp)], 1);
+
+	handler->cb(e, handler->data);
+	monome->dispatching = NULL;
+
+	COUNTER_ADD(s->callback_duration[bucket_of(m_now_ns() - start)], 1);
+	COUNTER_ADD(s->events_dispatched, 1);
+	return 1;
+}
+
+void monome_stats_free(monome_t *monome) {
+	m_free(monome->stats);
+	monome->stats = NULL;
+}
+
+/**
+ * public
+ */
+
+int monome_set_stats(monome_t *monome, int enable) {
+	if( !enable ) {
+		monome_stats_free(monome);
+		return MONOME_OK;
+	}
+
+	if( monome->stats )
+		return MONOME_OK;
+
+	if( !(monome->stats = m_calloc(1, sizeof(*monome->stats))) )
+		return MONOME_ERROR_GENERIC;
+
+	return MONOME_OK;
+}
+
+#define COPY(field) out->field = COUNTER_GET(s->field)
+#define COPY_ARRAY(field) do { \
+	for( i = 0; i < sizeof(out->field) / sizeof(*out->field); i++ ) \
+		out->field[i] = COUNTER_GET(s->field[i]); \
+} while( 0 )
+
+int monome_get_stats(monome_t *monome, monome_stats_t *out) {
+	monome_stats_block_t *s = monome->stats;
+	size_t i;
+
+	memset(out, 0, sizeof(*out));
+
+	if( !s )
+		return MONOME_OK;
+
+	COPY(bytes_in);
+	COPY(bytes_out);
+	COPY(messages_in);
+	COPY(messages_out);
+	COPY_ARRAY(messages_in_by_header);
+	COPY_ARRAY(messages_out_by_header);
+
+	COPY(reads);
+	COPY(writes);
+	COPY(short_writes);
+	COPY(write_again);
+
+	COPY(resyncs);
+	COPY(events_dispatched);
+	COPY(events_dropped);
+
+	COPY_ARRAY(read_to_callback);
+	COPY_ARRAY(callback_duration);
+
+	return MONOME_OK;
+}
+
+#define CLEAR(field) COUNTER_SET(s->field, 0)
+#define CLEAR_ARRAY(field) do { \
+	for( i = 0; i < sizeof(s->field) / sizeof(*s->field); i++ ) \
+		COUNTER_SET(s->field[i], 0); \
+} while( 0 )
+
+void monome_reset_stats(monome_t *monome) {
+	monome_stats_block_t *s = monome->stats;
+	size_t i;
+
+	if( !s )
+		return;
+
+	CLEAR(bytes_in);
+	CLEAR(bytes_out);
+	CLEAR(messages_in);
+	CLEAR(messages_out);
+	CLEAR_ARRAY(messages_in_by_header);
+	CLEAR_ARRAY(messages_out_by_header);
+
+	CLEAR(reads);
+	CLEAR(writes);
+	CLEAR(short_writes);
+	CLEAR(write_again);
+
+	CLEAR(resyncs);
+	CLEAR(events_dispatched);
+	CLEAR(events_dropped);
+
+	CLEAR_ARRAY(read_to_callback);
+	CLEAR_ARRAY(callback_duration);
+}
+
+uint64_t monome_stats_bucket_ns(unsigned int bucket) {
+	unsigned int msb;
+
+	if( bucket >= MONOME_STATS_BUCKETS )
+		bucket = MONOME_STATS_BUCKETS - 1;
+
+	if( bucket < 2 * SUB_BUCKETS )
+		return bucket;
+
+	msb = bucket / SUB_BUCKETS + SUB_BITS - 1;
+	return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << (msb - SUB_BITS);
+}
+
+uint64_t monome_stats_percentile(const uint64_t *histogram, double percentile) {
+	uint64_t total = 0, seen = 0, target;
+	unsigned int i;
+
+	for( i = 0; i < MONOME_STATS_BUCKETS; i++ )
+		total += histogram[i];
+
+	if( !total )
+		return 0;
+
+	target = (uint64_t) (total * (percentile / 100.0));
+	if( target >= total )
+		target = total - 1;
+
+	for( i = 0; i < MONOME_STATS_BUCKETS; i++ ) {
+		seen += histogram[i];
+		if( seen > target )
+			break;
+	}
+
+	return monome_stats_bucket_ns(i);
+}
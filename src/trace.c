@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "trace.h"
+
+struct monome_trace {
+	FILE *file;
+	uint64_t last[2];
+};
+
+/**
+ * format
+ */
+
+static void put_u16(uint8_t *p, uint_t v) {
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_u32(uint8_t *p, uint_t v) {
+	put_u16(p, v & 0xFFFF);
+	put_u16(p + 2, v >> 16);
+}
+
+static uint_t get_u16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint_t get_u32(const uint8_t *p) {
+	return get_u16(p) | ((uint_t) get_u16(p + 2) << 16);
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+	size_t n = 0;
+
+	while( v >= 0x80 ) {
+		p[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+
+	p[n++] = v;
+	return n;
+}
+
+static int get_varint(monome_trace_cursor_t *c, uint64_t *v) {
+	uint_t shift;
+
+	*v = 0;
+
+	for( shift = 0; shift < 64; shift += 7 ) {
+		if( c->pos >= c->len )
+			return -1;
+
+		*v |= (uint64_t) (c->buf[c->pos] & 0x7F) << shift;
+
+		if( !(c->buf[c->pos++] & 0x80) )
+			return 0;
+	}
+
+	return -1;
+}
+
+/* a NUL-terminated copy of a fixed-size field, cut short if need be */
+static void get_string(char *dst, const uint8_t *src, size_t size) {
+	memcpy(dst, src, size);
+	dst[size - 1] = '\0';
+}
+
+static void put_string(uint8_t *dst, const char *src, size_t size) {
+	if( src )
+		strncpy((char *) dst, src, size - 1);
+}
+
+int monome_trace_open(const uint8_t *buf, size_t len,
+                      monome_trace_header_t *header,
+                      monome_trace_cursor_t *cursor) {
+	if( len < TRACE_HEADER_SIZE || memcmp(buf, TRACE_MAGIC, 8) )
+		return -1;
+
+	if( (header->version = get_u16(buf + 8)) != TRACE_VERSION )
+		return -1;
+
+	header->rows = get_u16(buf + 10);
+	header->cols = get_u16(buf + 12);
+	header->link_rate = get_u32(buf + 16);
+	get_string(header->proto, buf + 24, sizeof(header->proto));
+	get_string(header->serial, buf + 40, sizeof(header->serial));
+	get_string(header->friendly, buf + 72, sizeof(header->friendly));
+
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->buf = buf;
+	cursor->len = len;
+	cursor->pos = TRACE_HEADER_SIZE;
+	return 0;
+}
+
+int monome_trace_next(monome_trace_cursor_t *c, monome_trace_record_t *r) {
+	uint64_t delta, nbyte;
+
+	if( c->pos == c->len )
+		return 0;
+
+	if( c->buf[c->pos] > MONOME_WIRE_OUT )
+		return -1;
+
+	r->direction = c->buf[c->pos++];
+
+	if( get_varint(c, &delta) || get_varint(c, &nbyte) )
+		return -1;
+
+	if( nbyte > c->len - c->pos )
+		return -1;
+
+	c->last[r->direction] += delta;
+
+	r->ns = c->last[r->direction];
+	r->data = &c->buf[c->pos];
+	r->nbyte = nbyte;
+
+	c->pos += nbyte;
+	return 1;
+}
+
+/**
+ * recording
+ */
+
+void monome_trace_record(monome_t *monome, monome_wire_direction_t direction,
+                         uint64_t ns, const uint8_t *buf, size_t nbyte) {
+	uint8_t record[1 + 10 + 10 + TRACE_CHUNK_MAX];
+	monome_trace_t *t = monome->record;
+	size_t chunk, len;
+
+	do {
+		chunk = (nbyte > TRACE_CHUNK_MAX) ? TRACE_CHUNK_MAX : nbyte;
+
+		/* a read or write that came back out of order with the clock
+		   (another thread's, say) is recorded as simultaneous */
+		if( ns < t->last[direction] )
+			ns = t->last[direction];
+
+		record[0] = direction;
+		len = 1 + put_varint(&record[1], ns - t->last[direction]);
+		len += put_varint(&record[len], chunk);
+		memcpy(&record[len], buf, chunk);
+
+		t->last[direction] = ns;
+		fwrite(record, 1, len + chunk, t->file);
+
+		buf += chunk;
+		nbyte -= chunk;
+	} while( nbyte );
+}
+
+void monome_trace_stop(monome_t *monome) {
+	monome_trace_t *t = monome->record;
+
+	if( !t )
+		return;
+
+	monome->record = NULL;
+	fclose(t->file);
+	m_free(t);
+}
+
+/**
+ * public
+ */
+
+int monome_record_start(monome_t *monome, const char *path) {
+	uint8_t header[TRACE_HEADER_SIZE] = {0};
+	monome_trace_t *t;
+
+	if( !monome || !path )
+		return MONOME_ERROR_INVALID_ARG;
+
+	/* an OSC device has no wire */
+	if( !monome->proto || !strcmp(monome->proto, "osc") )
+		return MONOME_ERROR_UNSUPPORTED;
+
+	if( !(t = m_calloc(1, sizeof(*t))) )
+		return MONOME_ERROR_GENERIC;
+
+	if( !(t->file = fopen(path, "wb")) ) {
+		m_free(t);
+		return MONOME_ERROR_GENERIC;
+	}
+
+	memcpy(header, TRACE_MAGIC, 8);
+	put_u16(header + 8, TRACE_VERSION);
+	put_u16(header + 10, monome->rows);
+	put_u16(header + 12, monome->cols);
+	put_u32(header + 16, monome->link_rate);
+	put_string(header + 24, monome->proto, 16);
+	put_string(header + 40, monome->serial, 32);
+	put_string(header + 72, monome->friendly, 40);
+
+	if( fwrite(header, 1, sizeof(header), t->file) != sizeof(header) ) {
+		fclose(t->file);
+		m_free(t);
+		return MONOME_ERROR_GENERIC;
+	}
+
+	t->last[MONOME_WIRE_IN] = t->last[MONOME_WIRE_OUT] = m_now_ns();
+
+	monome_trace_stop(monome);
+	monome->record = t;
+	return MONOME_OK;
+}
+
+void monome_record_stop(monome_t *monome) {
+	monome_trace_stop(monome);
+}
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "io.h"
+#include "schedule.h"
+#include "writer.h"
+
+#define WRITER_DEFAULT_CAPACITY 4096
+
+/* big enough for any single message we send (a mext level map is 35) */
+#define WRITER_SLOT_SIZE 40
+
+/* how long an idle writer sleeps before rechecking for a stop request */
+#define WRITER_POLL_MS 50
+
+#define CACHE_LINE 64
+
+/**
+ * a bounded multi-producer, single-consumer queue of encoded messages, after
+ * Dmitry Vyukov's bounded MPMC queue. each slot's `seq` says whose turn it
+ * is: a producer may fill slot `pos` when seq == pos, and the writer may
+ * drain it when seq == pos + 1.
+ */
+typedef struct {
+	atomic_size_t seq;
+	uint8_t len;
+	uint8_t data[WRITER_SLOT_SIZE];
+} writer_slot_t;
+
+struct monome_writer {
+	monome_t *monome;
+	m_thread_t *thread;
+	int wake[2];
+
+	writer_slot_t *slots;
+	size_t mask;
+
+	atomic_int stop;
+
+	/* set while the writer is (about to be) asleep on `wake`. a producer
+	   only makes the syscall to wake it if it's the one to clear this. */
+	atomic_int sleeping;
+
+	char pad0[CACHE_LINE];
+	atomic_size_t enqueue_pos;
+	char pad1[CACHE_LINE];
+
+	/* writer thread only */
+	size_t dequeue_pos;
+	uint8_t buf[MONOME_TX_BUF_SIZE];
+};
+
+/**
+ * producers
+ */
+
+ssize_t monome_writer_push(monome_writer_t *w, const uint8_t *buf,
+                           size_t nbyte) {
+	writer_slot_t *slot;
+	size_t pos, seq;
+	intptr_t dif;
+
+	if( nbyte > WRITER_SLOT_SIZE )
+		return -1;
+
+	pos = atomic_load_explicit(&w->enqueue_pos, memory_order_relaxed);
+
+	for( ;; ) {
+		slot = &w->slots[pos & w->mask];
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		dif = (intptr_t) seq - (intptr_t) pos;
+
+		if( !dif ) {
+			if( atomic_compare_exchange_weak_explicit(&w->enqueue_pos,
+			        &pos, pos + 1, memory_order_relaxed,
+			        memory_order_relaxed) )
+				break;
+		} else if( dif < 0 )
+			return -1; /* full */
+		else
+			pos = atomic_load_explicit(&w->enqueue_pos, memory_order_relaxed);
+	}
+
+	memcpy(slot->data, buf, nbyte);
+	slot->len = nbyte;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+	/* pairs with the fence in writer_sleep(): either we see that the
+	   writer is going to sleep, or it sees what we just queued */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if( atomic_load_explicit(&w->sleeping, memory_order_relaxed)
+	    && atomic_exchange(&w->sleeping, 0) )
+		m_wakeup_signal(w->wake[1]);
+
+	return nbyte;
+}
+
+/**
+ * writer thread
+ */
+
+static writer_slot_t *writer_peek(monome_writer_t *w) {
+	writer_slot_t *slot = &w->slots[w->dequeue_pos & w->mask];
+
+	if( atomic_load_explicit(&slot->seq, memory_order_acquire)
+	    != w->dequeue_pos + 1 )
+		return NULL;
+
+	return slot;
+}
+
+static void writer_release(monome_writer_t *w, writer_slot_t *slot) {
+	atomic_store_explicit(&slot->seq, w->dequeue_pos + w->mask + 1,
+	                      memory_order_release);
+	w->dequeue_pos++;
+}
+
+static void writer_sleep(monome_writer_t *w) {
+	atomic_store(&w->sleeping, 1);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if( !writer_peek(w) && !atomic_load(&w->stop) ) {
+		m_wakeup_wait(w->wake[0], WRITER_POLL_MS);
+		m_wakeup_clear(w->wake[0]);
+	}
+
+	atomic_store(&w->sleeping, 0);
+}
+
+static void *writer_thread(void *arg) {
+	monome_writer_t *w = arg;
+	writer_slot_t *slot;
+	size_t len;
+
+	for( ;; ) {
+		/* everything queued so far goes out in as few writes as fit */
+		for( len = 0; (slot = writer_peek(w)); writer_release(w, slot) ) {
+			if( len + slot->len > sizeof(w->buf) ) {
+				monome_io_send(w->monome, w->buf, len);
+				len = 0;
+			}
+
+			memcpy(&w->buf[len], slot->data, slot->len);
+			len += slot->len;
+		}
+
+		if( len ) {
+			monome_io_send(w->monome, w->buf, len);
+			continue;
+		}
+
+		/* the tty didn't take everything. rather than sleep on the queue,
+		   wait for it to make room. when stopping, give up once it stalls
+		   and leave the rest to monome_close(). */
+		if( TXQ_PENDING(w->monome) ) {
+			if( monome_platform_wait_for_output(w->monome, WRITER_POLL_MS) <= 0 ) {
+				monome_io_drain(w->monome);
+				continue;
+			}
+
+			if( !atomic_load(&w->stop) )
+				continue;
+		}
+
+		/* only stop once the queue is drained */
+		if( atomic_load(&w->stop) )
+			break;
+
+		writer_sleep(w);
+	}
+
+	return NULL;
+}
+
+/**
+ * public
+ */
+
+int monome_writer_start(monome_t *monome, size_t capacity) {
+	monome_writer_t *w;
+	size_t size, i;
+
+	if( monome->writer )
+		return MONOME_ERROR_INVALID_ARG;
+
+	if( !capacity )
+		capacity = WRITER_DEFAULT_CAPACITY;
+
+	for( size = 1; size < capacity; size <<= 1 )
+		;
+
+	if( !(w = m_calloc(1, sizeof(*w))) )
+		return MONOME_ERROR_GENERIC;
+
+	if( !(w->slots = m_calloc(size, sizeof(*w->slots))) )
+		goto err_slots;
+
+	if( m_wakeup_new(w->wake) )
+		goto err_wakeup;
+
+	w->monome = monome;
+	w->mask = size - 1;
+
+	for( i = 0; i < size; i++ )
+		atomic_init(&w->slots[i].seq, i);
+
+	atomic_init(&w->enqueue_pos, 0);
+	atomic_init(&w->stop, 0);
+	atomic_init(&w->sleeping, 0);
+
+	/* anything already buffered or paced has to go out before the
+	   thread's output. the rate stays set for after monome_writer_stop(). */
+	monome_sched_flush(monome);
+	monome_io_flush(monome);
+
+	if( !(w->thread = m_thread_start(writer_thread, w)) )
+		goto err_thread;
+
+	monome->writer = w;
+	return MONOME_OK;
+
+err_thread:
+	m_wakeup_free(w->wake);
+err_wakeup:
+	m_free(w->slots);
+err_slots:
+	m_free(w);
+	return MONOME_ERROR_GENERIC;
+}
+
+int monome_writer_stop(monome_t *monome) {
+	monome_writer_t *w = monome->writer;
+
+	if( !w )
+		return MONOME_ERROR_INVALID_ARG;
+
+	atomic_store(&w->stop, 1);
+	m_wakeup_signal(w->wake[1]);
+	m_thread_join(w->thread);
+
+	monome->writer = NULL;
+
+	/* anything the thread couldn't get out is now the poll group's */
+	monome_io_drain(monome);
+
+	m_wakeup_free(w->wake);
+	m_free(w->slots);
+	m_free(w);
+	return MONOME_OK;
+}
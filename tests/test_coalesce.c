@@ -0,0 +1,273 @@
+/**
+ * Tests for input coalescing (coalesce.c). A mext device reads raw
+ * protocol bytes from a socketpair, so encoder and tilt streams can be fed
+ * in as they'd arrive from an arc or a grid's accelerometer.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+#include "coalesce.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext SS_ENCODER and SS_TILT headers */
+#define ENC_DELTA    0x50
+#define ENC_KEY_UP   0x51
+#define ENC_KEY_DOWN 0x52
+#define TILT         0x81
+
+static int fds[2];
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	monome_coalesce_free(m);
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+static void feed(const uint8_t *buf, size_t nbyte) {
+	assert(write(fds[1], buf, nbyte) == (ssize_t) nbyte);
+}
+
+static void feed_delta(uint_t number, int delta) {
+	uint8_t msg[] = {ENC_DELTA, number, (uint8_t) delta};
+	feed(msg, sizeof(msg));
+}
+
+/* x, y and z all `v`, in both bytes so that byte order doesn't matter */
+static void feed_tilt(uint_t sensor, uint8_t v) {
+	uint8_t msg[] = {TILT, sensor, v, v, v, v, v, v};
+	feed(msg, sizeof(msg));
+}
+
+static int next_batch(monome_t *m, monome_event_t *events) {
+	return monome_event_next_batch(m, events, 32);
+}
+
+/* --- handlers --- */
+
+static struct {
+	int count;
+	int delta;
+} seen;
+
+static void count_delta(const monome_event_t *e, void *data) {
+	(void)data;
+	seen.count++;
+	seen.delta += e->encoder.delta;
+}
+
+/* --- tests --- */
+
+static void test_off_by_default(void) {
+	monome_t *m = make_mext();
+	monome_event_t events[32];
+
+	feed_delta(0, 1);
+	feed_delta(0, 1);
+	feed_delta(0, 1);
+
+	assert(next_batch(m, events) == 3);
+	free_mext(m);
+}
+
+static void test_deltas_summed_per_encoder(void) {
+	monome_t *m = make_mext();
+	monome_event_t events[32];
+
+	assert(monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 0) == MONOME_OK);
+
+	feed_delta(0, 1);
+	feed_delta(0, 2);
+	feed_delta(1, -1);
+	feed_delta(0, 3);
+
+	assert(next_batch(m, events) == 2);
+	assert(events[0].event_type == MONOME_ENCODER_DELTA);
+	assert(events[0].encoder.number == 0 && events[0].encoder.delta == 6);
+	assert(events[0].monome == m);
+	assert(events[1].encoder.number == 1 && events[1].encoder.delta == -1);
+
+	assert(next_batch(m, events) == 0);
+	free_mext(m);
+}
+
+static void test_key_ends_sum(void) {
+	monome_t *m = make_mext();
+	uint8_t down[] = {ENC_KEY_DOWN, 0};
+	monome_event_t events[32];
+
+	monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 0);
+
+	feed_delta(0, 1);
+	feed_delta(0, 1);
+	feed(down, sizeof(down));
+	feed_delta(0, -1);
+	feed_delta(0, -1);
+
+	assert(next_batch(m, events) == 3);
+	assert(events[0].encoder.delta == 2);
+	assert(events[1].event_type == MONOME_ENCODER_KEY_DOWN);
+	assert(events[2].encoder.delta == -2);
+	free_mext(m);
+}
+
+static void test_cancelled_deltas_dropped(void) {
+	monome_t *m = make_mext();
+	monome_event_t events[32];
+
+	monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 10);
+
+	feed_delta(2, 1);
+	assert(next_batch(m, events) == 1);
+
+	/* both held back by the rate, and they cancel out */
+	feed_delta(2, 3);
+	feed_delta(2, -3);
+	assert(next_batch(m, events) == 0);
+
+	usleep(120000);
+	assert(next_batch(m, events) == 0);
+	free_mext(m);
+}
+
+static void test_tilt_keeps_latest(void) {
+	monome_t *m = make_mext();
+	monome_event_t events[32];
+
+	monome_set_coalescing(m, MONOME_COALESCE_TILT, 0);
+
+	feed_tilt(0, 1);
+	feed_tilt(0, 2);
+	feed_tilt(0, 3);
+	feed_delta(0, 1);
+	feed_delta(0, 1);
+
+	/* encoders weren't asked for */
+	assert(next_batch(m, events) == 3);
+	assert(events[0].event_type == MONOME_TILT);
+	assert(events[0].tilt.x == 0x0303);
+	assert(events[0].tilt.z == 0x0303);
+	free_mext(m);
+}
+
+static void test_single_event_calls_coalesce(void) {
+	monome_t *m = make_mext();
+	monome_event_t e;
+	int i;
+
+	monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 0);
+
+	for( i = 0; i < 100; i++ )
+		feed_delta(3, 1);
+
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.encoder.number == 3 && e.encoder.delta == 100);
+	assert(monome_event_next(m, &e) == 0);
+	free_mext(m);
+}
+
+static void test_rate_holds_then_releases(void) {
+	monome_t *m = make_mext();
+	monome_poll_group_t *group = monome_poll_group_new();
+
+	monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 20);
+	monome_register_handler(m, MONOME_ENCODER_DELTA, count_delta, NULL);
+	monome_poll_group_add(group, m);
+	memset(&seen, 0, sizeof(seen));
+
+	feed_delta(0, 1);
+	assert(monome_poll_group_wait(group, 1000) == 1);
+
+	/* too soon after the first, so they wait */
+	feed_delta(0, 2);
+	feed_delta(0, 3);
+	assert(monome_poll_group_wait(group, 1000) == 0);
+	assert(seen.count == 1);
+
+	/* the wait wakes up on its own once the interval is over */
+	assert(monome_poll_group_wait(group, 1000) == 1);
+	assert(seen.count == 2 && seen.delta == 6);
+
+	monome_poll_group_free(group);
+	free_mext(m);
+}
+
+static void test_switching_off_releases_held(void) {
+	monome_t *m = make_mext();
+	monome_event_t events[32];
+
+	monome_set_coalescing(m, MONOME_COALESCE_ENCODER, 1);
+
+	feed_delta(0, 1);
+	assert(next_batch(m, events) == 1);
+
+	feed_delta(0, 5);
+	assert(next_batch(m, events) == 0);
+
+	assert(monome_set_coalescing(m, 0, 0) == MONOME_OK);
+	assert(next_batch(m, events) == 1);
+	assert(events[0].encoder.delta == 5);
+	assert(!m->coalesce);
+
+	feed_delta(0, 1);
+	feed_delta(0, 1);
+	assert(next_batch(m, events) == 2);
+	free_mext(m);
+}
+
+static void test_invalid_flags(void) {
+	monome_t *m = make_mext();
+
+	assert(monome_set_coalescing(m, 1 << 7, 0) == MONOME_ERROR_INVALID_ARG);
+	assert(!m->coalesce);
+	free_mext(m);
+}
+
+int main(void) {
+	printf("test_coalesce:\n");
+
+	RUN_TEST(test_off_by_default);
+	RUN_TEST(test_deltas_summed_per_encoder);
+	RUN_TEST(test_key_ends_sum);
+	RUN_TEST(test_cancelled_deltas_dropped);
+	RUN_TEST(test_tilt_keeps_latest);
+	RUN_TEST(test_single_event_calls_coalesce);
+	RUN_TEST(test_rate_holds_then_releases);
+	RUN_TEST(test_switching_off_releases_held);
+	RUN_TEST(test_invalid_flags);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+/**
+ * Tests for the descriptor cache (descriptor.c). A pty stands in for a
+ * mext grid that has been opened before. Nothing answers on the other side
+ * unless the test writes the answers itself, so an open that waited for the
+ * handshake would time out.
+ *
+ * Enumeration depends on what's attached, so only the shape of its result
+ * is checked.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+static int master;
+static char cache_path[] = "/tmp/test_descriptor_XXXXXX";
+
+static const char *open_pty(void) {
+	assert((master = posix_openpt(O_RDWR | O_NOCTTY)) >= 0);
+	assert(!grantpt(master));
+	assert(!unlockpt(master));
+	return ptsname(master);
+}
+
+static void write_cache(const char *contents) {
+	FILE *f = fopen(cache_path, "w");
+
+	assert(f);
+	fputs(contents, f);
+	fclose(f);
+}
+
+/* load a cache holding a single entry for `dev` */
+static void cache_entry(const char *dev, int cols, int rows, const char *name) {
+	char line[256];
+
+	snprintf(line, sizeof(line), "%s\tm1234567\tmext\t%d\t%d\t%s\n",
+	         dev, cols, rows, name);
+	write_cache(line);
+
+	monome_descriptor_cache_clear();
+	assert(monome_descriptor_cache_load(cache_path) == 1);
+}
+
+/* whether the saved cache has an entry for `dev` */
+static int cache_has(const char *dev) {
+	char line[256];
+	int found = 0;
+	FILE *f;
+
+	assert(monome_descriptor_cache_save(cache_path) == MONOME_OK);
+	assert((f = fopen(cache_path, "r")));
+
+	while( fgets(line, sizeof(line), f) )
+		if( !strncmp(line, dev, strlen(dev)) && line[strlen(dev)] == '\t' )
+			found = 1;
+
+	fclose(f);
+	return found;
+}
+
+/* what the library sent the device, waiting up to `msec` for it */
+static ssize_t device_read(uint8_t *buf, size_t nbyte, int msec) {
+	struct pollfd pfd = {master, POLLIN, 0};
+
+	if( poll(&pfd, 1, msec) <= 0 )
+		return 0;
+
+	return read(master, buf, nbyte);
+}
+
+static void device_answer(monome_t *m, const uint8_t *buf, size_t nbyte) {
+	struct pollfd pfd = {monome_get_fd(m), POLLIN, 0};
+	monome_event_t e;
+
+	assert(write(master, buf, nbyte) == nbyte);
+	assert(poll(&pfd, 1, 1000) == 1);
+
+	/* system messages are consumed without producing events */
+	assert(monome_event_next(m, &e) == 0);
+}
+
+/* query response, "m123" and a 16x8 size */
+static const uint8_t answers[] = {
+	0x00, 1, 1,
+	0x01, 'm', '1', '2', '3', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0x03, 16, 8
+};
+
+/* --- tests --- */
+
+static void test_cached_open_skips_handshake(void) {
+	const char *dev = open_pty();
+	uint8_t buf[16];
+	uint64_t start;
+	monome_t *m;
+
+	cache_entry(dev, 16, 8, "m123");
+
+	start = m_now_ns();
+	assert((m = monome_open(dev)));
+	assert(m_now_ns() - start < 100000000ULL);
+
+	assert(monome_get_cols(m) == 16 && monome_get_rows(m) == 8);
+	assert(!strcmp(monome_get_serial(m), "m1234567"));
+	assert(!strcmp(monome_get_friendly_name(m), "m123"));
+
+	/* the queries still went out, to check the entry against */
+	assert(device_read(buf, sizeof(buf), 1000) == 3);
+	assert(buf[0] == 0x00 && buf[1] == 0x01 && buf[2] == 0x05);
+
+	monome_close(m);
+	close(master);
+}
+
+static void test_matching_answers_keep_entry(void) {
+	const char *dev = open_pty();
+	uint8_t buf[16];
+	monome_t *m;
+
+	cache_entry(dev, 16, 8, "m123");
+
+	assert((m = monome_open(dev)));
+	assert(device_read(buf, sizeof(buf), 1000) == 3);
+
+	device_answer(m, answers, sizeof(answers));
+	assert(monome_get_cols(m) == 16 && monome_get_rows(m) == 8);
+	assert(cache_has(dev));
+
+	monome_close(m);
+	close(master);
+}
+
+static void test_mismatch_drops_entry(void) {
+	const char *dev = open_pty();
+	uint8_t buf[16];
+	monome_t *m;
+
+	/* the cache thinks this is an 8x8 grid */
+	cache_entry(dev, 8, 8, "m123");
+
+	assert((m = monome_open(dev)));
+	assert(monome_get_cols(m) == 8);
+	assert(device_read(buf, sizeof(buf), 1000) == 3);
+
+	/* what the device says wins, and the next open asks again */
+	device_answer(m, answers, sizeof(answers));
+	assert(monome_get_cols(m) == 16 && monome_get_rows(m) == 8);
+	assert(!cache_has(dev));
+
+	monome_close(m);
+	close(master);
+}
+
+static void test_queue_reader_leaves_cache_alone(void) {
+	const char *dev = open_pty();
+	monome_poll_group_t *group;
+	const uint8_t key[] = {0x21, 1, 2};
+	monome_event_queue_t *q;
+	monome_event_t e;
+	uint8_t buf[16];
+	monome_t *m;
+
+	cache_entry(dev, 8, 8, "m123");
+
+	assert((m = monome_open(dev)));
+	assert(device_read(buf, sizeof(buf), 1000) == 3);
+	assert((group = monome_poll_group_new()));
+	assert(monome_poll_group_add(group, m) == 0);
+	assert((q = monome_event_queue_new(group, 0)));
+
+	/* the reader decodes the mismatch, then the key. the entry and the
+	   size wait for this thread. */
+	assert(write(master, answers, sizeof(answers)) == sizeof(answers));
+	assert(write(master, key, sizeof(key)) == sizeof(key));
+
+	assert(monome_event_queue_wait(q, 1000) > 0);
+	assert(monome_event_queue_pop(q, &e) == 1);
+	assert(e.event_type == MONOME_BUTTON_DOWN);
+	assert(monome_get_cols(m) == 8 && cache_has(dev));
+
+	monome_event_queue_free(q);
+	assert(monome_get_cols(m) == 16 && monome_get_rows(m) == 8);
+	assert(!strcmp(monome_get_friendly_name(m), "m123"));
+	assert(!cache_has(dev));
+
+	monome_poll_group_free(group);
+	monome_close(m);
+	close(master);
+}
+
+static void test_unsized_entry_still_handshakes(void) {
+	const char *dev = open_pty();
+	uint64_t start;
+
+	/* what enumeration adds for a mext device: the serial, but no size */
+	cache_entry(dev, 0, 0, "monome i2c");
+	monome_set_open_timeout(100);
+
+	/* so opening waits for answers that never come */
+	start = m_now_ns();
+	assert(!monome_open(dev));
+	assert(m_now_ns() - start >= 100000000ULL);
+
+	monome_set_open_timeout(0);
+	close(master);
+}
+
+static void test_disabled_cache_is_ignored(void) {
+	const char *dev = open_pty();
+	monome_t *m;
+
+	cache_entry(dev, 16, 8, "m123");
+	monome_descriptor_cache_enable(0);
+
+	/* with no cache, the serial comes from udev, which has never heard
+	   of a pty */
+	assert(!(m = monome_open(dev)));
+
+	monome_descriptor_cache_enable(1);
+	close(master);
+}
+
+static void test_series_entry_needs_serial(void) {
+	const char *dev = open_pty();
+	char line[256];
+
+	/* nothing a series device says could show that it's the one the
+	   entry was for, so the serial is still looked up. udev has never
+	   heard of a pty, so there's nothing to match. */
+	snprintf(line, sizeof(line), "%s\tm256-0001\tseries\t16\t16\tmonome 256\n",
+	         dev);
+	write_cache(line);
+
+	monome_descriptor_cache_clear();
+	assert(monome_descriptor_cache_load(cache_path) == 1);
+	assert(!monome_open(dev));
+
+	close(master);
+}
+
+static void test_save_load_round_trip(void) {
+	char line[256];
+	FILE *f;
+
+	write_cache("/dev/ttyACM0\tm1000001\tmext\t16\t16\tmonome 256\n"
+	            "malformed line\n"
+	            "/dev/ttyACM1\tm1000002\tmext\t8\t8\tname\twith a tab\n");
+
+	monome_descriptor_cache_clear();
+	assert(monome_descriptor_cache_load(cache_path) == 2);
+	assert(monome_descriptor_cache_save(cache_path) == MONOME_OK);
+
+	assert((f = fopen(cache_path, "r")));
+	assert(fgets(line, sizeof(line), f));
+	assert(!strcmp(line, "/dev/ttyACM0\tm1000001\tmext\t16\t16\tmonome 256\n"));
+	assert(fgets(line, sizeof(line), f));
+	assert(!strcmp(line, "/dev/ttyACM1\tm1000002\tmext\t8\t8\tname\twith a tab\n"));
+	assert(!fgets(line, sizeof(line), f));
+	fclose(f);
+
+	monome_descriptor_cache_clear();
+	assert(cache_has("/dev/ttyACM0") == 0);
+	assert(monome_descriptor_cache_load("/nonexistent/cache") == MONOME_ERROR_GENERIC);
+}
+
+static void test_enumerate(void) {
+	monome_device_info_t *devices, *d;
+
+	/* whatever is attached, the list is terminated and complete. nothing
+	   that isn't a monome is listed, so a pty never is. */
+	assert((devices = monome_enumerate()));
+
+	for( d = devices; d->devpath; d++ ) {
+		assert(d->serial && d->proto && d->friendly);
+		assert(strncmp(d->devpath, "/dev/pts/", 9));
+	}
+
+	monome_enumerate_free(devices);
+	monome_enumerate_free(NULL);
+}
+
+int main(void) {
+	int fd;
+
+	assert((fd = mkstemp(cache_path)) >= 0);
+	close(fd);
+
+	printf("test_descriptor:\n");
+
+	RUN_TEST(test_cached_open_skips_handshake);
+	RUN_TEST(test_matching_answers_keep_entry);
+	RUN_TEST(test_mismatch_drops_entry);
+	RUN_TEST(test_queue_reader_leaves_cache_alone);
+	RUN_TEST(test_unsized_entry_still_handshakes);
+	RUN_TEST(test_disabled_cache_is_ignored);
+	RUN_TEST(test_series_entry_needs_serial);
+	RUN_TEST(test_save_load_round_trip);
+	RUN_TEST(test_enumerate);
+
+	monome_descriptor_cache_clear();
+	unlink(cache_path);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,627 @@
+/**
+ * Tests for the led command encoder (encoder.c).
+ * Plans are sent to mock led functions that charge each command at the
+ * protocol's byte cost and draw it into a fake grid, so we can check both
+ * that the plan's byte count is what actually goes out and that the device
+ * ends up showing the right thing. Also reports bytes per frame for a few
+ * typical workloads.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+#include "encoder.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+#define GRID_MAX 16
+
+/* --- mock device --- */
+
+static struct {
+	const monome_led_cost_t *cost;
+	size_t bytes;
+	uint8_t grid[GRID_MAX][GRID_MAX];
+	uint8_t ring[MONOME_RING_LEDS];
+	int ring_cmds[4];
+} dev;
+
+static uint8_t shown(uint_t level) {
+	if( dev.cost->monobright )
+		return (level > 7) ? 15 : 0;
+	return level & 0xF;
+}
+
+static void draw_mask(uint_t x, uint_t y, int dx, int dy, uint8_t mask) {
+	uint_t i;
+
+	for( i = 0; i < 8; i++ )
+		dev.grid[y + (i * dy)][x + (i * dx)] = (mask >> i & 1) ? 15 : 0;
+}
+
+static void draw_levels(uint_t x, uint_t y, int dx, int dy,
+                        const uint8_t *d) {
+	uint_t i;
+
+	for( i = 0; i < 8; i++ )
+		dev.grid[y + (i * dy)][x + (i * dx)] = shown(d[i]);
+}
+
+static int mock_set(monome_t *m, uint_t x, uint_t y, uint_t on) {
+	(void)m;
+	assert(dev.cost->set);
+	dev.bytes += dev.cost->set;
+	dev.grid[y][x] = on ? 15 : 0;
+	return MONOME_OK;
+}
+
+static int mock_all(monome_t *m, uint_t on) {
+	(void)m;
+	assert(dev.cost->all);
+	dev.bytes += dev.cost->all;
+	memset(dev.grid, on ? 15 : 0, sizeof(dev.grid));
+	return MONOME_OK;
+}
+
+static int mock_map(monome_t *m, uint_t x, uint_t y, const uint8_t *d) {
+	uint_t i;
+	(void)m;
+
+	assert(dev.cost->map);
+	dev.bytes += dev.cost->map;
+	for( i = 0; i < 8; i++ )
+		draw_mask(x, y + i, 1, 0, d[i]);
+	return MONOME_OK;
+}
+
+static int mock_row(monome_t *m, uint_t x, uint_t y, size_t c,
+                    const uint8_t *d) {
+	(void)m;
+	assert(dev.cost->row && c == 1);
+	dev.bytes += dev.cost->row;
+	draw_mask(x, y, 1, 0, *d);
+	return MONOME_OK;
+}
+
+static int mock_col(monome_t *m, uint_t x, uint_t y, size_t c,
+                    const uint8_t *d) {
+	(void)m;
+	assert(dev.cost->col && c == 1);
+	dev.bytes += dev.cost->col;
+	draw_mask(x, y, 0, 1, *d);
+	return MONOME_OK;
+}
+
+static int mock_level_set(monome_t *m, uint_t x, uint_t y, uint_t l) {
+	(void)m;
+	dev.bytes += dev.cost->level_set;
+	dev.grid[y][x] = shown(l);
+	return MONOME_OK;
+}
+
+static int mock_level_all(monome_t *m, uint_t l) {
+	(void)m;
+	dev.bytes += dev.cost->level_all;
+	memset(dev.grid, shown(l), sizeof(dev.grid));
+	return MONOME_OK;
+}
+
+static int mock_level_map(monome_t *m, uint_t x, uint_t y,
+                          const uint8_t *d) {
+	uint_t i;
+	(void)m;
+
+	dev.bytes += dev.cost->level_map;
+	for( i = 0; i < 8; i++ )
+		draw_levels(x, y + i, 1, 0, &d[i * 8]);
+	return MONOME_OK;
+}
+
+static int mock_level_row(monome_t *m, uint_t x, uint_t y, size_t c,
+                          const uint8_t *d) {
+	(void)m;
+	assert(dev.cost->level_row && c == 8);
+	dev.bytes += dev.cost->level_row;
+	draw_levels(x, y, 1, 0, d);
+	return MONOME_OK;
+}
+
+static int mock_level_col(monome_t *m, uint_t x, uint_t y, size_t c,
+                          const uint8_t *d) {
+	(void)m;
+	assert(dev.cost->level_col && c == 8);
+	dev.bytes += dev.cost->level_col;
+	draw_levels(x, y, 0, 1, d);
+	return MONOME_OK;
+}
+
+static monome_led_functions_t mock_led_fns = {
+	.set = mock_set,
+	.all = mock_all,
+	.map = mock_map,
+	.row = mock_row,
+	.col = mock_col
+};
+
+static monome_led_level_functions_t mock_level_fns = {
+	.set = mock_level_set,
+	.all = mock_level_all,
+	.map = mock_level_map,
+	.row = mock_level_row,
+	.col = mock_level_col
+};
+
+enum { RING_SET, RING_ALL, RING_MAP, RING_RANGE };
+
+static int mock_ring_set(monome_t *m, uint_t ring, uint_t led, uint_t l) {
+	(void)m; (void)ring;
+	dev.bytes += dev.cost->ring_set;
+	dev.ring_cmds[RING_SET]++;
+	dev.ring[led] = l;
+	return 0;
+}
+
+static int mock_ring_all(monome_t *m, uint_t ring, uint_t l) {
+	(void)m; (void)ring;
+	dev.bytes += dev.cost->ring_all;
+	dev.ring_cmds[RING_ALL]++;
+	memset(dev.ring, l, sizeof(dev.ring));
+	return 0;
+}
+
+static int mock_ring_map(monome_t *m, uint_t ring, const uint8_t *d) {
+	(void)m; (void)ring;
+	dev.bytes += dev.cost->ring_map;
+	dev.ring_cmds[RING_MAP]++;
+	memcpy(dev.ring, d, sizeof(dev.ring));
+	return 0;
+}
+
+static int mock_ring_range(monome_t *m, uint_t ring, uint_t start,
+                           uint_t end, uint_t l) {
+	(void)m; (void)ring;
+	assert(dev.cost->ring_range && start <= end);
+	dev.bytes += dev.cost->ring_range;
+	dev.ring_cmds[RING_RANGE]++;
+	memset(&dev.ring[start], l, end - start + 1);
+	return 0;
+}
+
+static monome_led_ring_functions_t mock_ring_fns = {
+	.set = mock_ring_set,
+	.all = mock_ring_all,
+	.map = mock_ring_map,
+	.range = mock_ring_range
+};
+
+/* --- cost models --- */
+
+static monome_led_cost_t mext_cost, h40_cost;
+
+/* series sets this up in open(), once it knows the grid size */
+static const monome_led_cost_t series_cost = {
+	.set = 2, .level_set = 2,
+	.map = 9, .level_map = 9,
+	.all = 1, .level_all = 1,
+	.monobright = 1
+};
+
+static void load_protocol_costs(void) {
+	monome_t *m;
+
+	m = monome_protocol_mext_new();
+	mext_cost = m->led_cost;
+	m->free(m);
+
+	m = monome_protocol_40h_new();
+	h40_cost = m->led_cost;
+	m->free(m);
+}
+
+/* --- helpers --- */
+
+static monome_t make_monome(const monome_led_cost_t *cost, int rows,
+                            int cols) {
+	monome_t m;
+	memset(&m, 0, sizeof(m));
+	m.rows = rows;
+	m.cols = cols;
+	m.rotation = MONOME_ROTATE_0;
+	m.led = &mock_led_fns;
+	m.led_level = &mock_level_fns;
+	m.led_ring = &mock_ring_fns;
+	m.led_cost = *cost;
+	return m;
+}
+
+/* plan and send, check that the device ends up right and that the plan
+   didn't lie about its size. returns the bytes sent. */
+static size_t encode(const monome_led_cost_t *cost, int rows, int cols,
+                     const uint8_t *next, const uint8_t *prev) {
+	monome_t m = make_monome(cost, rows, cols);
+	monome_encoder_plan_t plan;
+	int x, y;
+
+	dev.cost = cost;
+	dev.bytes = 0;
+	memset(dev.grid, 0xFF, sizeof(dev.grid));
+
+	if( prev )
+		for( y = 0; y < rows; y++ )
+			for( x = 0; x < cols; x++ )
+				dev.grid[y][x] = shown(prev[(y * cols) + x]);
+
+	monome_encoder_plan(monome_encoder_cost(&m), next, prev, rows, cols,
+	                    &plan);
+	assert(monome_encoder_send(&m, &plan, next, prev, rows, cols) == 0);
+	assert(dev.bytes == plan.bytes);
+
+	for( y = 0; y < rows; y++ )
+		for( x = 0; x < cols; x++ )
+			assert(dev.grid[y][x] == shown(next[(y * cols) + x]));
+
+	return dev.bytes;
+}
+
+/* the same for one arc ring */
+static size_t encode_ring(const monome_led_cost_t *cost, const uint8_t *next,
+                          const uint8_t *prev) {
+	monome_t m = make_monome(cost, 0, 0);
+	monome_ring_plan_t plan;
+
+	dev.cost = cost;
+	dev.bytes = 0;
+	memset(dev.ring_cmds, 0, sizeof(dev.ring_cmds));
+	memset(dev.ring, 0xFF, sizeof(dev.ring));
+
+	if( prev )
+		memcpy(dev.ring, prev, sizeof(dev.ring));
+
+	monome_encoder_ring_plan(monome_encoder_cost(&m), next, prev, &plan);
+	assert(monome_encoder_ring_send(&m, 0, &plan, next, prev) == 0);
+	assert(dev.bytes == plan.bytes);
+	assert(!memcmp(dev.ring, next, sizeof(dev.ring)));
+
+	return dev.bytes;
+}
+
+static uint32_t rng_state;
+
+static uint_t rng(void) {
+	rng_state = (rng_state * 1103515245) + 12345;
+	return (rng_state >> 16) & 0x7FFF;
+}
+
+/* --- cost model tests --- */
+
+static void test_mext_cost_from_payload_table(void) {
+	assert(mext_cost.set == 3);
+	assert(mext_cost.level_set == 4);
+	assert(mext_cost.row == 4);
+	assert(mext_cost.level_row == 7);
+	assert(mext_cost.col == 4);
+	assert(mext_cost.level_col == 7);
+	assert(mext_cost.map == 11);
+	assert(mext_cost.level_map == 35);
+	assert(mext_cost.all == 1);
+	assert(mext_cost.level_all == 2);
+	assert(!mext_cost.monobright);
+}
+
+static void test_mext_ring_cost_from_payload_table(void) {
+	assert(mext_cost.ring_set == 4);
+	assert(mext_cost.ring_all == 3);
+	assert(mext_cost.ring_map == 34);
+	assert(mext_cost.ring_range == 5);
+}
+
+static void test_40h_cost(void) {
+	assert(h40_cost.set == 2);
+	assert(h40_cost.map == 16);
+	assert(h40_cost.all == 16);
+	assert(h40_cost.monobright);
+}
+
+static void test_default_cost_without_protocol_model(void) {
+	monome_t m;
+	const monome_led_cost_t *cost;
+
+	memset(&m, 0, sizeof(m));
+	cost = monome_encoder_cost(&m);
+
+	/* varibright commands only, since there may be no led functions */
+	assert(cost->level_set && cost->level_row && cost->level_map);
+	assert(!cost->set && !cost->row && !cost->map && !cost->all);
+}
+
+/* --- command selection --- */
+
+static void test_unchanged_costs_nothing(void) {
+	uint8_t a[256];
+	monome_encoder_plan_t plan;
+
+	memset(a, 5, sizeof(a));
+	assert(monome_encoder_plan(&mext_cost, a, a, 16, 16, &plan) == 0);
+}
+
+static void test_binary_led_uses_on_off(void) {
+	uint8_t prev[256] = {0}, next[256] = {0};
+
+	next[17] = 15;
+	assert(encode(&mext_cost, 16, 16, next, prev) == 3);
+
+	next[17] = 9;
+	assert(encode(&mext_cost, 16, 16, next, prev) == 4);
+}
+
+static void test_binary_row_uses_led_row(void) {
+	uint8_t prev[256] = {0}, next[256] = {0};
+
+	memset(&next[16 * 4], 15, 8);
+	assert(encode(&mext_cost, 16, 16, next, prev) == 4);
+
+	next[16 * 4] = 3;
+	assert(encode(&mext_cost, 16, 16, next, prev) == 7);
+}
+
+static void test_binary_quad_uses_led_map(void) {
+	uint8_t prev[256] = {0}, next[256];
+	int i;
+
+	for( i = 0; i < 256; i++ )
+		next[i] = ((i ^ (i >> 4)) & 1) ? 15 : 0;
+
+	/* checkerboard: one LED_MAP per quad */
+	assert(encode(&mext_cost, 16, 16, next, prev) == 4 * 11);
+}
+
+static void test_uniform_uses_all(void) {
+	uint8_t prev[256], next[256];
+
+	memset(prev, 7, sizeof(prev));
+	memset(next, 0, sizeof(next));
+	assert(encode(&mext_cost, 16, 16, next, prev) == 1);
+
+	memset(next, 4, sizeof(next));
+	assert(encode(&mext_cost, 16, 16, next, prev) == 2);
+}
+
+static void test_monobright_ignores_invisible_changes(void) {
+	uint8_t prev[64] = {0}, next[64] = {0};
+	monome_encoder_plan_t plan;
+
+	/* 0 -> 7 looks the same on an on/off device */
+	next[10] = 7;
+	assert(monome_encoder_plan(&h40_cost, next, prev, 8, 8, &plan) == 0);
+
+	next[10] = 8;
+	assert(encode(&h40_cost, 8, 8, next, prev) == 2);
+}
+
+static void test_series_wide_grid_avoids_rows(void) {
+	uint8_t prev[256] = {0}, next[256] = {0};
+
+	/* a series row message would clobber the other half of the row */
+	memset(&next[16 * 2], 15, 8);
+	assert(encode(&series_cost, 16, 16, next, prev) == 9);
+}
+
+/* --- bytes per frame for typical workloads --- */
+
+typedef void (*workload_func_t)(uint8_t *next, uint8_t *prev,
+                                int rows, int cols);
+
+static void wl_single_led(uint8_t *next, uint8_t *prev, int rows, int cols) {
+	memset(prev, 0, rows * cols);
+	memcpy(next, prev, rows * cols);
+	next[(rows / 2) * cols + 3] = 15;
+}
+
+static void wl_row_update(uint8_t *next, uint8_t *prev, int rows, int cols) {
+	int x;
+
+	memset(prev, 0, rows * cols);
+	memcpy(next, prev, rows * cols);
+	for( x = 0; x < cols; x++ )
+		next[2 * cols + x] = x & 0xF;
+}
+
+static void wl_meter(uint8_t *next, uint8_t *prev, int rows, int cols) {
+	int x, y, was, is;
+
+	for( x = 0; x < cols; x++ ) {
+		was = rng() % (rows + 1);
+		is  = rng() % (rows + 1);
+
+		for( y = 0; y < rows; y++ ) {
+			prev[y * cols + x] = (rows - y <= was) ? 15 : 0;
+			next[y * cols + x] = (rows - y <= is) ? 15 : 0;
+		}
+	}
+}
+
+static void wl_sparse(uint8_t *next, uint8_t *prev, int rows, int cols) {
+	int i;
+
+	for( i = 0; i < rows * cols; i++ )
+		prev[i] = next[i] = rng() & 0xF;
+
+	for( i = 0; i < (rows * cols) / 10; i++ )
+		next[rng() % (rows * cols)] = rng() & 0xF;
+}
+
+static void wl_clear(uint8_t *next, uint8_t *prev, int rows, int cols) {
+	int i;
+
+	for( i = 0; i < rows * cols; i++ )
+		prev[i] = rng() & 0xF;
+	memset(next, 0, rows * cols);
+}
+
+static void wl_full_random(uint8_t *next, uint8_t *prev, int rows,
+                           int cols) {
+	int i;
+
+	for( i = 0; i < rows * cols; i++ ) {
+		prev[i] = rng() & 0xF;
+		next[i] = rng() & 0xF;
+	}
+}
+
+/* --- rings --- */
+
+static void test_ring_indicator_move(void) {
+	uint8_t prev[MONOME_RING_LEDS] = {0}, next[MONOME_RING_LEDS] = {0};
+	int i;
+
+	/* on a dark ring, clearing it and setting one led beats two sets */
+	prev[10] = 15;
+	next[11] = 15;
+	assert(encode_ring(&mext_cost, next, prev)
+	       == mext_cost.ring_all + mext_cost.ring_set);
+
+	/* over a background, only the two leds that changed go out */
+	for( i = 0; i < MONOME_RING_LEDS; i++ )
+		prev[i] = next[i] = (i / 8) + 1;
+	prev[10] = 15;
+	next[11] = 15;
+	assert(encode_ring(&mext_cost, next, prev) == 2 * mext_cost.ring_set);
+	assert(dev.ring_cmds[RING_SET] == 2);
+}
+
+static void test_ring_segment_uses_range(void) {
+	uint8_t prev[MONOME_RING_LEDS] = {0}, next[MONOME_RING_LEDS] = {0};
+	monome_led_cost_t no_range = mext_cost;
+
+	/* an unchanged led inside the segment doesn't split the range */
+	prev[24] = 9;
+	memset(&next[20], 9, 12);
+	assert(encode_ring(&mext_cost, next, prev) == mext_cost.ring_range);
+	assert(dev.ring_cmds[RING_RANGE] == 1);
+
+	/* without ranges, eleven sets would cost more than a map */
+	no_range.ring_range = 0;
+	assert(encode_ring(&no_range, next, prev) == no_range.ring_map);
+	assert(!dev.ring_cmds[RING_RANGE]);
+}
+
+static void test_ring_uniform_uses_all(void) {
+	uint8_t next[MONOME_RING_LEDS];
+
+	memset(next, 7, sizeof(next));
+	next[63] = 2;
+	assert(encode_ring(&mext_cost, next, NULL)
+	       == mext_cost.ring_all + mext_cost.ring_set);
+	assert(dev.ring_cmds[RING_ALL] == 1);
+}
+
+static void test_ring_scattered_uses_map(void) {
+	uint8_t prev[MONOME_RING_LEDS] = {0}, next[MONOME_RING_LEDS];
+	int i;
+
+	for( i = 0; i < MONOME_RING_LEDS; i++ )
+		next[i] = i & 0xF;
+
+	assert(encode_ring(&mext_cost, next, prev) == mext_cost.ring_map);
+	assert(encode_ring(&mext_cost, next, NULL) == mext_cost.ring_map);
+}
+
+static void test_ring_unchanged_costs_nothing(void) {
+	uint8_t a[MONOME_RING_LEDS];
+	monome_ring_plan_t plan;
+
+	memset(a, 3, sizeof(a));
+	assert(monome_encoder_ring_plan(&mext_cost, a, a, &plan) == 0);
+}
+
+static void test_report_bytes_per_frame(void) {
+	static const struct {
+		const char *name;
+		workload_func_t fn;
+	} workloads[] = {
+		{"single led",  wl_single_led},
+		{"row update",  wl_row_update},
+		{"level meter", wl_meter},
+		{"sparse 10%",  wl_sparse},
+		{"clear",       wl_clear},
+		{"full random", wl_full_random}
+	};
+
+	const struct {
+		const char *name;
+		const monome_led_cost_t *cost;
+		int rows, cols;
+	} models[] = {
+		{"mext 16x16",   &mext_cost,   16, 16},
+		{"series 16x16", &series_cost, 16, 16},
+		{"40h 8x8",      &h40_cost,     8,  8}
+	};
+
+	uint8_t next[256], prev[256];
+	size_t bytes, naive;
+	unsigned int w, i;
+
+	printf("\n");
+
+	for( i = 0; i < sizeof(models) / sizeof(*models); i++ ) {
+		/* what redrawing every quad from scratch would cost */
+		naive = (models[i].rows / 8) * (models[i].cols / 8)
+			* (models[i].cost->monobright
+			   ? models[i].cost->map : models[i].cost->level_map);
+
+		for( w = 0; w < sizeof(workloads) / sizeof(*workloads); w++ ) {
+			rng_state = 1;
+			workloads[w].fn(next, prev, models[i].rows, models[i].cols);
+
+			bytes = encode(models[i].cost, models[i].rows, models[i].cols,
+			               next, prev);
+			assert(bytes <= naive);
+
+			printf("    %-14s %-12s %4zu bytes/frame (full redraw %zu)\n",
+			       models[i].name, workloads[w].name, bytes, naive);
+		}
+	}
+
+	printf("  %-50s", "");
+}
+
+int main(void) {
+	printf("test_encoder:\n");
+
+	load_protocol_costs();
+
+	RUN_TEST(test_mext_cost_from_payload_table);
+	RUN_TEST(test_mext_ring_cost_from_payload_table);
+	RUN_TEST(test_40h_cost);
+	RUN_TEST(test_default_cost_without_protocol_model);
+	RUN_TEST(test_unchanged_costs_nothing);
+	RUN_TEST(test_binary_led_uses_on_off);
+	RUN_TEST(test_binary_row_uses_led_row);
+	RUN_TEST(test_binary_quad_uses_led_map);
+	RUN_TEST(test_uniform_uses_all);
+	RUN_TEST(test_monobright_ignores_invisible_changes);
+	RUN_TEST(test_series_wide_grid_avoids_rows);
+	RUN_TEST(test_ring_indicator_move);
+	RUN_TEST(test_ring_segment_uses_range);
+	RUN_TEST(test_ring_uniform_uses_all);
+	RUN_TEST(test_ring_scattered_uses_map);
+	RUN_TEST(test_ring_unchanged_costs_nothing);
+	RUN_TEST(test_report_bytes_per_frame);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,511 @@
+/**
+ * Tests for the retained led and ring frames (frame.c).
+ * Uses stack-allocated struct monome with mock led_level and led_ring
+ * functions that record which commands a commit chose to send.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* --- mock led_level stubs --- */
+
+static struct {
+	int set, all, map, row, col;
+	int fail;
+
+	/* what the "device" is showing */
+	uint8_t grid[16][16];
+
+	int ring_set, ring_all, ring_map, ring_range;
+	uint8_t rings[4][MONOME_RING_LEDS];
+} calls;
+
+static void reset_calls(void) {
+	int fail = calls.fail;
+	uint8_t grid[16][16], rings[4][MONOME_RING_LEDS];
+
+	memcpy(grid, calls.grid, sizeof(grid));
+	memcpy(rings, calls.rings, sizeof(rings));
+	memset(&calls, 0, sizeof(calls));
+	memcpy(calls.grid, grid, sizeof(grid));
+	memcpy(calls.rings, rings, sizeof(rings));
+	calls.fail = fail;
+}
+
+static int mock_level_set(monome_t *m, uint_t x, uint_t y, uint_t l) {
+	(void)m;
+	calls.set++;
+	calls.grid[y][x] = l;
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_level_all(monome_t *m, uint_t l) {
+	(void)m;
+	calls.all++;
+	memset(calls.grid, l, sizeof(calls.grid));
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_level_map(monome_t *m, uint_t x_off, uint_t y_off,
+                          const uint8_t *d) {
+	uint_t y;
+	(void)m;
+
+	calls.map++;
+	for( y = 0; y < 8; y++ )
+		memcpy(&calls.grid[y_off + y][x_off], &d[y * 8], 8);
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_level_row(monome_t *m, uint_t x_off, uint_t y,
+                          size_t c, const uint8_t *d) {
+	(void)m;
+	calls.row++;
+	memcpy(&calls.grid[y][x_off], d, c);
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_level_col(monome_t *m, uint_t x, uint_t y_off,
+                          size_t c, const uint8_t *d) {
+	size_t i;
+	(void)m;
+
+	calls.col++;
+	for( i = 0; i < c; i++ )
+		calls.grid[y_off + i][x] = d[i];
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static monome_led_level_functions_t mock_level_fns = {
+	.set = mock_level_set,
+	.all = mock_level_all,
+	.map = mock_level_map,
+	.row = mock_level_row,
+	.col = mock_level_col
+};
+
+static int mock_ring_set(monome_t *m, uint_t ring, uint_t led, uint_t l) {
+	(void)m;
+	calls.ring_set++;
+	calls.rings[ring][led] = l;
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_ring_all(monome_t *m, uint_t ring, uint_t l) {
+	(void)m;
+	calls.ring_all++;
+	memset(calls.rings[ring], l, MONOME_RING_LEDS);
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_ring_map(monome_t *m, uint_t ring, const uint8_t *d) {
+	(void)m;
+	calls.ring_map++;
+	memcpy(calls.rings[ring], d, MONOME_RING_LEDS);
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static int mock_ring_range(monome_t *m, uint_t ring, uint_t start,
+                           uint_t end, uint_t l) {
+	(void)m;
+	calls.ring_range++;
+	memset(&calls.rings[ring][start], l, end - start + 1);
+	return calls.fail ? -1 : MONOME_OK;
+}
+
+static monome_led_ring_functions_t mock_ring_fns = {
+	.set = mock_ring_set,
+	.all = mock_ring_all,
+	.map = mock_ring_map,
+	.range = mock_ring_range
+};
+
+/* helper: build a zeroed monome with given dimensions */
+static monome_t make_monome(int rows, int cols) {
+	monome_t m;
+	memset(&m, 0, sizeof(m));
+	m.rows = rows;
+	m.cols = cols;
+	m.rotation = MONOME_ROTATE_0;
+	m.led_level = &mock_level_fns;
+	m.led_ring = &mock_ring_fns;
+	memset(&calls, 0, sizeof(calls));
+	return m;
+}
+
+/* the mock device and the frame should agree after every commit */
+static void assert_device_matches(monome_frame_t *f) {
+	int x, y;
+
+	for( y = 0; y < monome_frame_get_rows(f); y++ )
+		for( x = 0; x < monome_frame_get_cols(f); x++ )
+			assert(calls.grid[y][x] == monome_frame_get(f, x, y));
+}
+
+static void assert_rings_match(monome_ring_frame_t *f) {
+	int ring, led;
+
+	for( ring = 0; ring < monome_ring_frame_get_rings(f); ring++ )
+		for( led = 0; led < MONOME_RING_LEDS; led++ )
+			assert(calls.rings[ring][led]
+			       == monome_ring_frame_get(f, ring, led));
+}
+
+/* --- construction --- */
+
+static void test_new_dimensions(void) {
+	monome_t m = make_monome(8, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	assert(f);
+	assert(monome_frame_get_rows(f) == 8);
+	assert(monome_frame_get_cols(f) == 16);
+	assert(monome_frame_get(f, 15, 7) == 0);
+	monome_frame_free(f);
+}
+
+static void test_new_rejects_non_grid(void) {
+	monome_t m = make_monome(0, 0);
+	assert(monome_frame_new(&m) == NULL);
+
+	m = make_monome(8, 12);
+	assert(monome_frame_new(&m) == NULL);
+}
+
+static void test_set_get_bounds(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	assert(monome_frame_set(f, 3, 4, 9) == MONOME_OK);
+	assert(monome_frame_get(f, 3, 4) == 9);
+	assert(monome_frame_get_data(f)[4 * 8 + 3] == 9);
+
+	assert(monome_frame_set(f, 8, 0, 1) == MONOME_ERROR_OUT_OF_RANGE);
+	assert(monome_frame_set(f, 0, 8, 1) == MONOME_ERROR_OUT_OF_RANGE);
+	assert(monome_frame_get(f, 8, 0) == MONOME_ERROR_OUT_OF_RANGE);
+
+	/* levels are 4 bits */
+	monome_frame_set(f, 0, 0, 0x1F);
+	assert(monome_frame_get(f, 0, 0) == 0xF);
+	monome_frame_free(f);
+}
+
+static void test_commit_unsupported(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	m.led_level = NULL;
+	assert(monome_frame_commit(f) == MONOME_ERROR_UNSUPPORTED);
+	monome_frame_free(f);
+}
+
+/* --- diffing --- */
+
+static void test_first_commit_uniform_uses_all(void) {
+	monome_t m = make_monome(16, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	monome_frame_clear(f, 3);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.all == 1);
+	assert(calls.set + calls.row + calls.col + calls.map == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_unchanged_commit_sends_nothing(void) {
+	monome_t m = make_monome(8, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	monome_frame_set(f, 1, 1, 5);
+	assert(monome_frame_commit(f) == MONOME_OK);
+
+	reset_calls();
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.set + calls.all + calls.row + calls.col + calls.map == 0);
+	monome_frame_free(f);
+}
+
+static void test_single_led_uses_set(void) {
+	monome_t m = make_monome(16, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	monome_frame_clear(f, 0);
+	monome_frame_commit(f);
+
+	reset_calls();
+	monome_frame_set(f, 12, 9, 7);
+	monome_frame_set(f, 2, 2, 1);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.set == 2);
+	assert(calls.row + calls.col + calls.map + calls.all == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_full_row_uses_row(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+	int x;
+
+	monome_frame_commit(f);
+
+	reset_calls();
+	for( x = 0; x < 8; x++ )
+		monome_frame_set(f, x, 5, x);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.row == 1);
+	assert(calls.set + calls.col + calls.map == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_full_col_uses_col(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+	int y;
+
+	monome_frame_commit(f);
+
+	reset_calls();
+	for( y = 0; y < 8; y++ )
+		monome_frame_set(f, 6, y, y + 1);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.col == 1);
+	assert(calls.set + calls.row + calls.map == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_dense_quad_uses_map(void) {
+	monome_t m = make_monome(8, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+	int x, y;
+
+	monome_frame_commit(f);
+
+	/* scatter changes across every row and column of the right quad only */
+	reset_calls();
+	for( y = 0; y < 8; y++ )
+		for( x = 0; x < 8; x++ )
+			monome_frame_set(f, 8 + x, y, (x * y) & 0xF);
+	monome_frame_set(f, 8, 0, 15);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.map == 1);
+	assert(calls.set + calls.row + calls.col == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_first_commit_sends_everything(void) {
+	monome_t m = make_monome(16, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+	int x, y;
+
+	/* device starts in an unknown state, and no level dominates */
+	memset(calls.grid, 0xA, sizeof(calls.grid));
+	for( y = 0; y < 16; y++ )
+		for( x = 0; x < 16; x++ )
+			monome_frame_set(f, x, y, x + y);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.map == 4);
+	assert(calls.all == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_first_commit_clears_then_diffs(void) {
+	monome_t m = make_monome(16, 16);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	memset(calls.grid, 0xA, sizeof(calls.grid));
+	monome_frame_set(f, 0, 0, 1);
+	monome_frame_set(f, 9, 12, 5);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.all == 1);
+	assert(calls.set == 2);
+	assert(calls.row + calls.col + calls.map == 0);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_invalidate_resends(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	monome_frame_set(f, 0, 0, 1);
+	monome_frame_commit(f);
+
+	reset_calls();
+	memset(calls.grid, 0xA, sizeof(calls.grid));
+	monome_frame_invalidate(f);
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.all == 1);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+static void test_failed_commit_invalidates(void) {
+	monome_t m = make_monome(8, 8);
+	monome_frame_t *f = monome_frame_new(&m);
+
+	monome_frame_set(f, 0, 0, 1);
+	monome_frame_commit(f);
+
+	monome_frame_set(f, 1, 0, 1);
+	calls.fail = 1;
+	assert(monome_frame_commit(f) < 0);
+
+	/* nothing changed since, but the device state is unknown */
+	calls.fail = 0;
+	reset_calls();
+	memset(calls.grid, 0xA, sizeof(calls.grid));
+	assert(monome_frame_commit(f) == MONOME_OK);
+	assert(calls.all == 1);
+	assert_device_matches(f);
+	monome_frame_free(f);
+}
+
+/* --- ring frames --- */
+
+static void test_ring_set_get_bounds(void) {
+	monome_t m = make_monome(0, 0);
+	monome_ring_frame_t *f;
+
+	assert(monome_ring_frame_new(&m, 0) == NULL);
+
+	f = monome_ring_frame_new(&m, 2);
+	assert(f);
+	assert(monome_ring_frame_get_rings(f) == 2);
+
+	assert(monome_ring_frame_set(f, 1, 63, 0x1F) == MONOME_OK);
+	assert(monome_ring_frame_get(f, 1, 63) == 0xF);
+	assert(monome_ring_frame_get_data(f)[MONOME_RING_LEDS + 63] == 0xF);
+
+	assert(monome_ring_frame_set(f, 2, 0, 1) == MONOME_ERROR_OUT_OF_RANGE);
+	assert(monome_ring_frame_set(f, 0, 64, 1) == MONOME_ERROR_OUT_OF_RANGE);
+	assert(monome_ring_frame_get(f, 2, 0) == MONOME_ERROR_OUT_OF_RANGE);
+
+	m.led_ring = NULL;
+	assert(monome_ring_frame_commit(f) == MONOME_ERROR_UNSUPPORTED);
+	monome_ring_frame_free(f);
+}
+
+static void test_ring_first_commit_uses_all(void) {
+	monome_t m = make_monome(0, 0);
+	monome_ring_frame_t *f = monome_ring_frame_new(&m, 4);
+
+	memset(calls.rings, 0xA, sizeof(calls.rings));
+	monome_ring_frame_set(f, 2, 0, 15);
+	assert(monome_ring_frame_commit(f) == MONOME_OK);
+	assert(calls.ring_all == 4);
+	assert(calls.ring_set == 1);
+	assert(calls.ring_map + calls.ring_range == 0);
+	assert_rings_match(f);
+
+	reset_calls();
+	assert(monome_ring_frame_commit(f) == MONOME_OK);
+	assert(calls.ring_set + calls.ring_all + calls.ring_map == 0);
+	monome_ring_frame_free(f);
+}
+
+static void test_ring_indicator_move_sends_only_changes(void) {
+	monome_t m = make_monome(0, 0);
+	monome_ring_frame_t *f = monome_ring_frame_new(&m, 4);
+	int ring, pos;
+
+	for( pos = 0; pos < 8; pos++ ) {
+		reset_calls();
+		monome_ring_frame_clear(f, 0);
+		for( ring = 0; ring < 4; ring++ )
+			monome_ring_frame_set(f, ring, pos + ring, 15);
+
+		assert(monome_ring_frame_commit(f) == MONOME_OK);
+		assert_rings_match(f);
+
+		/* each ring is cleared and gets its one led back */
+		assert(calls.ring_all == 4);
+		assert(calls.ring_set == 4);
+		assert(calls.ring_map + calls.ring_range == 0);
+	}
+
+	monome_ring_frame_free(f);
+}
+
+static void test_ring_unchanged_rings_are_skipped(void) {
+	monome_t m = make_monome(0, 0);
+	monome_ring_frame_t *f = monome_ring_frame_new(&m, 4);
+	int led;
+
+	monome_ring_frame_commit(f);
+
+	reset_calls();
+	for( led = 0; led < MONOME_RING_LEDS; led++ )
+		monome_ring_frame_set(f, 3, led, led & 0xF);
+	assert(monome_ring_frame_commit(f) == MONOME_OK);
+	assert(calls.ring_map == 1);
+	assert(calls.ring_set + calls.ring_all + calls.ring_range == 0);
+	assert_rings_match(f);
+	monome_ring_frame_free(f);
+}
+
+static void test_ring_failed_commit_invalidates(void) {
+	monome_t m = make_monome(0, 0);
+	monome_ring_frame_t *f = monome_ring_frame_new(&m, 1);
+
+	monome_ring_frame_commit(f);
+
+	monome_ring_frame_set(f, 0, 5, 3);
+	calls.fail = 1;
+	assert(monome_ring_frame_commit(f) < 0);
+
+	calls.fail = 0;
+	reset_calls();
+	memset(calls.rings, 0xA, sizeof(calls.rings));
+	assert(monome_ring_frame_commit(f) == MONOME_OK);
+	assert(calls.ring_all == 1);
+	assert_rings_match(f);
+	monome_ring_frame_free(f);
+}
+
+int main(void) {
+	printf("test_frame:\n");
+
+	RUN_TEST(test_new_dimensions);
+	RUN_TEST(test_new_rejects_non_grid);
+	RUN_TEST(test_set_get_bounds);
+	RUN_TEST(test_commit_unsupported);
+	RUN_TEST(test_first_commit_uniform_uses_all);
+	RUN_TEST(test_unchanged_commit_sends_nothing);
+	RUN_TEST(test_single_led_uses_set);
+	RUN_TEST(test_full_row_uses_row);
+	RUN_TEST(test_full_col_uses_col);
+	RUN_TEST(test_dense_quad_uses_map);
+	RUN_TEST(test_first_commit_sends_everything);
+	RUN_TEST(test_first_commit_clears_then_diffs);
+	RUN_TEST(test_invalidate_resends);
+	RUN_TEST(test_failed_commit_invalidates);
+	RUN_TEST(test_ring_set_get_bounds);
+	RUN_TEST(test_ring_first_commit_uses_all);
+	RUN_TEST(test_ring_indicator_move_sends_only_changes);
+	RUN_TEST(test_ring_unchanged_rings_are_skipped);
+	RUN_TEST(test_ring_failed_commit_invalidates);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+/**
+ * Tests for poll group hotplug (hotplug.c). A pty stands in for a mext
+ * device, and closing the master side is the unplug. Arrivals need a real
+ * udev to announce them, so only departures are tested here.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+static int master;
+
+static struct {
+	int calls;
+	monome_t *monome;
+	monome_hotplug_event_t event;
+} seen;
+
+static void hotplug_cb(monome_poll_group_t *group, monome_t *monome,
+                       monome_hotplug_event_t event, void *data) {
+	(void) group;
+	(void) data;
+
+	seen.calls++;
+	seen.monome = monome;
+	seen.event = event;
+}
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert((master = posix_openpt(O_RDWR | O_NOCTTY)) >= 0);
+	assert(!grantpt(master));
+	assert(!unlockpt(master));
+
+	m->fd = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+	assert(m->fd >= 0);
+
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	close(m->fd);
+	m->free(m);
+}
+
+/* a group holding one device, watching for hotplug. returns NULL where
+   there's no device monitor to watch. */
+static monome_poll_group_t *make_group(monome_t *m) {
+	monome_poll_group_t *group = monome_poll_group_new();
+	int ret;
+
+	assert(group);
+	assert(monome_poll_group_add(group, m) == MONOME_OK);
+
+	ret = monome_poll_group_enable_hotplug(group, hotplug_cb, NULL);
+	if( ret == MONOME_ERROR_UNSUPPORTED ) {
+		monome_poll_group_free(group);
+		return NULL;
+	}
+
+	assert(ret == MONOME_OK);
+	memset(&seen, 0, sizeof(seen));
+	return group;
+}
+
+/* --- tests --- */
+
+static void test_unplug_departs_from_wait(void) {
+	monome_t *m = make_mext();
+	monome_poll_group_t *group;
+	int i;
+
+	if( !(group = make_group(m)) )
+		goto out;
+
+	close(master);
+
+	/* the hangup is a departure, not an error */
+	for( i = 0; !seen.calls && i < 10; i++ )
+		assert(monome_poll_group_wait(group, 100) >= 0);
+
+	assert(seen.calls == 1);
+	assert(seen.monome == m);
+	assert(seen.event == MONOME_HOTPLUG_DEPARTED);
+	assert(m->group == NULL);
+
+	/* an empty group keeps waiting for devices to arrive */
+	assert(monome_poll_group_wait(group, 0) >= 0);
+	assert(seen.calls == 1);
+
+	monome_poll_group_free(group);
+	free_mext(m);
+	return;
+
+out:
+	close(master);
+	free_mext(m);
+}
+
+static void test_unplug_departs_from_process(void) {
+	monome_t *m = make_mext();
+	monome_poll_group_t *group;
+
+	if( !(group = make_group(m)) )
+		goto out;
+
+	close(master);
+
+	assert(monome_poll_group_process(group, 0, 0) == 0);
+	assert(seen.calls == 1);
+	assert(seen.event == MONOME_HOTPLUG_DEPARTED);
+
+	assert(monome_poll_group_process(group, 0, 0) == 0);
+	assert(seen.calls == 1);
+
+	monome_poll_group_free(group);
+	free_mext(m);
+	return;
+
+out:
+	close(master);
+	free_mext(m);
+}
+
+static void test_enable_and_disable(void) {
+	monome_t *m = make_mext();
+	monome_poll_group_t *group;
+
+	if( !(group = make_group(m)) )
+		goto out;
+
+	assert(monome_poll_group_enable_hotplug(group, NULL, NULL)
+	       == MONOME_ERROR_INVALID_ARG);
+	assert(monome_poll_group_enable_hotplug(NULL, hotplug_cb, NULL)
+	       == MONOME_ERROR_INVALID_ARG);
+
+	/* a reader thread can't be opening devices behind the app's back */
+	assert(!monome_event_queue_new(group, 0));
+
+	/* enabling again just replaces the callback */
+	assert(monome_poll_group_enable_hotplug(group, hotplug_cb, &seen)
+	       == MONOME_OK);
+
+	/* once disabled, an empty group has nothing to wait for */
+	monome_poll_group_disable_hotplug(group);
+	assert(monome_poll_group_remove(group, m) == MONOME_OK);
+	assert(monome_poll_group_wait(group, 0) == -1);
+
+	monome_poll_group_free(group);
+
+out:
+	close(master);
+	free_mext(m);
+}
+
+int main(void) {
+	printf("test_hotplug:\n");
+
+	RUN_TEST(test_unplug_departs_from_wait);
+	RUN_TEST(test_unplug_departs_from_process);
+	RUN_TEST(test_enable_and_disable);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
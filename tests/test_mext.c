@@ -0,0 +1,560 @@
+/**
+ * Tests for the mext protocol's buffered i/o. A datagram socketpair stands
+ * in for the serial device, so the test can feed raw protocol bytes in and
+ * see each write() the library makes as a separate packet coming out.
+ * The handshake tests open a pty instead, with a thread answering on the
+ * other side.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+static int fds[2];
+
+/* helper: a mext device talking to the test's end of the socketpair */
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_DGRAM, 0, fds));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 8;
+	m->cols = 8;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+static void feed(const uint8_t *buf, size_t nbyte) {
+	assert(write(fds[1], buf, nbyte) == (ssize_t) nbyte);
+}
+
+/* returns the size of the next write() the library made, or -1 if none */
+static ssize_t sent(uint8_t *buf, size_t nbyte) {
+	return read(fds[1], buf, nbyte);
+}
+
+static void test_empty_returns_zero(void) {
+	monome_t *m = make_mext();
+	monome_event_t e;
+
+	assert(monome_event_next(m, &e) == 0);
+	free_mext(m);
+}
+
+static void test_single_key(void) {
+	monome_t *m = make_mext();
+	uint8_t down[] = {0x21, 3, 5};
+	monome_event_t e;
+
+	feed(down, sizeof(down));
+
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_BUTTON_DOWN);
+	assert(e.grid.x == 3 && e.grid.y == 5);
+	assert(e.monome == m);
+
+	assert(monome_event_next(m, &e) == 0);
+	free_mext(m);
+}
+
+static void test_many_messages_one_read(void) {
+	monome_t *m = make_mext();
+	uint8_t keys[] = {0x21, 0, 0, 0x20, 0, 0, 0x21, 7, 7, 0x20, 7, 7};
+	monome_event_t e;
+	int i;
+
+	feed(keys, sizeof(keys));
+
+	for( i = 0; i < 4; i++ ) {
+		assert(monome_event_next(m, &e) == 1);
+		assert(e.event_type == ((i & 1) ? MONOME_BUTTON_UP : MONOME_BUTTON_DOWN));
+	}
+
+	/* everything came in with the first read() */
+	assert(m->rx.start == 0 && m->rx.end == 0);
+	assert(monome_event_next(m, &e) == 0);
+	free_mext(m);
+}
+
+static void test_partial_message_resumes(void) {
+	monome_t *m = make_mext();
+	uint8_t delta[] = {0x50, 2, 0xFD};
+	monome_event_t e;
+
+	feed(delta, 2);
+	assert(monome_event_next(m, &e) == 0);
+	assert(m->rx.end - m->rx.start == 2);
+
+	feed(delta + 2, 1);
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_ENCODER_DELTA);
+	assert(e.encoder.number == 2);
+	assert(e.encoder.delta == -3);
+	free_mext(m);
+}
+
+static void test_partial_tilt_across_reads(void) {
+	monome_t *m = make_mext();
+	uint8_t tilt[] = {0x81, 0, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00};
+	monome_event_t e;
+	size_t i;
+
+	/* one byte per read, the worst case for the old blocking reader */
+	for( i = 0; i < sizeof(tilt) - 1; i++ ) {
+		feed(&tilt[i], 1);
+		assert(monome_event_next(m, &e) == 0);
+	}
+
+	feed(&tilt[i], 1);
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_TILT);
+	assert(e.tilt.sensor == 0);
+	free_mext(m);
+}
+
+static void test_stray_byte_is_skipped(void) {
+	monome_t *m = make_mext();
+	uint8_t msgs[] = {0x22, 0x21, 3, 5};
+	monome_event_t e;
+
+	/* 0x22 is in the key subsystem but isn't a message. it mustn't come
+	   out as a key up at 0,0. */
+	feed(msgs, sizeof(msgs));
+
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_BUTTON_DOWN);
+	assert(e.grid.x == 3 && e.grid.y == 5);
+
+	assert(monome_event_next(m, &e) == 0);
+	free_mext(m);
+}
+
+static void test_system_messages_consumed(void) {
+	monome_t *m = make_mext();
+	uint8_t msgs[] = {0x03, 16, 8, 0x21, 1, 2};
+	monome_event_t e;
+
+	feed(msgs, sizeof(msgs));
+
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_BUTTON_DOWN);
+	assert(m->cols == 16 && m->rows == 8);
+	free_mext(m);
+}
+
+static void test_next_batch(void) {
+	monome_t *m = make_mext();
+	uint8_t msgs[] = {0x21, 0, 0, 0x03, 8, 8, 0x50, 1, 1, 0x20, 0, 0};
+	monome_event_t events[8];
+
+	feed(msgs, sizeof(msgs));
+
+	/* the grid size response is consumed, not returned */
+	assert(monome_event_next_batch(m, events, 8) == 3);
+	assert(events[0].event_type == MONOME_BUTTON_DOWN);
+	assert(events[1].event_type == MONOME_ENCODER_DELTA);
+	assert(events[2].event_type == MONOME_BUTTON_UP);
+	assert(events[2].monome == m);
+
+	assert(monome_event_next_batch(m, events, 8) == 0);
+	free_mext(m);
+}
+
+static void test_next_batch_respects_max(void) {
+	monome_t *m = make_mext();
+	uint8_t keys[] = {0x21, 0, 0, 0x21, 1, 0, 0x21, 2, 0};
+	monome_event_t events[2];
+
+	feed(keys, sizeof(keys));
+
+	assert(monome_event_next_batch(m, events, 2) == 2);
+	assert(events[1].grid.x == 1);
+	assert(monome_event_next_batch(m, events, 2) == 1);
+	assert(events[0].grid.x == 2);
+	free_mext(m);
+}
+
+static int handled;
+
+static void count_handler(const monome_event_t *e, void *data) {
+	(void)e; (void)data;
+	handled++;
+}
+
+static void test_handle_next_batch(void) {
+	monome_t *m = make_mext();
+	uint8_t keys[3 * 40];
+	int i;
+
+	for( i = 0; i < 40; i++ ) {
+		keys[i * 3] = 0x21;
+		keys[i * 3 + 1] = i & 7;
+		keys[i * 3 + 2] = i >> 3;
+	}
+
+	feed(keys, sizeof(keys));
+	monome_register_handler(m, MONOME_BUTTON_DOWN, count_handler, NULL);
+
+	/* more than one internal batch's worth, all from a single read() */
+	handled = 0;
+	assert(monome_event_handle_next_batch(m, SIZE_MAX) == 40);
+	assert(handled == 40);
+	free_mext(m);
+}
+
+static void test_immediate_write(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[64];
+
+	assert(monome_led_on(m, 1, 2) == 3);
+	assert(sent(buf, sizeof(buf)) == 3);
+	assert(buf[0] == 0x11 && buf[1] == 1 && buf[2] == 2);
+	assert(sent(buf, sizeof(buf)) == -1);
+	free_mext(m);
+}
+
+static void test_multi_message_call_is_one_write(void) {
+	monome_t *m = make_mext();
+	uint8_t data[2] = {0xFF, 0x0F};
+	uint8_t buf[64];
+
+	m->cols = 16;
+	monome_led_row(m, 0, 0, 2, data);
+
+	/* two CMD_LED_ROW messages, one write */
+	assert(sent(buf, sizeof(buf)) == 8);
+	assert(buf[0] == 0x15 && buf[4] == 0x15);
+	assert(sent(buf, sizeof(buf)) == -1);
+	free_mext(m);
+}
+
+static void test_deferred_coalesces(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[256];
+	uint_t i;
+
+	monome_set_deferred(m, 1);
+
+	for( i = 0; i < 8; i++ )
+		monome_led_level_set(m, i, 0, i);
+
+	assert(sent(buf, sizeof(buf)) == -1);
+
+	assert(monome_flush(m) == MONOME_OK);
+	assert(sent(buf, sizeof(buf)) == 8 * 4);
+	assert(buf[4] == 0x18 && buf[5] == 1 && buf[7] == 1);
+
+	/* nothing left over */
+	assert(monome_flush(m) == MONOME_OK);
+	assert(sent(buf, sizeof(buf)) == -1);
+	free_mext(m);
+}
+
+static void test_deferred_flushes_when_full(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+	uint8_t buf[MONOME_TX_BUF_SIZE];
+	int i, maps;
+
+	monome_set_deferred(m, 1);
+
+	maps = MONOME_TX_BUF_SIZE / 35 + 1;
+	for( i = 0; i < maps; i++ )
+		monome_led_level_map(m, 0, 0, levels);
+
+	/* the map that didn't fit pushed the full buffer out */
+	assert(sent(buf, sizeof(buf)) == (maps - 1) * 35);
+	assert(sent(buf, sizeof(buf)) == -1);
+
+	monome_set_deferred(m, 0);
+	assert(sent(buf, sizeof(buf)) == 35);
+	free_mext(m);
+}
+
+static void test_masked_subsystems_skipped(void) {
+	monome_t *m = make_mext();
+	uint8_t in[] = {
+		0x21, 1, 1,                                 /* key down */
+		0x81, 0, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, /* tilt */
+		0x50, 0, 0x01,                              /* encoder delta */
+		0x20, 1, 1                                  /* key up */
+	};
+	monome_event_t events[8];
+
+	assert(monome_get_event_mask(m) == MONOME_EVENT_MASK_ALL);
+	assert(monome_set_event_mask(m, MONOME_EVENT_MASK(MONOME_ENCODER_DELTA)
+	                             | MONOME_EVENT_MASK(MONOME_BUTTON_UP))
+	       == MONOME_OK);
+
+	feed(in, sizeof(in));
+
+	/* the whole read is consumed, but only the wanted events come out */
+	assert(monome_event_next_batch(m, events, 8) == 2);
+	assert(events[0].event_type == MONOME_ENCODER_DELTA);
+	assert(events[1].event_type == MONOME_BUTTON_UP);
+	assert(m->rx.start == m->rx.end);
+
+	assert(monome_set_event_mask(m, 1U << 31) == MONOME_ERROR_INVALID_ARG);
+	free_mext(m);
+}
+
+static void test_events_are_timestamped(void) {
+	monome_t *m = make_mext();
+	uint8_t first[] = {0x21, 1, 1, 0x20, 1, 1}, second[] = {0x21, 2, 2};
+	monome_event_t events[4];
+	uint64_t stamps[4], before, after;
+
+	before = m_now_ns();
+	feed(first, sizeof(first));
+	assert(monome_event_next_batch_ts(m, events, stamps, 1) == 1);
+	after = m_now_ns();
+
+	assert(stamps[0] >= before && stamps[0] <= after);
+
+	/* the second event came in with the same read, even though it's
+	   handed out later */
+	m_sleep(2);
+	feed(second, sizeof(second));
+	assert(monome_event_next_batch_ts(m, events, stamps, 4) == 2);
+	assert(events[0].event_type == MONOME_BUTTON_UP);
+	assert(stamps[0] <= after);
+	assert(stamps[1] > after);
+
+	free_mext(m);
+}
+
+static struct {
+	uint64_t stamp, copy_stamp;
+} stamped;
+
+static void stamp_handler(const monome_event_t *e, void *data) {
+	monome_event_t copy = *e;
+
+	stamped.stamp = monome_event_get_timestamp(e);
+	stamped.copy_stamp = monome_event_get_timestamp(&copy);
+}
+
+static void test_handler_sees_timestamp(void) {
+	monome_t *m = make_mext();
+	uint8_t in[] = {0x21, 1, 1};
+	uint64_t before;
+
+	monome_register_handler(m, MONOME_BUTTON_DOWN, stamp_handler, NULL);
+
+	before = monome_get_time_ns();
+	feed(in, sizeof(in));
+	assert(monome_event_handle_next(m) == 1);
+
+	assert(stamped.stamp >= before);
+	assert(stamped.stamp <= monome_get_time_ns());
+	assert(stamped.copy_stamp == 0);
+
+	free_mext(m);
+}
+
+static void test_masking_tilt_disables_it(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[16];
+
+	assert(monome_tilt_enable(m, 0) >= 0);
+	assert(sent(buf, sizeof(buf)) == 2 && buf[0] == 0x81 && buf[1] == 0);
+
+	/* nothing listens for tilt any more */
+	monome_set_event_mask(m, MONOME_EVENT_MASK_ALL
+	                      & ~MONOME_EVENT_MASK(MONOME_TILT));
+	assert(sent(buf, sizeof(buf)) == 2 && buf[0] == 0x82 && buf[1] == 0);
+
+	/* enabling while masked is remembered, not sent */
+	assert(monome_tilt_enable(m, 1) == MONOME_OK);
+	assert(sent(buf, sizeof(buf)) < 0);
+
+	/* changing the rest of the mask leaves tilt alone */
+	monome_set_event_mask(m, MONOME_EVENT_MASK(MONOME_ENCODER_DELTA));
+	assert(sent(buf, sizeof(buf)) < 0);
+
+	monome_set_event_mask(m, MONOME_EVENT_MASK_ALL);
+	assert(sent(buf, sizeof(buf)) == 2 && buf[0] == 0x81 && buf[1] == 0);
+	assert(sent(buf, sizeof(buf)) == 2 && buf[0] == 0x81 && buf[1] == 1);
+	assert(sent(buf, sizeof(buf)) < 0);
+	free_mext(m);
+}
+
+/* --- handshake --- */
+
+static monome_devmap_t test_devmap = {
+	"m", "mext", {0, 0}, "test grid", NO_QUIRKS
+};
+
+static struct {
+	int master;
+
+	/* the size of the first write the library made, and whether all three
+	   queries have been seen */
+	ssize_t first_write;
+	int queries;
+} fake;
+
+/* answers the queries the way a 16x8 grid would, with a key press that
+   gets there before the answers */
+static void *fake_device(void *arg) {
+	uint8_t buf[64], id[33] = {0x01, 'm', '1', '2', '3'};
+	uint8_t key[] = {0x21, 2, 3};
+	uint8_t query[] = {0x00, 1, 1};
+	uint8_t gridsz[] = {0x03, 16, 8};
+	struct pollfd pfd = {fake.master, POLLIN, 0};
+	ssize_t i, n;
+	(void)arg;
+
+	while( fake.queries != 7 && poll(&pfd, 1, 2000) > 0 ) {
+		if( (n = read(fake.master, buf, sizeof(buf))) <= 0 )
+			break;
+
+		if( !fake.first_write )
+			fake.first_write = n;
+
+		for( i = 0; i < n; i++ ) {
+			if( buf[i] == 0x00 ) fake.queries |= 1;
+			if( buf[i] == 0x01 ) fake.queries |= 2;
+			if( buf[i] == 0x05 ) fake.queries |= 4;
+		}
+	}
+
+	assert(write(fake.master, key, sizeof(key)) == sizeof(key));
+	assert(write(fake.master, query, sizeof(query)) == sizeof(query));
+	assert(write(fake.master, id, sizeof(id)) == sizeof(id));
+	assert(write(fake.master, gridsz, sizeof(gridsz)) == sizeof(gridsz));
+	return NULL;
+}
+
+static const char *open_pty(void) {
+	memset(&fake, 0, sizeof(fake));
+
+	assert((fake.master = posix_openpt(O_RDWR | O_NOCTTY)) >= 0);
+	assert(!grantpt(fake.master));
+	assert(!unlockpt(fake.master));
+	return ptsname(fake.master);
+}
+
+static int call_open(monome_t *m, const char *dev, ...) {
+	va_list args;
+	int ret;
+
+	va_start(args, dev);
+	ret = m->open(m, dev, "m1234567", &test_devmap, args);
+	va_end(args);
+	return ret;
+}
+
+static void test_handshake_pipelined(void) {
+	monome_t *m = monome_protocol_mext_new();
+	const char *dev = open_pty();
+	monome_event_t e;
+	pthread_t thread;
+	uint64_t start;
+
+	assert(!pthread_create(&thread, NULL, fake_device, NULL));
+
+	m->open_timeout = 1000;
+	start = m_now_ns();
+	assert(call_open(m, dev) == 0);
+	assert(m_now_ns() - start < 500000000ULL);
+	pthread_join(thread, NULL);
+
+	/* all three queries went out in the first write */
+	assert(fake.first_write == 3);
+	assert(fake.queries == 7);
+
+	assert(monome_get_cols(m) == 16 && monome_get_rows(m) == 8);
+	assert(!strcmp(monome_get_friendly_name(m), "m123"));
+
+	/* the key press that beat the answers wasn't lost */
+	assert(monome_event_next(m, &e) == 1);
+	assert(e.event_type == MONOME_BUTTON_DOWN);
+	assert(e.grid.x == 2 && e.grid.y == 3);
+	assert(monome_event_next(m, &e) == 0);
+
+	m->close(m);
+	m->free(m);
+	close(fake.master);
+}
+
+static void test_handshake_times_out(void) {
+	monome_t *m = monome_protocol_mext_new();
+	const char *dev = open_pty();
+	uint64_t start, took;
+
+	/* nobody answers */
+	m->open_timeout = 100;
+	start = m_now_ns();
+	assert(call_open(m, dev) < 0);
+	took = m_now_ns() - start;
+
+	assert(took >= 100000000ULL && took < 1000000000ULL);
+
+	m->free(m);
+	close(fake.master);
+}
+
+int main(void) {
+	printf("test_mext:\n");
+
+	RUN_TEST(test_empty_returns_zero);
+	RUN_TEST(test_single_key);
+	RUN_TEST(test_many_messages_one_read);
+	RUN_TEST(test_partial_message_resumes);
+	RUN_TEST(test_partial_tilt_across_reads);
+	RUN_TEST(test_stray_byte_is_skipped);
+	RUN_TEST(test_system_messages_consumed);
+	RUN_TEST(test_next_batch);
+	RUN_TEST(test_next_batch_respects_max);
+	RUN_TEST(test_handle_next_batch);
+	RUN_TEST(test_immediate_write);
+	RUN_TEST(test_multi_message_call_is_one_write);
+	RUN_TEST(test_deferred_coalesces);
+	RUN_TEST(test_deferred_flushes_when_full);
+	RUN_TEST(test_masked_subsystems_skipped);
+	RUN_TEST(test_events_are_timestamped);
+	RUN_TEST(test_handler_sees_timestamp);
+	RUN_TEST(test_masking_tilt_disables_it);
+	RUN_TEST(test_handshake_pipelined);
+	RUN_TEST(test_handshake_times_out);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
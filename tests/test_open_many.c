@@ -0,0 +1,210 @@
+/**
+ * Tests for monome_open_many(). Each device is a pty with a thread on the
+ * other side that takes a while to answer the handshake, so opening them
+ * one after another would take the sum of those delays.
+ *
+ * There's no udev to ask for a pty's serial. The descriptor cache supplies
+ * one instead, from mext entries that don't know the size, as enumeration
+ * leaves them, so every device still does the full handshake.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+#define DEVICES 4
+#define ANSWER_DELAY_MS 200
+
+static char cache_path[] = "/tmp/test_open_many_XXXXXX";
+
+static struct {
+	int master;
+	char path[64];
+	pthread_t thread;
+} fake[DEVICES];
+
+/* waits for all three queries, then answers as a 16x8 grid */
+static void *fake_device(void *arg) {
+	uint8_t buf[64], answers[] = {
+		0x00, 1, 1,
+		0x01, 'm', '1', '2', '3', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0x03, 16, 8
+	};
+	int master = *(int *) arg, queries = 0;
+	struct pollfd pfd = {master, POLLIN, 0};
+	ssize_t i, n;
+
+	while( queries != 7 && poll(&pfd, 1, 2000) > 0 ) {
+		if( (n = read(master, buf, sizeof(buf))) <= 0 )
+			return NULL;
+
+		for( i = 0; i < n; i++ ) {
+			if( buf[i] == 0x00 ) queries |= 1;
+			if( buf[i] == 0x01 ) queries |= 2;
+			if( buf[i] == 0x05 ) queries |= 4;
+		}
+	}
+
+	m_sleep(ANSWER_DELAY_MS);
+	assert(write(master, answers, sizeof(answers)) == sizeof(answers));
+	return NULL;
+}
+
+static void start_devices(void) {
+	FILE *f;
+	int i;
+
+	assert((f = fopen(cache_path, "w")));
+
+	for( i = 0; i < DEVICES; i++ ) {
+		assert((fake[i].master = posix_openpt(O_RDWR | O_NOCTTY)) >= 0);
+		assert(!grantpt(fake[i].master));
+		assert(!unlockpt(fake[i].master));
+		snprintf(fake[i].path, sizeof(fake[i].path), "%s",
+		         ptsname(fake[i].master));
+
+		fprintf(f, "%s\tm100000%d\tmext\t0\t0\told\n", fake[i].path, i);
+		assert(!pthread_create(&fake[i].thread, NULL, fake_device,
+		                       &fake[i].master));
+	}
+
+	fclose(f);
+
+	monome_descriptor_cache_clear();
+	assert(monome_descriptor_cache_load(cache_path) == DEVICES);
+}
+
+static void stop_devices(void) {
+	int i;
+
+	for( i = 0; i < DEVICES; i++ ) {
+		pthread_join(fake[i].thread, NULL);
+		close(fake[i].master);
+	}
+}
+
+/* --- tests --- */
+
+static void test_handshakes_overlap(void) {
+	const char *devs[DEVICES];
+	monome_t *out[DEVICES];
+	uint64_t start, took;
+	int i;
+
+	start_devices();
+
+	for( i = 0; i < DEVICES; i++ )
+		devs[i] = fake[i].path;
+
+	start = m_now_ns();
+	assert(monome_open_many(devs, DEVICES, out) == DEVICES);
+	took = (m_now_ns() - start) / 1000000;
+
+	/* one after another would be DEVICES * ANSWER_DELAY_MS */
+	assert(took >= ANSWER_DELAY_MS);
+	assert(took < 2 * ANSWER_DELAY_MS);
+
+	for( i = 0; i < DEVICES; i++ ) {
+		assert(out[i]);
+		assert(!strcmp(monome_get_devpath(out[i]), fake[i].path));
+		assert(monome_get_cols(out[i]) == 16 && monome_get_rows(out[i]) == 8);
+		assert(!strcmp(monome_get_friendly_name(out[i]), "m123"));
+	}
+
+	stop_devices();
+
+	for( i = 0; i < DEVICES; i++ )
+		monome_close(out[i]);
+}
+
+static void test_refreshes_cache(void) {
+	const char *devs[DEVICES];
+	monome_t *out[DEVICES];
+	char line[256], expect[256];
+	FILE *f;
+	int i;
+
+	start_devices();
+
+	for( i = 0; i < DEVICES; i++ )
+		devs[i] = fake[i].path;
+
+	assert(monome_open_many(devs, DEVICES, out) == DEVICES);
+	stop_devices();
+
+	/* the entries were filled in with what the devices said */
+	assert(monome_descriptor_cache_save(cache_path) == MONOME_OK);
+	assert((f = fopen(cache_path, "r")));
+
+	for( i = 0; i < DEVICES; i++ ) {
+		snprintf(expect, sizeof(expect), "%s\tm100000%d\tmext\t16\t8\tm123\n",
+		         fake[i].path, i);
+		rewind(f);
+
+		while( fgets(line, sizeof(line), f) && strcmp(line, expect) )
+			;
+
+		assert(!strcmp(line, expect));
+		monome_close(out[i]);
+	}
+
+	fclose(f);
+}
+
+static void test_failures_are_null(void) {
+	const char *devs[] = {
+		"/nonexistent/tty",
+		"osc.udp://127.0.0.1:8080/monome",
+		NULL
+	};
+	monome_t *out[3] = {(monome_t *) 1, (monome_t *) 1, (monome_t *) 1};
+
+	monome_descriptor_cache_clear();
+
+	assert(monome_open_many(devs, 3, out) == 0);
+	assert(!out[0] && !out[1] && !out[2]);
+	assert(monome_open_many(devs, 0, out) == 0);
+}
+
+int main(void) {
+	int fd;
+
+	assert((fd = mkstemp(cache_path)) >= 0);
+	close(fd);
+
+	printf("test_open_many:\n");
+
+	RUN_TEST(test_handshakes_overlap);
+	RUN_TEST(test_refreshes_cache);
+	RUN_TEST(test_failures_are_null);
+
+	monome_descriptor_cache_clear();
+	unlink(cache_path);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -1,13 +1,18 @@
 /**
  * Tests for poll group data structure operations.
  * These exercise the pure data structure logic (new/add/remove/free)
- * without requiring any hardware.
+ * without requiring any hardware. Each fake device gets a pipe for its fd,
+ * since the platform backend registers fds with the kernel.
  */
 
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <monome.h>
 #include "internal.h"
@@ -23,9 +28,75 @@ static int tests_passed = 0;
 	printf("PASS\n"); \
 } while(0)
 
-/* use a fake monome_t -- we only need distinct pointer values */
+/* use a fake monome_t -- we only need distinct pointer values and fds */
 static monome_t fake_monomes[8];
 
+#if !defined(_WIN32)
+static int fake_write_fds[8];
+
+/* each byte written to a fake device's pipe is one button press */
+static int fake_next_events(monome_t *m, monome_event_t *events,
+                            uint64_t *stamps, size_t max) {
+	uint8_t buf[32];
+	ssize_t nbyte;
+	int i;
+
+	if( max > sizeof(buf) )
+		max = sizeof(buf);
+
+	if( (nbyte = read(m->fd, buf, max)) <= 0 )
+		return 0;
+
+	for( i = 0; i < nbyte; i++ ) {
+		events[i].event_type = MONOME_BUTTON_DOWN;
+		events[i].grid.x = buf[i];
+		events[i].grid.y = 0;
+
+		if( stamps )
+			stamps[i] = 0;
+	}
+
+	return nbyte;
+}
+
+static int presses[8];
+
+/* which device each press came from, in dispatch order */
+static int order[64];
+static int norder;
+
+static void count_press(const monome_event_t *e, void *data) {
+	int dev = (monome_t *) data - fake_monomes;
+
+	presses[dev] += e->grid.x;
+	if( norder < 64 )
+		order[norder++] = dev;
+}
+
+static void reset_presses(void) {
+	memset(presses, 0, sizeof(presses));
+	norder = 0;
+}
+
+static void setup_fake_monomes(void) {
+	int i, fds[2];
+
+	for( i = 0; i < 8; i++ ) {
+		/* real device fds are non-blocking too */
+		assert(pipe(fds) == 0);
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+		fake_monomes[i].fd = fds[0];
+		fake_monomes[i].next_events = fake_next_events;
+		fake_write_fds[i] = fds[1];
+
+		monome_register_handler(&fake_monomes[i], MONOME_BUTTON_DOWN,
+		                        count_press, &fake_monomes[i]);
+	}
+}
+
+#endif
+
 static void test_new_free(void) {
 	monome_poll_group_t *g = monome_poll_group_new();
 	assert(g != NULL);
@@ -160,9 +231,165 @@ static void test_add_remove_add(void) {
 	monome_poll_group_free(g);
 }
 
+#if !defined(_WIN32)
+static void test_wait_timeout(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	monome_poll_group_add(g, &fake_monomes[1]);
+	assert(monome_poll_group_wait(g, 0) == 0);
+
+	monome_poll_group_free(g);
+}
+
+static void test_wait_empty_group(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+
+	assert(monome_poll_group_wait(g, 0) == -1);
+	assert(monome_poll_group_wait(NULL, 0) == -1);
+
+	monome_poll_group_free(g);
+}
+
+static void test_wait_dispatches_ready_only(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t press[3] = {1, 2, 3};
+	int i;
+
+	for( i = 0; i < 6; i++ )
+		monome_poll_group_add(g, &fake_monomes[i]);
+
+	memset(presses, 0, sizeof(presses));
+	assert(write(fake_write_fds[1], press, 3) == 3);
+	assert(write(fake_write_fds[4], press, 1) == 1);
+
+	assert(monome_poll_group_wait(g, 1000) == 4);
+	assert(presses[1] == 6);
+	assert(presses[4] == 1);
+	assert(presses[0] + presses[2] + presses[3] + presses[5] == 0);
+
+	/* everything was drained */
+	assert(monome_poll_group_wait(g, 0) == 0);
+
+	monome_poll_group_free(g);
+}
+
+static void test_wait_ignores_removed(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t press = 1;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	monome_poll_group_add(g, &fake_monomes[1]);
+	monome_poll_group_remove(g, &fake_monomes[1]);
+
+	memset(presses, 0, sizeof(presses));
+	assert(write(fake_write_fds[1], &press, 1) == 1);
+	assert(monome_poll_group_wait(g, 0) == 0);
+	assert(presses[1] == 0);
+
+	/* drain it so later tests start clean */
+	monome_poll_group_add(g, &fake_monomes[1]);
+	assert(monome_poll_group_wait(g, 1000) == 1);
+
+	monome_poll_group_free(g);
+}
+
+static void test_process_round_robin(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t press[10] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+	int i;
+
+	for( i = 0; i < 3; i++ )
+		monome_poll_group_add(g, &fake_monomes[i]);
+
+	reset_presses();
+	assert(write(fake_write_fds[0], press, 10) == 10);
+	assert(write(fake_write_fds[2], press, 2) == 2);
+
+	/* the chatty device doesn't get to go twice in a row while the other
+	   one still has input */
+	assert(monome_poll_group_process(g, 4, 0) == 1);
+	assert(norder == 4);
+	assert(order[0] != order[1] && order[2] != order[3]);
+	assert(presses[2] == 2);
+
+	/* no limit drains the rest */
+	assert(monome_poll_group_process(g, 0, 0) == 0);
+	assert(presses[0] == 10);
+
+	monome_poll_group_free(g);
+}
+
+static void test_process_resumes_after_cursor(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t press[2] = {1, 1};
+	int i;
+
+	for( i = 0; i < 2; i++ )
+		monome_poll_group_add(g, &fake_monomes[i]);
+
+	reset_presses();
+	assert(write(fake_write_fds[0], press, 2) == 2);
+	assert(write(fake_write_fds[1], press, 2) == 2);
+
+	/* one event per call still alternates between devices */
+	for( i = 0; i < 4; i++ )
+		monome_poll_group_process(g, 1, 0);
+
+	assert(norder == 4);
+	assert(order[0] != order[1] && order[1] != order[2]
+	       && order[2] != order[3]);
+
+	monome_poll_group_free(g);
+}
+
+static void slow_press(const monome_event_t *e, void *data) {
+	count_press(e, data);
+	usleep(2000);
+}
+
+static void test_process_time_budget(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t press[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	monome_register_handler(&fake_monomes[0], MONOME_BUTTON_DOWN,
+	                        slow_press, &fake_monomes[0]);
+
+	reset_presses();
+	assert(write(fake_write_fds[0], press, 8) == 8);
+
+	assert(monome_poll_group_process(g, 0, 1000) == 1);
+	assert(norder == 1);
+
+	assert(monome_poll_group_process(g, 0, 0) == 0);
+	assert(presses[0] == 8);
+
+	monome_register_handler(&fake_monomes[0], MONOME_BUTTON_DOWN,
+	                        count_press, &fake_monomes[0]);
+	monome_poll_group_free(g);
+}
+
+static void test_process_idle(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+
+	assert(monome_poll_group_process(g, 0, 0) == -1);
+	assert(monome_poll_group_process(NULL, 0, 0) == -1);
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	assert(monome_poll_group_process(g, 0, 0) == 0);
+
+	monome_poll_group_free(g);
+}
+#endif
+
 int main(void) {
 	printf("test_poll_group:\n");
 
+#if !defined(_WIN32)
+	setup_fake_monomes();
+#endif
+
 	RUN_TEST(test_new_free);
 	RUN_TEST(test_free_null);
 	RUN_TEST(test_add_one);
@@ -175,6 +402,16 @@ int main(void) {
 	RUN_TEST(test_remove_not_found);
 	RUN_TEST(test_remove_null_args);
 	RUN_TEST(test_add_remove_add);
+#if !defined(_WIN32)
+	RUN_TEST(test_wait_timeout);
+	RUN_TEST(test_wait_empty_group);
+	RUN_TEST(test_wait_dispatches_ready_only);
+	RUN_TEST(test_wait_ignores_removed);
+	RUN_TEST(test_process_round_robin);
+	RUN_TEST(test_process_resumes_after_cursor);
+	RUN_TEST(test_process_time_budget);
+	RUN_TEST(test_process_idle);
+#endif
 
 	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
 	return (tests_passed == tests_run) ? 0 : 1;
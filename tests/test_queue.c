@@ -0,0 +1,305 @@
+/**
+ * Tests for the threaded input queue (queue.c).
+ * Fake devices read button presses from pipes; the queue's reader thread
+ * decodes them and the test pops them on the main thread.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <monome.h>
+#include "internal.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+#define FAKE_ERROR 0xFF
+#define FAKE_STAMP(x) (1000 + (x))
+
+static monome_t fake_monomes[2];
+static int fake_write_fds[2];
+
+/* each byte is a press at x = byte, except FAKE_ERROR which is a read
+   error, as if the device had been unplugged */
+static int fake_next_events(monome_t *m, monome_event_t *events,
+                            uint64_t *stamps, size_t max) {
+	uint8_t buf[64];
+	ssize_t nbyte;
+	int i;
+
+	if( max > sizeof(buf) )
+		max = sizeof(buf);
+
+	if( (nbyte = read(m->fd, buf, max)) <= 0 )
+		return 0;
+
+	for( i = 0; i < nbyte; i++ ) {
+		if( buf[i] == FAKE_ERROR )
+			return -1;
+
+		events[i].event_type = MONOME_BUTTON_DOWN;
+		events[i].grid.x = buf[i];
+		events[i].grid.y = 0;
+
+		/* so that tests can tell the stamps went with their events */
+		if( stamps )
+			stamps[i] = FAKE_STAMP(buf[i]);
+	}
+
+	return nbyte;
+}
+
+static void setup_fake_monomes(void) {
+	int i, fds[2];
+
+	for( i = 0; i < 2; i++ ) {
+		assert(pipe(fds) == 0);
+		fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+		fake_monomes[i].fd = fds[0];
+		fake_monomes[i].next_events = fake_next_events;
+		fake_write_fds[i] = fds[1];
+	}
+}
+
+static void press(int dev, const uint8_t *xs, size_t n) {
+	assert(write(fake_write_fds[dev], xs, n) == (ssize_t) n);
+}
+
+/* pop `n` events, waiting for the reader as needed */
+static void pop_n(monome_event_queue_t *q, monome_event_t *events, size_t n) {
+	size_t got = 0;
+
+	while( got < n ) {
+		assert(monome_event_queue_wait(q, 1000) == 1);
+		got += monome_event_queue_pop_batch(q, &events[got], n - got);
+	}
+}
+
+/* --- tests --- */
+
+static void test_new_rejects_empty_group(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+
+	assert(monome_event_queue_new(NULL, 0) == NULL);
+	assert(monome_event_queue_new(g, 0) == NULL);
+
+	monome_poll_group_free(g);
+}
+
+static void test_empty_pop(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	monome_event_queue_t *q;
+	monome_event_t e;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 16);
+	assert(q);
+
+	assert(monome_event_queue_pop(q, &e) == 0);
+	assert(monome_event_queue_pop_batch(q, &e, 1) == 0);
+	assert(monome_event_queue_wait(q, 0) == 0);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_events_arrive_in_order(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t xs[5] = {1, 2, 3, 4, 5};
+	monome_event_queue_t *q;
+	monome_event_t events[5];
+	int i;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 16);
+
+	press(0, xs, 5);
+	pop_n(q, events, 5);
+
+	for( i = 0; i < 5; i++ ) {
+		assert(events[i].event_type == MONOME_BUTTON_DOWN);
+		assert(events[i].grid.x == xs[i]);
+		assert(events[i].monome == &fake_monomes[0]);
+	}
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_timestamps_travel_with_events(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t xs[3] = {7, 8, 9};
+	monome_event_queue_t *q;
+	monome_event_t events[3];
+	uint64_t stamps[3];
+	size_t got = 0;
+	int i;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 16);
+
+	press(0, xs, 3);
+
+	while( got < 3 ) {
+		assert(monome_event_queue_wait(q, 1000) == 1);
+		got += monome_event_queue_pop_batch_ts(q, &events[got], &stamps[got],
+		                                       3 - got);
+	}
+
+	for( i = 0; i < 3; i++ ) {
+		assert(events[i].grid.x == xs[i]);
+		assert(stamps[i] == FAKE_STAMP(xs[i]));
+	}
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_multiple_devices(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t a[3] = {1, 2, 3}, b[2] = {7, 8};
+	monome_event_queue_t *q;
+	monome_event_t events[5];
+	int i, from_a = 0, from_b = 0;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	monome_poll_group_add(g, &fake_monomes[1]);
+	q = monome_event_queue_new(g, 16);
+
+	press(0, a, 3);
+	press(1, b, 2);
+	pop_n(q, events, 5);
+
+	for( i = 0; i < 5; i++ ) {
+		if( events[i].monome == &fake_monomes[0] )
+			from_a += events[i].grid.x;
+		else
+			from_b += events[i].grid.x;
+	}
+
+	assert(from_a == 6);
+	assert(from_b == 15);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_wraps_around(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	monome_event_queue_t *q;
+	monome_event_t e;
+	uint8_t x;
+	int i;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 4);
+
+	/* many more events than slots, one at a time */
+	for( i = 0; i < 50; i++ ) {
+		x = i;
+		press(0, &x, 1);
+		pop_n(q, &e, 1);
+		assert(e.grid.x == (unsigned int) i);
+	}
+
+	assert(monome_event_queue_get_dropped(q) == 0);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_full_queue_drops(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t xs[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	monome_event_queue_t *q;
+	monome_event_t events[4];
+	int i;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+
+	/* 3 rounds up to 4 */
+	q = monome_event_queue_new(g, 3);
+
+	press(0, xs, 10);
+	pop_n(q, events, 4);
+
+	/* the oldest events are kept */
+	for( i = 0; i < 4; i++ )
+		assert(events[i].grid.x == (unsigned int) i);
+
+	assert(monome_event_queue_get_dropped(q) == 6);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_fd_signals(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	monome_event_queue_t *q;
+	monome_event_t e;
+	uint8_t x = 3;
+	int fd;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 16);
+	fd = monome_event_queue_get_fd(q);
+	assert(fd >= 0);
+
+	press(0, &x, 1);
+	assert(monome_event_queue_wait(q, 1000) == 1);
+	assert(monome_event_queue_pop(q, &e) == 1);
+
+	/* wait() resets the fd, and an empty queue doesn't wake */
+	assert(monome_event_queue_wait(q, 0) == 0);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+static void test_reader_error(void) {
+	monome_poll_group_t *g = monome_poll_group_new();
+	uint8_t x = FAKE_ERROR;
+	monome_event_queue_t *q;
+	monome_event_t e;
+
+	monome_poll_group_add(g, &fake_monomes[0]);
+	q = monome_event_queue_new(g, 16);
+
+	press(0, &x, 1);
+	assert(monome_event_queue_wait(q, 1000) == -1);
+	assert(monome_event_queue_pop(q, &e) == -1);
+
+	monome_event_queue_free(q);
+	monome_poll_group_free(g);
+}
+
+int main(void) {
+	printf("test_queue:\n");
+
+	setup_fake_monomes();
+
+	RUN_TEST(test_new_rejects_empty_group);
+	RUN_TEST(test_empty_pop);
+	RUN_TEST(test_events_arrive_in_order);
+	RUN_TEST(test_timestamps_travel_with_events);
+	RUN_TEST(test_multiple_devices);
+	RUN_TEST(test_wraps_around);
+	RUN_TEST(test_full_queue_drops);
+	RUN_TEST(test_fd_signals);
+	RUN_TEST(test_reader_error);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,410 @@
+/**
+ * Tests for paced led output (schedule.c). A mext device writes into a
+ * socketpair at a low output rate, so that after the first burst led
+ * calls have to wait, and the test checks what gets coalesced while
+ * they do.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+#include "schedule.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext grid led commands: header byte, then payload */
+#define LEVEL_SET_HEADER 0x18
+#define LEVEL_ALL_HEADER 0x19
+#define LEVEL_MAP_HEADER 0x1A
+
+#define LEVEL_SET_LEN 4
+#define LEVEL_ALL_LEN 2
+#define LEVEL_MAP_LEN 35
+
+/* slow enough that nothing past the first burst goes out during a test */
+#define RATE 1000
+
+static int fds[2];
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	monome_set_output_rate(m, 0);
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+static size_t sent(uint8_t *buf, size_t nbyte) {
+	ssize_t ret;
+	size_t len = 0;
+
+	while( len < nbyte && (ret = read(fds[1], &buf[len], nbyte - len)) > 0 )
+		len += ret;
+
+	return len;
+}
+
+static monome_tx_stats_t stats(monome_t *m) {
+	monome_tx_stats_t s;
+
+	assert(monome_get_tx_stats(m, &s) == MONOME_OK);
+	return s;
+}
+
+/* use up the first burst, so that everything after this has to wait.
+   the message that didn't fit, a level_set at (15, 15), is left waiting
+   at the front of the schedule. */
+static void exhaust_burst(monome_t *m) {
+	uint8_t buf[4096];
+	unsigned int i;
+
+	for( i = 0; !stats(m).scheduled; i++ )
+		assert(monome_led_level_set(m, 15, 15, i & 15) >= 0);
+
+	sent(buf, sizeof(buf));
+	m->tx_stats.coalesced = 0;
+
+	assert(stats(m).scheduled == LEVEL_SET_LEN);
+}
+
+static uint8_t stream[8192];
+
+/* --- tests --- */
+
+static void test_off_by_default(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[64];
+	int i;
+
+	for( i = 0; i < 8; i++ )
+		assert(monome_led_level_set(m, i, 0, 15) >= 0);
+
+	assert(sent(buf, sizeof(buf)) == 8 * LEVEL_SET_LEN);
+	assert(stats(m).scheduled == 0);
+	assert(m->sched == NULL);
+
+	free_mext(m);
+}
+
+static void test_link_rate(void) {
+	monome_t *m = make_mext();
+
+	assert(monome_set_output_rate(m, MONOME_OUTPUT_RATE_LINK)
+	       == MONOME_ERROR_UNSUPPORTED);
+	assert(monome_set_output_rate(m, -5) == MONOME_ERROR_INVALID_ARG);
+
+	m->link_rate = MONOME_LINK_RATE(QUIRK_57600_BAUD);
+	assert(m->link_rate == 5760);
+	assert(monome_set_output_rate(m, MONOME_OUTPUT_RATE_LINK) == MONOME_OK);
+	assert(m->sched);
+
+	assert(monome_set_output_rate(m, 0) == MONOME_OK);
+	assert(m->sched == NULL);
+
+	free_mext(m);
+}
+
+static void test_burst_then_paced(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t s;
+	size_t len;
+	int i;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+
+	for( i = 0; i < 100; i++ )
+		assert(monome_led_level_set(m, i & 15, i >> 4, 15) >= 0);
+
+	/* the first burst goes straight out, the rest waits its turn */
+	len = sent(stream, sizeof(stream));
+	s = stats(m);
+
+	assert(len > 0 && len < 100 * LEVEL_SET_LEN);
+	assert(len % LEVEL_SET_LEN == 0);
+	assert(len + s.scheduled == 100 * LEVEL_SET_LEN);
+	assert(s.coalesced == 0);
+
+	assert(monome_sched_next_ms(m) > 0);
+
+	/* turning pacing off sends everything still waiting, in order */
+	assert(monome_set_output_rate(m, 0) == MONOME_OK);
+	len += sent(&stream[len], sizeof(stream) - len);
+	assert(len == 100 * LEVEL_SET_LEN);
+
+	for( i = 0; i < 100; i++ ) {
+		assert(stream[i * LEVEL_SET_LEN] == LEVEL_SET_HEADER);
+		assert(stream[i * LEVEL_SET_LEN + 1] == (i & 15));
+		assert(stream[i * LEVEL_SET_LEN + 2] == (i >> 4));
+	}
+
+	free_mext(m);
+}
+
+static void test_same_led_coalesces(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t s;
+	size_t len;
+	int i;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_set(m, 0, 0, 1);
+	for( i = 0; i < 10; i++ )
+		monome_led_level_set(m, 5, 5, i);
+
+	s = stats(m);
+	assert(s.coalesced == 9);
+	assert(s.scheduled == 3 * LEVEL_SET_LEN);
+
+	monome_set_output_rate(m, 0);
+	len = sent(stream, sizeof(stream));
+	assert(len == 3 * LEVEL_SET_LEN);
+	assert(stream[5] == 0 && stream[7] == 1);
+	assert(stream[9] == 5 && stream[11] == 9);
+
+	free_mext(m);
+}
+
+static void test_all_supersedes_grid(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+	monome_tx_stats_t s;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_set(m, 1, 1, 15);
+	monome_led_level_map(m, 8, 8, levels);
+	monome_led_level_row(m, 0, 3, 16, levels);
+	monome_led_ring_set(m, 0, 0, 15);
+	monome_led_level_all(m, 4);
+
+	/* the map also covers (15, 15), and the row went out as two messages.
+	   the ring is a different kind of led and stays. */
+	s = stats(m);
+	assert(s.coalesced == 5);
+	assert(s.scheduled == 4 + LEVEL_ALL_LEN);
+
+	monome_set_output_rate(m, 0);
+	assert(sent(stream, sizeof(stream)) == 4 + LEVEL_ALL_LEN);
+	assert(stream[4] == LEVEL_ALL_HEADER && stream[5] == 4);
+
+	free_mext(m);
+}
+
+static void test_map_supersedes_its_quad(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+	monome_tx_stats_t s;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_set(m, 0, 0, 15);
+	monome_led_level_set(m, 7, 7, 15);
+	monome_led_level_set(m, 8, 0, 15);
+	monome_led_level_map(m, 0, 0, levels);
+
+	s = stats(m);
+	assert(s.coalesced == 2);
+	assert(s.scheduled == 2 * LEVEL_SET_LEN + LEVEL_MAP_LEN);
+
+	/* a single led inside the map doesn't cover it */
+	monome_led_level_set(m, 3, 3, 15);
+	assert(stats(m).coalesced == 2);
+
+	monome_set_output_rate(m, 0);
+	assert(sent(stream, sizeof(stream))
+	       == 3 * LEVEL_SET_LEN + LEVEL_MAP_LEN);
+	assert(stream[4] == LEVEL_SET_HEADER && stream[5] == 8);
+	assert(stream[8] == LEVEL_MAP_HEADER);
+
+	free_mext(m);
+}
+
+static void test_row_needs_full_cover(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	/* rows may span the whole device, so only a whole row covers one */
+	monome_led_level_row(m, 0, 2, 8, levels);
+	monome_led_level_map(m, 0, 0, levels);
+	assert(stats(m).coalesced == 0);
+
+	monome_led_level_row(m, 0, 2, 16, levels);
+	assert(stats(m).coalesced == 1);
+
+	free_mext(m);
+}
+
+static void test_frame_backlog_is_bounded(void) {
+	monome_t *m = make_mext();
+	monome_frame_t *frame = monome_frame_new(m);
+	unsigned int i, x, y;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	/* a renderer running far ahead of the link never builds up more than
+	   a single full redraw */
+	for( i = 0; i < 200; i++ ) {
+		for( y = 0; y < 16; y++ )
+			for( x = 0; x < 16; x++ )
+				monome_frame_set(frame, x, y, (x * 7 + y * 3 + i) & 15);
+
+		assert(monome_frame_commit(frame) >= 0);
+		assert(stats(m).scheduled <= 4 * LEVEL_MAP_LEN + LEVEL_ALL_LEN);
+	}
+
+	assert(stats(m).coalesced > 0);
+
+	monome_frame_free(frame);
+	free_mext(m);
+}
+
+static void test_flush_releases_when_due(void) {
+	monome_t *m = make_mext();
+	size_t waiting;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_set(m, 0, 0, 15);
+	monome_led_level_set(m, 1, 0, 15);
+	waiting = stats(m).scheduled;
+
+	assert(monome_flush(m) == MONOME_OK);
+	assert(stats(m).scheduled == waiting);
+
+	/* 8 bytes at 1000 bytes/sec are due within a few milliseconds */
+	usleep((monome_sched_next_ms(m) + 10) * 1000);
+	assert(monome_flush(m) == MONOME_OK);
+	assert(stats(m).scheduled < waiting);
+
+	free_mext(m);
+}
+
+static void test_urgent_jumps_paced_output(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+	size_t waiting;
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_map(m, 0, 8, levels);
+	waiting = stats(m).scheduled;
+
+	/* nothing waiting touches (3, 2), so it goes straight out */
+	assert(monome_led_level_set_urgent(m, 3, 2, 15) >= 0);
+	assert(sent(stream, sizeof(stream)) == LEVEL_SET_LEN);
+	assert(stream[0] == LEVEL_SET_HEADER);
+	assert(stream[1] == 3 && stream[2] == 2 && stream[3] == 15);
+	assert(stats(m).scheduled == waiting);
+
+	free_mext(m);
+}
+
+static void test_urgent_conflict_takes_bulk_lane(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+
+	assert(monome_set_output_rate(m, RATE) == MONOME_OK);
+	exhaust_burst(m);
+
+	monome_led_level_map(m, 0, 8, levels);
+
+	/* (3, 10) is inside the waiting map, so it has to go after it */
+	assert(monome_led_level_set_urgent(m, 3, 10, 15) >= 0);
+	assert(sent(stream, sizeof(stream)) == 0);
+	assert(stats(m).scheduled == 2 * LEVEL_SET_LEN + LEVEL_MAP_LEN);
+
+	monome_set_output_rate(m, 0);
+	assert(sent(stream, sizeof(stream)) == 2 * LEVEL_SET_LEN + LEVEL_MAP_LEN);
+	assert(stream[LEVEL_SET_LEN] == LEVEL_MAP_HEADER);
+	assert(stream[LEVEL_SET_LEN + LEVEL_MAP_LEN] == LEVEL_SET_HEADER);
+	assert(stream[LEVEL_SET_LEN + LEVEL_MAP_LEN + 2] == 10);
+
+	free_mext(m);
+}
+
+static void test_urgent_jumps_deferred_output(void) {
+	monome_t *m = make_mext();
+	uint8_t levels[64] = {0};
+
+	monome_set_deferred(m, 1);
+	monome_led_level_map(m, 8, 0, levels);
+
+	assert(monome_led_set_urgent(m, 0, 0, 1) >= 0);
+	assert(sent(stream, sizeof(stream)) == 3);
+
+	/* this one conflicts with the buffered map */
+	assert(monome_led_level_set_urgent(m, 9, 1, 15) >= 0);
+	assert(sent(stream, sizeof(stream)) == 0);
+
+	assert(monome_flush(m) == MONOME_OK);
+	assert(sent(stream, sizeof(stream)) == LEVEL_MAP_LEN + LEVEL_SET_LEN);
+	assert(stream[0] == LEVEL_MAP_HEADER);
+	assert(stream[LEVEL_MAP_LEN] == LEVEL_SET_HEADER);
+
+	/* once flushed, nothing is in the way any more */
+	assert(monome_led_level_set_urgent(m, 9, 1, 0) >= 0);
+	assert(sent(stream, sizeof(stream)) == LEVEL_SET_LEN);
+
+	free_mext(m);
+}
+
+int main(void) {
+	printf("test_sched:\n");
+
+	RUN_TEST(test_off_by_default);
+	RUN_TEST(test_link_rate);
+	RUN_TEST(test_burst_then_paced);
+	RUN_TEST(test_same_led_coalesces);
+	RUN_TEST(test_all_supersedes_grid);
+	RUN_TEST(test_map_supersedes_its_quad);
+	RUN_TEST(test_row_needs_full_cover);
+	RUN_TEST(test_frame_backlog_is_bounded);
+	RUN_TEST(test_flush_releases_when_due);
+	RUN_TEST(test_urgent_jumps_paced_output);
+	RUN_TEST(test_urgent_conflict_takes_bulk_lane);
+	RUN_TEST(test_urgent_jumps_deferred_output);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/**
+ * Tests for performance counters (stats.c). A mext device sits on one end
+ * of a socketpair, and the test plays the grid on the other.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext key down and up on SS_KEY_GRID: header, x, y */
+#define KEY_DOWN_HEADER 0x21
+#define KEY_UP_HEADER 0x20
+
+/* mext CMD_LED_LEVEL_SET on SS_LED_GRID: header, x, y, level */
+#define LEVEL_SET_HEADER 0x18
+
+static int fds[2];
+static int presses;
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	monome_set_stats(m, 0);
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+static void press(const monome_event_t *e, void *data) {
+	(void) e;
+	(void) data;
+
+	presses++;
+}
+
+static void device_send(const uint8_t *buf, size_t nbyte) {
+	assert(write(fds[1], buf, nbyte) == nbyte);
+}
+
+static void drain_device(void) {
+	uint8_t buf[256];
+
+	while( recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT) > 0 )
+		;
+}
+
+static uint64_t histogram_total(const uint64_t *histogram) {
+	uint64_t total = 0;
+	int i;
+
+	for( i = 0; i < MONOME_STATS_BUCKETS; i++ )
+		total += histogram[i];
+
+	return total;
+}
+
+/* --- tests --- */
+
+static void test_off_by_default(void) {
+	monome_t *m = make_mext();
+	const uint8_t keys[] = {KEY_DOWN_HEADER, 1, 2};
+	monome_stats_t stats;
+
+	assert(!m->stats);
+	assert(monome_led_level_set(m, 0, 0, 15) >= 0);
+	device_send(keys, sizeof(keys));
+	assert(monome_event_handle_next(m) == 0);
+
+	memset(&stats, 0xff, sizeof(stats));
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+	assert(stats.bytes_out == 0 && stats.messages_in == 0);
+	assert(stats.events_dropped == 0);
+
+	/* resetting nothing is fine too */
+	monome_reset_stats(m);
+	free_mext(m);
+}
+
+static void test_counts_traffic(void) {
+	monome_t *m = make_mext();
+	const uint8_t keys[] = {
+		KEY_DOWN_HEADER, 1, 2,
+		KEY_UP_HEADER, 1, 2
+	};
+	monome_stats_t stats;
+
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+
+	assert(monome_led_level_set(m, 0, 0, 15) >= 0);
+	assert(monome_led_level_set(m, 1, 0, 15) >= 0);
+	drain_device();
+
+	device_send(keys, sizeof(keys));
+	monome_register_handler(m, MONOME_BUTTON_DOWN, press, NULL);
+	monome_register_handler(m, MONOME_BUTTON_UP, press, NULL);
+	presses = 0;
+	assert(monome_event_handle_next_batch(m, 8) == 2);
+	assert(presses == 2);
+
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+
+	assert(stats.messages_out == 2);
+	assert(stats.messages_out_by_header[LEVEL_SET_HEADER] == 2);
+	assert(stats.bytes_out == 8);
+	assert(stats.writes == 2);
+	assert(stats.short_writes == 0 && stats.write_again == 0);
+
+	assert(stats.bytes_in == sizeof(keys));
+	assert(stats.reads >= 1);
+	assert(stats.messages_in == 2);
+	assert(stats.messages_in_by_header[KEY_DOWN_HEADER] == 1);
+	assert(stats.messages_in_by_header[KEY_UP_HEADER] == 1);
+
+	assert(stats.events_dispatched == 2);
+	assert(stats.events_dropped == 0);
+	assert(histogram_total(stats.read_to_callback) == 2);
+	assert(histogram_total(stats.callback_duration) == 2);
+
+	free_mext(m);
+}
+
+static void test_unknown_header_is_a_resync(void) {
+	monome_t *m = make_mext();
+	const uint8_t noise[] = {0xf0, 0xf1, KEY_DOWN_HEADER, 3, 4};
+	monome_stats_t stats;
+
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+	device_send(noise, sizeof(noise));
+
+	monome_register_handler(m, MONOME_BUTTON_DOWN, press, NULL);
+	presses = 0;
+	while( monome_event_handle_next(m) > 0 )
+		;
+	assert(presses == 1);
+
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+	assert(stats.resyncs == 2);
+	assert(stats.messages_in == 1);
+
+	free_mext(m);
+}
+
+static void test_dropped_events(void) {
+	monome_t *m = make_mext();
+	const uint8_t keys[] = {
+		KEY_DOWN_HEADER, 1, 2,
+		KEY_UP_HEADER, 1, 2
+	};
+	monome_stats_t stats;
+
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+
+	/* nobody is listening for key down */
+	device_send(keys, 3);
+	assert(monome_event_handle_next(m) == 0);
+
+	/* and now nobody wants key events at all */
+	monome_set_event_mask(m, MONOME_EVENT_MASK(MONOME_TILT));
+	device_send(keys, sizeof(keys));
+	assert(monome_event_handle_next_batch(m, 8) == 0);
+
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+	assert(stats.events_dispatched == 0);
+	assert(stats.events_dropped == 3);
+	assert(histogram_total(stats.callback_duration) == 0);
+
+	free_mext(m);
+}
+
+static void test_reset(void) {
+	monome_t *m = make_mext();
+	monome_stats_t stats;
+
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+	assert(monome_led_level_set(m, 0, 0, 15) >= 0);
+
+	monome_reset_stats(m);
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+	assert(stats.messages_out == 0 && stats.bytes_out == 0);
+	assert(stats.messages_out_by_header[LEVEL_SET_HEADER] == 0);
+
+	/* off and on again starts from zero as well */
+	assert(monome_led_level_set(m, 0, 0, 15) >= 0);
+	assert(monome_set_stats(m, 0) == MONOME_OK);
+	assert(monome_set_stats(m, 1) == MONOME_OK);
+	assert(monome_get_stats(m, &stats) == MONOME_OK);
+	assert(stats.messages_out == 0);
+
+	free_mext(m);
+}
+
+static void test_histogram_buckets(void) {
+	uint64_t histogram[MONOME_STATS_BUCKETS] = {0};
+	unsigned int i;
+
+	/* exact below 8 ns, then four buckets to each power of two */
+	for( i = 0; i < 8; i++ )
+		assert(monome_stats_bucket_ns(i) == i);
+
+	assert(monome_stats_bucket_ns(8) == 8);
+	assert(monome_stats_bucket_ns(9) == 10);
+	assert(monome_stats_bucket_ns(12) == 16);
+	assert(monome_stats_bucket_ns(13) == 20);
+
+	for( i = 9; i < MONOME_STATS_BUCKETS; i++ )
+		assert(monome_stats_bucket_ns(i) > monome_stats_bucket_ns(i - 1));
+
+	assert(monome_stats_bucket_ns(MONOME_STATS_BUCKETS + 10)
+	       == monome_stats_bucket_ns(MONOME_STATS_BUCKETS - 1));
+
+	/* nothing recorded */
+	assert(monome_stats_percentile(histogram, 50) == 0);
+
+	/* 90 fast samples and 10 slow ones */
+	histogram[12] = 90;
+	histogram[40] = 10;
+
+	assert(monome_stats_percentile(histogram, 0) == 16);
+	assert(monome_stats_percentile(histogram, 50) == 16);
+	assert(monome_stats_percentile(histogram, 89) == 16);
+	assert(monome_stats_percentile(histogram, 95) == monome_stats_bucket_ns(40));
+	assert(monome_stats_percentile(histogram, 100) == monome_stats_bucket_ns(40));
+}
+
+int main(void) {
+	printf("test_stats:\n");
+
+	RUN_TEST(test_off_by_default);
+	RUN_TEST(test_counts_traffic);
+	RUN_TEST(test_unknown_header_is_a_resync);
+	RUN_TEST(test_dropped_events);
+	RUN_TEST(test_reset);
+	RUN_TEST(test_histogram_buckets);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+/**
+ * Tests for recording and replaying wire traces (trace.c, replay.c). A
+ * device on a socketpair is recorded while the test plays the grid on the
+ * other end, and the trace it leaves is read back, both record by record
+ * and by replaying it through the protocol's decoder.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "protocol.h"
+#include "trace.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext key down and up on SS_KEY_GRID: header, x, y */
+#define KEY_DOWN_HEADER 0x21
+#define KEY_UP_HEADER 0x20
+
+static int fds[2];
+static char trace_path[] = "/tmp/test_trace_XXXXXX";
+
+static monome_t *make_device(monome_t *m, const char *proto,
+                             const char *serial, int rows, int cols) {
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->proto = proto;
+	m->serial = serial;
+	m->friendly = "test grid";
+	m->rows = rows;
+	m->cols = cols;
+	m->link_rate = 11520;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_device(monome_t *m) {
+	monome_record_stop(m);
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+/* the device sends `buf`, and the library reads it */
+static void device_send(monome_t *m, const uint8_t *buf, size_t nbyte) {
+	monome_event_t events[8];
+
+	assert(write(fds[1], buf, nbyte) == nbyte);
+	while( monome_event_next_batch(m, events, 8) > 0 )
+		;
+}
+
+/* record a mext grid pressing a key at (x, y) for each of `count`, with
+   `gap_ms` between them */
+static void record_presses(int count, int gap_ms) {
+	monome_t *m = make_device(monome_protocol_mext_new(), "mext", "m1234567",
+	                          8, 16);
+	uint8_t press[] = {KEY_DOWN_HEADER, 0, 0, KEY_UP_HEADER, 0, 0};
+	int i;
+
+	assert(monome_record_start(m, trace_path) == MONOME_OK);
+
+	for( i = 0; i < count; i++ ) {
+		if( i && gap_ms )
+			m_sleep(gap_ms);
+
+		press[1] = press[4] = i & 15;
+		press[2] = press[5] = i >> 4;
+		device_send(m, press, sizeof(press));
+	}
+
+	free_device(m);
+}
+
+static uint8_t *read_trace(size_t *len) {
+	static uint8_t buf[1 << 16];
+	FILE *f = fopen(trace_path, "rb");
+
+	assert(f);
+	*len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	return buf;
+}
+
+static int presses;
+
+static void count_press(const monome_event_t *e, void *data) {
+	assert(e->grid.x == (presses & 15));
+	assert(e->grid.y == (presses >> 4));
+	presses++;
+}
+
+/* handle everything a replay has, returning how many key downs there were */
+static int replay_all(monome_t *m) {
+	int ret;
+
+	presses = 0;
+	monome_register_handler(m, MONOME_BUTTON_DOWN, count_press, NULL);
+
+	while( (ret = monome_event_handle_next_batch(m, 64)) >= 0 )
+		;
+
+	return presses;
+}
+
+/* --- tests --- */
+
+static void test_records_both_directions(void) {
+	monome_t *m = make_device(monome_protocol_mext_new(), "mext", "m1234567",
+	                          8, 16);
+	const uint8_t in[] = {KEY_DOWN_HEADER, 3, 4};
+	const uint8_t out[] = {0x18, 3, 4, 15};
+	monome_trace_header_t header;
+	monome_trace_cursor_t cursor;
+	monome_trace_record_t record;
+	uint8_t *buf;
+	size_t len;
+
+	assert(monome_record_start(m, trace_path) == MONOME_OK);
+	device_send(m, in, sizeof(in));
+	m_sleep(2);
+	assert(monome_led_level_set(m, 3, 4, 15) >= 0);
+	free_device(m);
+
+	buf = read_trace(&len);
+	assert(monome_trace_open(buf, len, &header, &cursor) == 0);
+
+	assert(!strcmp(header.proto, "mext"));
+	assert(!strcmp(header.serial, "m1234567"));
+	assert(!strcmp(header.friendly, "test grid"));
+	assert(header.rows == 8 && header.cols == 16);
+	assert(header.link_rate == 11520);
+
+	assert(monome_trace_next(&cursor, &record) == 1);
+	assert(record.direction == MONOME_WIRE_IN);
+	assert(record.nbyte == sizeof(in) && !memcmp(record.data, in, sizeof(in)));
+
+	assert(monome_trace_next(&cursor, &record) == 1);
+	assert(record.direction == MONOME_WIRE_OUT);
+	assert(record.nbyte == sizeof(out)
+	       && !memcmp(record.data, out, sizeof(out)));
+	assert(record.ns >= 2000000);
+
+	assert(monome_trace_next(&cursor, &record) == 0);
+
+	/* a record cut short is an error, not the end */
+	assert(monome_trace_open(buf, len - 1, &header, &cursor) == 0);
+	assert(monome_trace_next(&cursor, &record) == 1);
+	assert(monome_trace_next(&cursor, &record) == -1);
+
+	/* and so is anything that isn't a trace */
+	buf[0] = 'X';
+	assert(monome_trace_open(buf, len, &header, &cursor) == -1);
+}
+
+static void test_replay_fast(void) {
+	monome_t *m;
+
+	record_presses(40, 0);
+
+	assert((m = monome_open_replay(trace_path, MONOME_REPLAY_FAST)));
+	assert(!strcmp(monome_get_serial(m), "m1234567"));
+	assert(!strcmp(monome_get_friendly_name(m), "test grid"));
+	assert(monome_get_rows(m) == 8 && monome_get_cols(m) == 16);
+	assert(monome_get_fd(m) < 0);
+
+	/* led output goes nowhere, without complaint */
+	assert(monome_led_level_set(m, 1, 1, 15) >= 0);
+	assert(monome_flush(m) == MONOME_OK);
+
+	assert(replay_all(m) == 40);
+	monome_close(m);
+}
+
+static void test_replay_keeps_time(void) {
+	char dev[64];
+	uint64_t start, took;
+	monome_t *m;
+
+	record_presses(3, 50);
+
+	/* as fast as possible */
+	assert((m = monome_open_replay(trace_path, MONOME_REPLAY_FAST)));
+	start = m_now_ns();
+	assert(replay_all(m) == 3);
+	took = (m_now_ns() - start) / 1000000;
+	assert(took < 50);
+	monome_close(m);
+
+	/* as recorded, through monome_open() */
+	snprintf(dev, sizeof(dev), "replay://%s", trace_path);
+	assert((m = monome_open(dev)));
+	assert(!strcmp(monome_get_devpath(m), dev));
+
+	start = m_now_ns();
+	assert(replay_all(m) == 3);
+	took = (m_now_ns() - start) / 1000000;
+	assert(took >= 98 && took < 1000);
+	monome_close(m);
+}
+
+static void test_replay_series(void) {
+	monome_t *m = make_device(monome_protocol_series_new(), "series",
+	                          "m256-0001", 16, 16);
+	const uint8_t in[] = {0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x10, 0x10};
+	monome_event_t events[8];
+
+	assert(monome_record_start(m, trace_path) == MONOME_OK);
+	device_send(m, in, sizeof(in));
+	free_device(m);
+
+	assert((m = monome_open_replay(trace_path, MONOME_REPLAY_FAST)));
+	assert(!strcmp(monome_get_friendly_name(m), "monome 256"));
+
+	assert(monome_event_next_batch(m, events, 8) == 4);
+	assert(events[0].event_type == MONOME_BUTTON_DOWN);
+	assert(events[2].event_type == MONOME_BUTTON_DOWN);
+	assert(events[2].grid.x == 1 && events[2].grid.y == 0);
+	assert(monome_event_next_batch(m, events, 8) == -1);
+
+	monome_close(m);
+}
+
+static void test_bad_traces(void) {
+	monome_t *m = make_device(monome_protocol_mext_new(), "osc", "m1", 8, 8);
+	FILE *f;
+
+	/* nothing to record for a device with no wire */
+	assert(monome_record_start(m, trace_path) == MONOME_ERROR_UNSUPPORTED);
+	assert(monome_record_start(NULL, trace_path) == MONOME_ERROR_INVALID_ARG);
+	free_device(m);
+
+	assert(!monome_open_replay("/nonexistent/trace", 0));
+	assert(!monome_open_replay(trace_path, 1U << 5));
+
+	assert((f = fopen(trace_path, "wb")));
+	fputs("not a trace", f);
+	fclose(f);
+	assert(!monome_open_replay(trace_path, 0));
+
+	/* a device the table doesn't know */
+	m = make_device(monome_protocol_mext_new(), "mext", "xyz", 8, 8);
+	assert(monome_record_start(m, trace_path) == MONOME_OK);
+	free_device(m);
+	assert(!monome_open_replay(trace_path, 0));
+}
+
+int main(void) {
+	int fd;
+
+	assert((fd = mkstemp(trace_path)) >= 0);
+	close(fd);
+
+	printf("test_trace:\n");
+
+	RUN_TEST(test_records_both_directions);
+	RUN_TEST(test_replay_fast);
+	RUN_TEST(test_replay_keeps_time);
+	RUN_TEST(test_replay_series);
+	RUN_TEST(test_bad_traces);
+
+	unlink(trace_path);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
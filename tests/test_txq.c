@@ -0,0 +1,240 @@
+/**
+ * Tests for pending output (io.c). A mext device writes into a stream
+ * socketpair with a small send buffer, so writes come up short as soon as
+ * the test stops reading. Whatever didn't go out has to arrive later, in
+ * order and in whole messages.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext CMD_LED_LEVEL_SET on SS_LED_GRID: header, x, y, level */
+#define LEVEL_SET_HEADER 0x18
+#define MSG_LEN 4
+
+static int fds[2];
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+	int sndbuf = 1;
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	close(fds[0]);
+	if( fds[1] >= 0 )
+		close(fds[1]);
+	m->free(m);
+}
+
+/* message `seq`, with the sequence number spread over x, y and level */
+static int send_seq(monome_t *m, unsigned int seq) {
+	return monome_led_level_set(m, seq & 15, (seq >> 4) & 15,
+	                            (seq >> 8) & 15);
+}
+
+static unsigned int msg_seq(const uint8_t *msg) {
+	return msg[1] | (msg[2] << 4) | (msg[3] << 8);
+}
+
+static size_t pending(monome_t *m) {
+	monome_tx_stats_t stats;
+
+	assert(monome_get_tx_stats(m, &stats) == MONOME_OK);
+	return stats.pending;
+}
+
+/* send messages until one of them has to wait */
+static unsigned int fill(monome_t *m) {
+	unsigned int seq;
+
+	for( seq = 0; !pending(m); seq++ ) {
+		assert(seq < 100000);
+		assert(send_seq(m, seq) >= 0);
+	}
+
+	return seq;
+}
+
+/* read whatever the device has been sent so far */
+static size_t receive(uint8_t *buf, size_t nbyte) {
+	ssize_t ret;
+	size_t len = 0;
+
+	while( len < nbyte && (ret = read(fds[1], &buf[len], nbyte - len)) > 0 )
+		len += ret;
+
+	return len;
+}
+
+static void check_stream(const uint8_t *buf, size_t len, unsigned int count) {
+	unsigned int i;
+
+	assert(len == count * MSG_LEN);
+
+	for( i = 0; i < count; i++ ) {
+		assert(buf[i * MSG_LEN] == LEVEL_SET_HEADER);
+		assert(msg_seq(&buf[i * MSG_LEN]) == i);
+	}
+}
+
+static uint8_t stream[1 << 18];
+
+/* --- tests --- */
+
+static void test_short_write_is_kept(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t stats;
+	unsigned int seq, count;
+	size_t len = 0;
+
+	seq = fill(m);
+
+	/* these have to queue up behind what's pending */
+	for( count = seq + 100; seq < count; seq++ )
+		assert(send_seq(m, seq) >= 0);
+
+	monome_get_tx_stats(m, &stats);
+	assert(stats.queued > 0);
+	assert(stats.dropped == 0);
+	assert(stats.errors == 0);
+
+	while( pending(m) ) {
+		len += receive(&stream[len], sizeof(stream) - len);
+		assert(monome_flush(m) == MONOME_OK);
+	}
+
+	len += receive(&stream[len], sizeof(stream) - len);
+	check_stream(stream, len, count);
+
+	free_mext(m);
+}
+
+static void test_full_queue_drops_whole_writes(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t stats;
+	unsigned int seq, failed = 0;
+	size_t len = 0, i;
+
+	for( seq = 0; seq < 4000; seq++ )
+		if( send_seq(m, seq) < 0 )
+			failed++;
+
+	monome_get_tx_stats(m, &stats);
+	assert(failed > 0);
+	assert(stats.dropped == failed);
+	assert(stats.pending <= MONOME_TXQ_SIZE);
+
+	while( pending(m) ) {
+		len += receive(&stream[len], sizeof(stream) - len);
+		monome_flush(m);
+	}
+
+	len += receive(&stream[len], sizeof(stream) - len);
+
+	/* everything that wasn't dropped arrived whole and in order */
+	assert(len == (seq - failed) * MSG_LEN);
+
+	for( i = 0; i < len; i += MSG_LEN ) {
+		assert(stream[i] == LEVEL_SET_HEADER);
+		if( i )
+			assert(msg_seq(&stream[i]) > msg_seq(&stream[i - MSG_LEN]));
+	}
+
+	free_mext(m);
+}
+
+static void test_poll_group_drains(void) {
+	monome_t *m = make_mext();
+	monome_poll_group_t *group = monome_poll_group_new();
+	unsigned int count;
+	size_t len = 0;
+	int i;
+
+	assert(monome_poll_group_add(group, m) == MONOME_OK);
+
+	count = fill(m);
+	assert(m->txq.want_output);
+
+	/* nothing drains until the peer reads */
+	assert(monome_poll_group_process(group, 0, 0) == 0);
+	assert(pending(m));
+
+	for( i = 0; pending(m); i++ ) {
+		assert(i < 10000);
+		len += receive(&stream[len], sizeof(stream) - len);
+		assert(monome_poll_group_process(group, 0, 0) >= 0);
+	}
+
+	assert(!m->txq.want_output);
+
+	len += receive(&stream[len], sizeof(stream) - len);
+	check_stream(stream, len, count);
+
+	monome_poll_group_free(group);
+	free_mext(m);
+}
+
+static void test_write_errors_are_counted(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t stats;
+
+	close(fds[1]);
+	fds[1] = -1;
+
+	assert(monome_led_level_set(m, 0, 0, 15) < 0);
+	assert(monome_flush(m) == MONOME_OK);
+
+	monome_get_tx_stats(m, &stats);
+	assert(stats.errors == 1);
+	assert(stats.pending == 0);
+
+	free_mext(m);
+}
+
+int main(void) {
+	/* a write to the closed socketpair would kill us otherwise */
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("test_txq:\n");
+
+	RUN_TEST(test_short_write_is_kept);
+	RUN_TEST(test_full_queue_drops_whole_writes);
+	RUN_TEST(test_poll_group_drains);
+	RUN_TEST(test_write_errors_are_counted);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
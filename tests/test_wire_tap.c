@@ -0,0 +1,212 @@
+/**
+ * Tests for the wire tap (io.c). Devices sit on one end of a stream
+ * socketpair with a small send buffer, so writes come up short once the
+ * test stops reading, and the tap has to show each part exactly once.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext CMD_LED_LEVEL_SET on SS_LED_GRID: header, x, y, level */
+#define LEVEL_SET_HEADER 0x18
+
+static int fds[2];
+
+/* everything the tap saw, per direction, and how many calls it took */
+static struct {
+	uint8_t buf[1 << 18];
+	size_t len;
+	int calls;
+	uint64_t last_ns;
+} tapped[2];
+
+static void tap(monome_t *monome, monome_wire_direction_t direction,
+                uint64_t timestamp, const uint8_t *buf, size_t nbyte,
+                void *data) {
+	assert(data == &tapped);
+	assert(tapped[direction].len + nbyte <= sizeof(tapped[direction].buf));
+
+	memcpy(&tapped[direction].buf[tapped[direction].len], buf, nbyte);
+	tapped[direction].len += nbyte;
+	tapped[direction].calls++;
+	tapped[direction].last_ns = timestamp;
+}
+
+static monome_t *make_device(monome_t *m) {
+	int sndbuf = 1;
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+
+	memset(&tapped, 0, sizeof(tapped));
+	assert(monome_set_wire_tap(m, tap, &tapped) == MONOME_OK);
+	return m;
+}
+
+static void free_device(monome_t *m) {
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+static size_t pending(monome_t *m) {
+	monome_tx_stats_t stats;
+
+	assert(monome_get_tx_stats(m, &stats) == MONOME_OK);
+	return stats.pending;
+}
+
+/* read whatever the device has been sent so far */
+static size_t receive(uint8_t *buf, size_t nbyte) {
+	ssize_t ret;
+	size_t len = 0;
+
+	while( len < nbyte && (ret = read(fds[1], &buf[len], nbyte - len)) > 0 )
+		len += ret;
+
+	return len;
+}
+
+static uint8_t stream[1 << 18];
+
+/* --- tests --- */
+
+static void test_sees_input(void) {
+	monome_t *m = make_device(monome_protocol_mext_new());
+	uint8_t in[] = {0x21, 1, 2, 0xf0, 0x20, 1, 2};
+	monome_event_t events[4];
+	uint64_t stamps[4];
+
+	assert(write(fds[1], in, sizeof(in)) == sizeof(in));
+	assert(monome_event_next_batch_ts(m, events, stamps, 4) == 2);
+
+	/* the bytes as read, noise and all, stamped like their events */
+	assert(tapped[MONOME_WIRE_IN].len == sizeof(in));
+	assert(!memcmp(tapped[MONOME_WIRE_IN].buf, in, sizeof(in)));
+	assert(tapped[MONOME_WIRE_IN].last_ns == stamps[0]);
+	assert(tapped[MONOME_WIRE_OUT].calls == 0);
+
+	free_device(m);
+}
+
+static void test_sees_output(void) {
+	monome_t *m = make_device(monome_protocol_mext_new());
+	const uint8_t expect[] = {LEVEL_SET_HEADER, 3, 4, 15};
+	uint64_t before = monome_get_time_ns();
+
+	assert(monome_led_level_set(m, 3, 4, 15) >= 0);
+
+	assert(tapped[MONOME_WIRE_OUT].calls == 1);
+	assert(tapped[MONOME_WIRE_OUT].len == sizeof(expect));
+	assert(!memcmp(tapped[MONOME_WIRE_OUT].buf, expect, sizeof(expect)));
+	assert(tapped[MONOME_WIRE_OUT].last_ns >= before);
+
+	free_device(m);
+}
+
+static void test_short_writes_seen_once(void) {
+	monome_t *m = make_device(monome_protocol_mext_new());
+	unsigned int seq;
+	size_t len = 0;
+
+	for( seq = 0; !pending(m) || seq < 500; seq++ ) {
+		assert(seq < 100000);
+		assert(monome_led_level_set(m, seq & 15, (seq >> 4) & 15, 15) >= 0);
+	}
+
+	/* nothing is tapped until the tty takes it */
+	assert(tapped[MONOME_WIRE_OUT].len < seq * 4);
+
+	while( pending(m) ) {
+		len += receive(&stream[len], sizeof(stream) - len);
+		assert(monome_flush(m) == MONOME_OK);
+	}
+
+	len += receive(&stream[len], sizeof(stream) - len);
+
+	assert(len == seq * 4);
+	assert(tapped[MONOME_WIRE_OUT].len == len);
+	assert(!memcmp(tapped[MONOME_WIRE_OUT].buf, stream, len));
+	assert(tapped[MONOME_WIRE_OUT].calls > 1);
+
+	free_device(m);
+}
+
+static void test_series_output(void) {
+	monome_t *m = make_device(monome_protocol_series_new());
+	uint8_t row[2] = {0xff, 0x0f};
+	uint8_t buf[16];
+	size_t len;
+
+	m->rows = 8;
+	m->cols = 8;
+
+	/* a single led, and a row */
+	assert(monome_led_on(m, 1, 2) >= 0);
+	assert(monome_led_row(m, 0, 3, 1, row) >= 0);
+
+	len = receive(buf, sizeof(buf));
+	assert(len >= 4);
+	assert(tapped[MONOME_WIRE_OUT].len == len);
+	assert(!memcmp(tapped[MONOME_WIRE_OUT].buf, buf, len));
+
+	free_device(m);
+}
+
+static void test_removed_tap_is_quiet(void) {
+	monome_t *m = make_device(monome_protocol_mext_new());
+	uint8_t in[] = {0x21, 1, 2};
+	monome_event_t e;
+
+	assert(monome_set_wire_tap(m, NULL, NULL) == MONOME_OK);
+
+	assert(monome_led_level_set(m, 3, 4, 15) >= 0);
+	assert(write(fds[1], in, sizeof(in)) == sizeof(in));
+	assert(monome_event_next(m, &e) == 1);
+
+	assert(!tapped[MONOME_WIRE_IN].calls && !tapped[MONOME_WIRE_OUT].calls);
+	assert(monome_set_wire_tap(NULL, tap, NULL) == MONOME_ERROR_INVALID_ARG);
+
+	free_device(m);
+}
+
+int main(void) {
+	printf("test_wire_tap:\n");
+
+	RUN_TEST(test_sees_input);
+	RUN_TEST(test_sees_output);
+	RUN_TEST(test_short_writes_seen_once);
+	RUN_TEST(test_series_output);
+	RUN_TEST(test_removed_tap_is_quiet);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
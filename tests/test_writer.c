@@ -0,0 +1,230 @@
+/**
+ * Tests for the per-device writer thread (writer.c). A mext device writes
+ * into a stream socketpair while several threads make led calls at once;
+ * the test reads the byte stream back and checks that every message
+ * arrived whole.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "protocol.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define RUN_TEST(fn) do { \
+	tests_run++; \
+	printf("  %-50s", #fn); \
+	fn(); \
+	tests_passed++; \
+	printf("PASS\n"); \
+} while(0)
+
+/* mext CMD_LED_LEVEL_SET on SS_LED_GRID: header, x, y, level */
+#define LEVEL_SET_HEADER 0x18
+
+#define THREADS 4
+#define CALLS_PER_THREAD 2000
+
+static int fds[2];
+
+static monome_t *make_mext(void) {
+	monome_t *m = monome_protocol_mext_new();
+
+	assert(m);
+	assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	m->fd = fds[0];
+	m->rows = 16;
+	m->cols = 16;
+	m->rotation = MONOME_ROTATE_0;
+	return m;
+}
+
+static void free_mext(monome_t *m) {
+	close(fds[0]);
+	close(fds[1]);
+	m->free(m);
+}
+
+/* everything the device has been sent so far */
+static size_t sent(uint8_t *buf, size_t nbyte) {
+	ssize_t ret;
+	size_t len = 0;
+
+	while( len < nbyte && (ret = read(fds[1], &buf[len], nbyte - len)) > 0 )
+		len += ret;
+
+	return len;
+}
+
+/* --- tests --- */
+
+static void test_start_stop(void) {
+	monome_t *m = make_mext();
+
+	assert(monome_writer_start(m, 0) == MONOME_OK);
+	assert(monome_writer_start(m, 0) == MONOME_ERROR_INVALID_ARG);
+	assert(monome_writer_stop(m) == MONOME_OK);
+	assert(monome_writer_stop(m) == MONOME_ERROR_INVALID_ARG);
+
+	free_mext(m);
+}
+
+static void test_single_thread_order(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[64];
+	int i;
+
+	assert(monome_writer_start(m, 16) == MONOME_OK);
+
+	for( i = 0; i < 8; i++ )
+		assert(monome_led_level_set(m, i, 1, i) >= 0);
+
+	/* stopping drains the queue */
+	assert(monome_writer_stop(m) == MONOME_OK);
+	assert(sent(buf, sizeof(buf)) == 8 * 4);
+
+	for( i = 0; i < 8; i++ ) {
+		assert(buf[i * 4] == LEVEL_SET_HEADER);
+		assert(buf[i * 4 + 1] == i);
+		assert(buf[i * 4 + 3] == i);
+	}
+
+	free_mext(m);
+}
+
+static void test_buffered_output_goes_first(void) {
+	monome_t *m = make_mext();
+	uint8_t buf[16];
+
+	monome_set_deferred(m, 1);
+	monome_led_level_set(m, 0, 0, 1);
+
+	assert(monome_writer_start(m, 16) == MONOME_OK);
+	monome_led_level_set(m, 0, 0, 2);
+	assert(monome_writer_stop(m) == MONOME_OK);
+
+	assert(sent(buf, sizeof(buf)) == 8);
+	assert(buf[3] == 1 && buf[7] == 2);
+
+	free_mext(m);
+}
+
+static void test_paced_output_goes_first(void) {
+	monome_t *m = make_mext();
+	monome_tx_stats_t stats;
+	uint8_t buf[256];
+	int i;
+
+	/* the burst takes 20 leds, and the rest wait */
+	assert(monome_set_output_rate(m, 100) == MONOME_OK);
+
+	for( i = 0; i < 32; i++ )
+		monome_led_level_set(m, i % 16, i / 16, 1);
+
+	monome_get_tx_stats(m, &stats);
+	assert(stats.scheduled > 0);
+
+	/* they go out before the thread starts, and nothing is left for the
+	   app thread to release behind its back */
+	assert(monome_writer_start(m, 16) == MONOME_OK);
+	monome_get_tx_stats(m, &stats);
+	assert(stats.scheduled == 0);
+
+	monome_led_level_set(m, 0, 0, 2);
+	assert(monome_flush(m) == MONOME_OK);
+	assert(monome_writer_stop(m) == MONOME_OK);
+
+	assert(sent(buf, sizeof(buf)) == 33 * 4);
+	for( i = 0; i < 32; i++ )
+		assert(buf[i * 4 + 1] == i % 16 && buf[i * 4 + 2] == i / 16);
+	assert(buf[32 * 4 + 3] == 2);
+
+	/* the fake has no monome_close() to free the schedule */
+	assert(monome_set_output_rate(m, 0) == MONOME_OK);
+	free_mext(m);
+}
+
+static void *hammer(void *arg) {
+	monome_t *m = arg;
+	static int next_row;
+	int row, i, ret;
+
+	row = __atomic_fetch_add(&next_row, 1, __ATOMIC_RELAXED);
+
+	for( i = 0; i < CALLS_PER_THREAD; i++ ) {
+		/* back off if the writer's behind */
+		while( (ret = monome_led_level_set(m, i & 15, row, i & 15)) < 0 )
+			usleep(100);
+	}
+
+	return NULL;
+}
+
+static void test_concurrent_producers(void) {
+	static uint8_t buf[THREADS * CALLS_PER_THREAD * 4];
+	pthread_t threads[THREADS];
+	monome_t *m = make_mext();
+	int i, row, counts[THREADS] = {0}, expect_x[THREADS] = {0};
+	size_t len, got;
+
+	assert(monome_writer_start(m, 64) == MONOME_OK);
+
+	for( i = 0; i < THREADS; i++ )
+		assert(!pthread_create(&threads[i], NULL, hammer, m));
+
+	/* keep the socket from filling up while the threads run */
+	for( len = 0; len < sizeof(buf); len += got ) {
+		got = sent(&buf[len], sizeof(buf) - len);
+		if( !got )
+			usleep(100);
+	}
+
+	for( i = 0; i < THREADS; i++ )
+		pthread_join(threads[i], NULL);
+
+	assert(monome_writer_stop(m) == MONOME_OK);
+	assert(sent(buf, 1) == 0);
+
+	/* every message is whole, and each thread's arrive in its order */
+	for( i = 0; i < THREADS * CALLS_PER_THREAD; i++ ) {
+		assert(buf[i * 4] == LEVEL_SET_HEADER);
+
+		row = buf[i * 4 + 2];
+		assert(row < THREADS);
+		assert(buf[i * 4 + 1] == expect_x[row]);
+		assert(buf[i * 4 + 3] == expect_x[row]);
+
+		expect_x[row] = (expect_x[row] + 1) & 15;
+		counts[row]++;
+	}
+
+	for( i = 0; i < THREADS; i++ )
+		assert(counts[i] == CALLS_PER_THREAD);
+
+	free_mext(m);
+}
+
+int main(void) {
+	printf("test_writer:\n");
+
+	RUN_TEST(test_start_stop);
+	RUN_TEST(test_single_thread_order);
+	RUN_TEST(test_buffered_output_goes_first);
+	RUN_TEST(test_paced_output_goes_first);
+	RUN_TEST(test_concurrent_producers);
+
+	printf("\n%d/%d tests passed\n", tests_passed, tests_run);
+	return (tests_passed == tests_run) ? 0 : 1;
+}
@@ -0,0 +1,988 @@
+/**
+ * Copyright (c) 2026 William Light <wrl@illest.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <monome.h>
+#include "internal.h"
+#include "platform.h"
+#include "encoder.h"
+#include "trace.h"
+
+#include "mext.h"
+#include "series.h"
+#include "40h.h"
+
+/*
+ * trace-report.c:
+ *  reads traces made with monome_record_start() and reports how much of the
+ *  link they used, which commands used it, and how much of that a perfect
+ *  diff encoder would have left out. for working out how many devices, or
+ *  how high a frame rate, a rig has room for.
+ *
+ * uses the internal trace and encoder APIs, not a good idea to use in your
+ * own code!
+ */
+
+#define NS_PER_MS  1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+#define DEFAULT_WINDOW_MS 100
+
+/* longer than any message of any protocol */
+#define MAX_MESSAGE 64
+
+/* the most arc rings a mext device can address */
+#define MAX_RINGS 16
+
+typedef struct report report_t;
+
+typedef struct {
+	uint64_t count, bytes, redundant;
+	size_t size;
+} command_t;
+
+typedef struct {
+	uint64_t bytes;
+
+	/* the window being counted, and the busiest one so far */
+	uint64_t window, window_bytes;
+	uint64_t peak, over_budget;
+
+	/* a message a record ended partway through */
+	uint8_t pending[MAX_MESSAGE];
+	size_t pending_len, want;
+
+	command_t commands[256];
+} direction_t;
+
+typedef struct {
+	uint8_t *level, *known;
+} grid_state_t;
+
+typedef struct {
+	uint8_t level[MAX_RINGS][MONOME_RING_LEDS];
+	uint8_t known[MAX_RINGS][MONOME_RING_LEDS];
+} ring_state_t;
+
+/**
+ * what a protocol's messages look like. a message's length, and which
+ * command it is, follow from its first byte.
+ */
+
+typedef struct {
+	const char *proto;
+
+	uint_t (*kind)(monome_wire_direction_t dir, uint8_t header);
+	size_t (*length)(monome_wire_direction_t dir, uint8_t header);
+	const char *(*name)(monome_wire_direction_t dir, uint_t kind);
+
+	/* update the led model with an outbound message. returns 0 if it
+	   isn't an led command. */
+	int (*apply)(report_t *r, const uint8_t *msg);
+} dialect_t;
+
+struct report {
+	monome_trace_header_t header;
+	monome_led_cost_t cost;
+	const dialect_t *dialect;
+
+	uint64_t budget;            /* bytes per second each way */
+	uint64_t window_ns, frame_ns;
+	uint64_t end_ns;
+
+	direction_t dir[2];
+
+	/* the leds, in device coordinates, as the device has been told to show
+	   them and as they were at the end of the last frame */
+	uint_t rows, cols;
+	grid_state_t grid, frame_grid;
+	ring_state_t rings, frame_rings;
+	uint8_t *next, *prev;
+
+	/* the frame being put together */
+	uint64_t frame;
+	size_t frame_led_bytes;
+
+	/* set by apply() for the message it's given */
+	uint_t touched, changed, unknown;
+
+	uint64_t led_commands, led_bytes;
+	uint64_t redundant_commands, redundant_bytes;
+	uint64_t ideal_bytes;
+};
+
+/**
+ * led model
+ */
+
+static void set_level(report_t *r, uint8_t *level, uint8_t *known,
+                      uint_t value) {
+	r->touched++;
+
+	if( !*known )
+		r->unknown++;
+	else if( *level != value )
+		r->changed++;
+
+	*known = 1;
+	*level = value;
+}
+
+static void grid_set(report_t *r, uint_t x, uint_t y, uint_t level) {
+	size_t i;
+
+	if( x >= r->cols || y >= r->rows )
+		return;
+
+	i = (y * r->cols) + x;
+	set_level(r, &r->grid.level[i], &r->grid.known[i], level & 0x0F);
+}
+
+static void grid_all(report_t *r, uint_t level) {
+	uint_t x, y;
+
+	for( y = 0; y < r->rows; y++ )
+		for( x = 0; x < r->cols; x++ )
+			grid_set(r, x, y, level);
+}
+
+/* eight on/off leds, lowest bit first */
+static void grid_row_bits(report_t *r, uint_t x, uint_t y, uint8_t bits) {
+	uint_t i;
+
+	for( i = 0; i < 8; i++ )
+		grid_set(r, x + i, y, (bits & (1 << i)) ? 15 : 0);
+}
+
+static void grid_col_bits(report_t *r, uint_t x, uint_t y, uint8_t bits) {
+	uint_t i;
+
+	for( i = 0; i < 8; i++ )
+		grid_set(r, x, y + i, (bits & (1 << i)) ? 15 : 0);
+}
+
+static void ring_set(report_t *r, uint_t ring, uint_t led, uint_t level) {
+	if( ring >= MAX_RINGS )
+		return;
+
+	led %= MONOME_RING_LEDS;
+	set_level(r, &r->rings.level[ring][led], &r->rings.known[ring][led],
+	          level & 0x0F);
+}
+
+/* levels packed two to a byte, high nybble first */
+static uint_t nybble(const uint8_t *data, uint_t i) {
+	return (i & 1) ? data[i / 2] & 0x0F : data[i / 2] >> 4;
+}
+
+/**
+ * mext
+ */
+
+#define MEXT(ss, cmd) (((ss) << 4) | (cmd))
+
+static const char *mext_out_names[256] = {
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_QUERY)]          = "system_query",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GET_ID)]         = "system_get_id",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_SET_ID)]         = "system_set_id",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GET_OFFSETS)]    = "system_get_offsets",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_SET_OFFSET)]     = "system_set_offset",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GET_GRIDSZ)]     = "system_get_gridsz",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_SET_GRIDSZ)]     = "system_set_gridsz",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GET_ADDR)]       = "system_get_addr",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_SET_ADDR)]       = "system_set_addr",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GET_VERSION)]    = "system_get_version",
+
+	[MEXT(SS_LED_GRID, CMD_LED_OFF)]             = "led_off",
+	[MEXT(SS_LED_GRID, CMD_LED_ON)]              = "led_on",
+	[MEXT(SS_LED_GRID, CMD_LED_ALL_OFF)]         = "led_all_off",
+	[MEXT(SS_LED_GRID, CMD_LED_ALL_ON)]          = "led_all_on",
+	[MEXT(SS_LED_GRID, CMD_LED_MAP)]             = "led_map",
+	[MEXT(SS_LED_GRID, CMD_LED_ROW)]             = "led_row",
+	[MEXT(SS_LED_GRID, CMD_LED_COLUMN)]          = "led_col",
+	[MEXT(SS_LED_GRID, CMD_LED_INTENSITY)]       = "led_intensity",
+	[MEXT(SS_LED_GRID, CMD_LED_LEVEL_SET)]       = "led_level_set",
+	[MEXT(SS_LED_GRID, CMD_LED_LEVEL_ALL)]       = "led_level_all",
+	[MEXT(SS_LED_GRID, CMD_LED_LEVEL_MAP)]       = "led_level_map",
+	[MEXT(SS_LED_GRID, CMD_LED_LEVEL_ROW)]       = "led_level_row",
+	[MEXT(SS_LED_GRID, CMD_LED_LEVEL_COLUMN)]    = "led_level_col",
+
+	[MEXT(SS_LED_RING, CMD_LED_RING_SET)]        = "ring_set",
+	[MEXT(SS_LED_RING, CMD_LED_RING_ALL)]        = "ring_all",
+	[MEXT(SS_LED_RING, CMD_LED_RING_MAP)]        = "ring_map",
+	[MEXT(SS_LED_RING, CMD_LED_RING_RANGE)]      = "ring_range",
+	[MEXT(SS_LED_RING, CMD_LED_RING_INTENSITY)]  = "ring_intensity",
+
+	[MEXT(SS_TILT, CMD_TILT_STATE_REQ)]          = "tilt_state_req",
+	[MEXT(SS_TILT, CMD_TILT_ENABLE)]             = "tilt_enable",
+	[MEXT(SS_TILT, CMD_TILT_DISABLE)]            = "tilt_disable"
+};
+
+static const char *mext_in_names[256] = {
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_QUERY_RESPONSE)] = "system_query_response",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_ID)]             = "system_id",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GRID_OFFSET)]    = "system_grid_offset",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_GRIDSZ)]         = "system_gridsz",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_ADDR)]           = "system_addr",
+	[MEXT(SS_SYSTEM, CMD_SYSTEM_VERSION)]        = "system_version",
+
+	[MEXT(SS_KEY_GRID, CMD_KEY_UP)]              = "key_up",
+	[MEXT(SS_KEY_GRID, CMD_KEY_DOWN)]            = "key_down",
+
+	[MEXT(SS_ENCODER, CMD_ENCODER_DELTA)]        = "encoder_delta",
+	[MEXT(SS_ENCODER, CMD_ENCODER_SWITCH_UP)]    = "encoder_key_up",
+	[MEXT(SS_ENCODER, CMD_ENCODER_SWITCH_DOWN)]  = "encoder_key_down",
+
+	[MEXT(SS_TILT, CMD_TILT_STATES)]             = "tilt_states",
+	[MEXT(SS_TILT, CMD_TILT)]                    = "tilt"
+};
+
+static uint_t mext_kind(monome_wire_direction_t dir, uint8_t header) {
+	return header;
+}
+
+static size_t mext_length(monome_wire_direction_t dir, uint8_t header) {
+	if( dir == MONOME_WIRE_IN )
+		return 1 + incoming_payload_lengths[header >> 4][header & 0x0F];
+
+	return 1 + outgoing_payload_lengths[header >> 4][header & 0x0F];
+}
+
+static const char *mext_name(monome_wire_direction_t dir, uint_t kind) {
+	return (dir == MONOME_WIRE_IN) ? mext_in_names[kind] : mext_out_names[kind];
+}
+
+static int mext_apply(report_t *r, const uint8_t *msg) {
+	uint_t i;
+
+	switch( msg[0] ) {
+	case MEXT(SS_LED_GRID, CMD_LED_OFF):
+	case MEXT(SS_LED_GRID, CMD_LED_ON):
+		grid_set(r, msg[1], msg[2], (msg[0] & 1) ? 15 : 0);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_ALL_OFF):
+	case MEXT(SS_LED_GRID, CMD_LED_ALL_ON):
+		grid_all(r, (msg[0] & 1) ? 15 : 0);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_MAP):
+		for( i = 0; i < 8; i++ )
+			grid_row_bits(r, msg[1], msg[2] + i, msg[3 + i]);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_ROW):
+		grid_row_bits(r, msg[1], msg[2], msg[3]);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_COLUMN):
+		grid_col_bits(r, msg[1], msg[2], msg[3]);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_LEVEL_SET):
+		grid_set(r, msg[1], msg[2], msg[3]);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_LEVEL_ALL):
+		grid_all(r, msg[1]);
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_LEVEL_MAP):
+		for( i = 0; i < 64; i++ )
+			grid_set(r, msg[1] + (i % 8), msg[2] + (i / 8), nybble(&msg[3], i));
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_LEVEL_ROW):
+		for( i = 0; i < 8; i++ )
+			grid_set(r, msg[1] + i, msg[2], nybble(&msg[3], i));
+		break;
+
+	case MEXT(SS_LED_GRID, CMD_LED_LEVEL_COLUMN):
+		for( i = 0; i < 8; i++ )
+			grid_set(r, msg[1], msg[2] + i, nybble(&msg[3], i));
+		break;
+
+	case MEXT(SS_LED_RING, CMD_LED_RING_SET):
+		ring_set(r, msg[1], msg[2], msg[3]);
+		break;
+
+	case MEXT(SS_LED_RING, CMD_LED_RING_ALL):
+		for( i = 0; i < MONOME_RING_LEDS; i++ )
+			ring_set(r, msg[1], i, msg[2]);
+		break;
+
+	case MEXT(SS_LED_RING, CMD_LED_RING_MAP):
+		for( i = 0; i < MONOME_RING_LEDS; i++ )
+			ring_set(r, msg[1], i, nybble(&msg[2], i));
+		break;
+
+	case MEXT(SS_LED_RING, CMD_LED_RING_RANGE):
+		/* inclusive, wrapping past the last led */
+		for( i = msg[2] % MONOME_RING_LEDS;; i = (i + 1) % MONOME_RING_LEDS ) {
+			ring_set(r, msg[1], i, msg[4]);
+
+			if( i == msg[3] % MONOME_RING_LEDS )
+				break;
+		}
+		break;
+
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * series
+ */
+
+static uint_t series_kind(monome_wire_direction_t dir, uint8_t header) {
+	return header & 0xF0;
+}
+
+static size_t series_length(monome_wire_direction_t dir, uint8_t header) {
+	if( dir == MONOME_WIRE_IN )
+		return 2;
+
+	switch( header & 0xF0 ) {
+	case PROTO_SERIES_LED_ON:
+	case PROTO_SERIES_LED_OFF:
+	case PROTO_SERIES_LED_ROW_8:
+	case PROTO_SERIES_LED_COL_8:
+		return 2;
+
+	case PROTO_SERIES_LED_ROW_16:
+	case PROTO_SERIES_LED_COL_16:
+		return 3;
+
+	case PROTO_SERIES_LED_FRAME:
+		return 9;
+
+	default:
+		return 1;
+	}
+}
+
+static const char *series_name(monome_wire_direction_t dir, uint_t kind) {
+	if( dir == MONOME_WIRE_IN ) {
+		switch( kind ) {
+		case PROTO_SERIES_BUTTON_DOWN: return "key_down";
+		case PROTO_SERIES_BUTTON_UP:   return "key_up";
+		case PROTO_SERIES_TILT:        return "tilt";
+		case PROTO_SERIES_AUX_INPUT:   return "aux_input";
+		default:                       return NULL;
+		}
+	}
+
+	switch( kind ) {
+	case PROTO_SERIES_LED_ON:              return "led_on";
+	case PROTO_SERIES_LED_OFF:             return "led_off";
+	case PROTO_SERIES_LED_ROW_8:           return "led_row_8";
+	case PROTO_SERIES_LED_COL_8:           return "led_col_8";
+	case PROTO_SERIES_LED_ROW_16:          return "led_row_16";
+	case PROTO_SERIES_LED_COL_16:          return "led_col_16";
+	case PROTO_SERIES_LED_FRAME:           return "led_frame";
+	case PROTO_SERIES_CLEAR:               return "clear";
+	case PROTO_SERIES_INTENSITY:           return "intensity";
+	case PROTO_SERIES_MODE:                return "mode";
+	case PROTO_SERIES_AUX_PORT_ACTIVATE:   return "aux_port_activate";
+	case PROTO_SERIES_AUX_PORT_DEACTIVATE: return "aux_port_deactivate";
+	default:                               return NULL;
+	}
+}
+
+static int series_apply(report_t *r, const uint8_t *msg) {
+	uint_t addr = msg[0] & 0x0F, i;
+
+	switch( msg[0] & 0xF0 ) {
+	case PROTO_SERIES_LED_ON:
+	case PROTO_SERIES_LED_OFF:
+		grid_set(r, msg[1] >> 4, msg[1] & 0x0F,
+		         ((msg[0] & 0xF0) == PROTO_SERIES_LED_ON) ? 15 : 0);
+		break;
+
+	case PROTO_SERIES_LED_ROW_8:
+		grid_row_bits(r, 0, addr, msg[1]);
+		break;
+
+	case PROTO_SERIES_LED_COL_8:
+		grid_col_bits(r, addr, 0, msg[1]);
+		break;
+
+	case PROTO_SERIES_LED_ROW_16:
+		grid_row_bits(r, 0, addr, msg[1]);
+		grid_row_bits(r, 8, addr, msg[2]);
+		break;
+
+	case PROTO_SERIES_LED_COL_16:
+		grid_col_bits(r, addr, 0, msg[1]);
+		grid_col_bits(r, addr, 8, msg[2]);
+		break;
+
+	case PROTO_SERIES_LED_FRAME:
+		for( i = 0; i < 8; i++ )
+			grid_row_bits(r, (addr & 1) * 8, ((addr >> 1) & 1) * 8 + i,
+			              msg[1 + i]);
+		break;
+
+	case PROTO_SERIES_CLEAR:
+		grid_all(r, (msg[0] & 1) ? 15 : 0);
+		break;
+
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * 40h
+ */
+
+static uint_t proto_40h_kind(monome_wire_direction_t dir, uint8_t header) {
+	return header & 0xF0;
+}
+
+static size_t proto_40h_length(monome_wire_direction_t dir, uint8_t header) {
+	return 2;
+}
+
+static const char *proto_40h_name(monome_wire_direction_t dir, uint_t kind) {
+	if( dir == MONOME_WIRE_IN ) {
+		switch( kind ) {
+		case PROTO_40h_BUTTON_UP: return "key";
+		case PROTO_40h_AUX_1:     return "aux";
+		default:                  return NULL;
+		}
+	}
+
+	switch( kind ) {
+	case PROTO_40h_LED_OFF:    return "led_set";
+	case PROTO_40h_INTENSITY:  return "intensity";
+	case PROTO_40h_LED_TEST:   return "led_test";
+	case PROTO_40h_ADC_ENABLE: return "adc_enable";
+	case PROTO_40h_SHUTDOWN:   return "shutdown";
+	case PROTO_40h_LED_ROW:    return "led_row";
+	case PROTO_40h_LED_COL:    return "led_col";
+	default:                   return NULL;
+	}
+}
+
+static int proto_40h_apply(report_t *r, const uint8_t *msg) {
+	switch( msg[0] & 0xF0 ) {
+	case PROTO_40h_LED_OFF:
+		grid_set(r, msg[1] >> 4, msg[1] & 0x0F, (msg[0] & 1) ? 15 : 0);
+		break;
+
+	case PROTO_40h_LED_ROW:
+		grid_row_bits(r, 0, msg[0] & 0x07, msg[1]);
+		break;
+
+	case PROTO_40h_LED_COL:
+		grid_col_bits(r, msg[0] & 0x07, 0, msg[1]);
+		break;
+
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+static const dialect_t dialects[] = {
+	{"mext", mext_kind, mext_length, mext_name, mext_apply},
+	{"series", series_kind, series_length, series_name, series_apply},
+	{"40h", proto_40h_kind, proto_40h_length, proto_40h_name, proto_40h_apply}
+};
+
+/**
+ * ideal encoder
+ */
+
+/* what a perfect encoder working from the last frame's leds would have
+   sent. leds that have never been set are left out, and leds set for the
+   first time this frame count as changed. */
+static size_t ideal_grid_cost(report_t *r) {
+	monome_encoder_plan_t plan;
+	size_t i, n = r->rows * r->cols;
+
+	if( !n )
+		return 0;
+
+	for( i = 0; i < n; i++ ) {
+		if( !r->grid.known[i] )
+			r->next[i] = r->prev[i] = 0;
+		else {
+			r->next[i] = r->grid.level[i];
+
+			/* a level that differs whether or not the device is
+			   monobright */
+			if( r->frame_grid.known[i] )
+				r->prev[i] = r->frame_grid.level[i];
+			else
+				r->prev[i] = 15 - r->grid.level[i];
+		}
+	}
+
+	return monome_encoder_plan(&r->cost, r->next, r->prev, r->rows, r->cols,
+	                           &plan);
+}
+
+static size_t ideal_ring_cost(report_t *r) {
+	uint8_t next[MONOME_RING_LEDS], prev[MONOME_RING_LEDS];
+	monome_ring_plan_t plan;
+	size_t bytes = 0;
+	uint_t ring, i;
+
+	for( ring = 0; ring < MAX_RINGS; ring++ ) {
+		if( !memcmp(r->rings.level[ring], r->frame_rings.level[ring],
+		            MONOME_RING_LEDS)
+		    && !memcmp(r->rings.known[ring], r->frame_rings.known[ring],
+		               MONOME_RING_LEDS) )
+			continue;
+
+		for( i = 0; i < MONOME_RING_LEDS; i++ ) {
+			if( !r->rings.known[ring][i] )
+				next[i] = prev[i] = 0;
+			else {
+				next[i] = r->rings.level[ring][i];
+
+				if( r->frame_rings.known[ring][i] )
+					prev[i] = r->frame_rings.level[ring][i];
+				else
+					prev[i] = 15 - r->rings.level[ring][i];
+			}
+		}
+
+		bytes += monome_encoder_ring_plan(&r->cost, next, prev, &plan);
+	}
+
+	return bytes;
+}
+
+static void frame_end(report_t *r) {
+	size_t n = r->rows * r->cols;
+
+	if( !r->frame_led_bytes )
+		return;
+
+	r->ideal_bytes += ideal_grid_cost(r) + ideal_ring_cost(r);
+	r->frame_led_bytes = 0;
+
+	memcpy(r->frame_grid.level, r->grid.level, n);
+	memcpy(r->frame_grid.known, r->grid.known, n);
+	r->frame_rings = r->rings;
+}
+
+/**
+ * counting
+ */
+
+static void count_message(report_t *r, monome_wire_direction_t dir,
+                          const uint8_t *msg, size_t len) {
+	command_t *c = &r->dir[dir].commands[r->dialect->kind(dir, msg[0])];
+
+	c->count++;
+	c->bytes += len;
+	c->size = len;
+
+	if( dir != MONOME_WIRE_OUT )
+		return;
+
+	r->touched = r->changed = r->unknown = 0;
+
+	if( !r->dialect->apply(r, msg) )
+		return;
+
+	r->led_commands++;
+	r->led_bytes += len;
+	r->frame_led_bytes += len;
+
+	if( r->touched && !r->changed && !r->unknown ) {
+		c->redundant++;
+		r->redundant_commands++;
+		r->redundant_bytes += len;
+	}
+}
+
+/* split a record into messages, carrying over any it ends partway through */
+static void feed(report_t *r, monome_wire_direction_t dir,
+                 const uint8_t *buf, size_t nbyte) {
+	direction_t *d = &r->dir[dir];
+	size_t take;
+
+	while( nbyte ) {
+		if( !d->pending_len ) {
+			d->want = r->dialect->length(dir, buf[0]);
+
+			if( nbyte >= d->want ) {
+				count_message(r, dir, buf, d->want);
+				buf += d->want;
+				nbyte -= d->want;
+				continue;
+			}
+		}
+
+		take = d->want - d->pending_len;
+		if( take > nbyte )
+			take = nbyte;
+
+		memcpy(&d->pending[d->pending_len], buf, take);
+		d->pending_len += take;
+		buf += take;
+		nbyte -= take;
+
+		if( d->pending_len == d->want ) {
+			count_message(r, dir, d->pending, d->want);
+			d->pending_len = 0;
+		}
+	}
+}
+
+static void window_end(report_t *r, direction_t *d) {
+	if( d->window_bytes > d->peak )
+		d->peak = d->window_bytes;
+
+	if( d->window_bytes * NS_PER_SEC > r->budget * r->window_ns )
+		d->over_budget++;
+
+	d->window_bytes = 0;
+}
+
+static void count_bytes(report_t *r, direction_t *d, uint64_t ns,
+                        size_t nbyte) {
+	uint64_t window = ns / r->window_ns;
+
+	if( window != d->window ) {
+		window_end(r, d);
+		d->window = window;
+	}
+
+	d->bytes += nbyte;
+	d->window_bytes += nbyte;
+}
+
+/**
+ * output
+ */
+
+static double per_sec(uint64_t bytes, uint64_t ns) {
+	return ns ? (double) bytes * NS_PER_SEC / ns : 0;
+}
+
+static double percent(double part, double whole) {
+	return whole ? 100 * part / whole : 0;
+}
+
+static void print_link(report_t *r) {
+	static const char *names[] = {"in", "out"};
+	double avg, peak;
+	int i;
+
+	printf("             bytes      avg/s    link     peak/s    link"
+	       "   windows over\n");
+
+	for( i = MONOME_WIRE_IN; i <= MONOME_WIRE_OUT; i++ ) {
+		avg = per_sec(r->dir[i].bytes, r->end_ns);
+		peak = per_sec(r->dir[i].peak, r->window_ns);
+
+		printf("  %-4s %12llu %10.0f %6.1f%% %10.0f %6.1f%% %14llu\n",
+		       names[i], (unsigned long long) r->dir[i].bytes,
+		       avg, percent(avg, r->budget),
+		       peak, percent(peak, r->budget),
+		       (unsigned long long) r->dir[i].over_budget);
+	}
+}
+
+static void print_commands(report_t *r, monome_wire_direction_t dir) {
+	direction_t *d = &r->dir[dir];
+	uint_t order[256], n = 0, i, j, t;
+	const char *name;
+	char unknown[8];
+
+	for( i = 0; i < 256; i++ )
+		if( d->commands[i].count )
+			order[n++] = i;
+
+	if( !n )
+		return;
+
+	/* busiest first */
+	for( i = 1; i < n; i++ )
+		for( j = i; j > 0 && d->commands[order[j]].bytes
+		                     > d->commands[order[j - 1]].bytes; j-- ) {
+			t = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = t;
+		}
+
+	printf("\n  %-22s %4s %12s %12s %6s",
+	       (dir == MONOME_WIRE_IN) ? "in" : "out",
+	       "size", "count", "bytes", "share");
+
+	if( dir == MONOME_WIRE_OUT )
+		printf(" %10s", "redundant");
+
+	printf("\n");
+
+	for( i = 0; i < n; i++ ) {
+		command_t *c = &d->commands[order[i]];
+
+		if( !(name = r->dialect->name(dir, order[i])) ) {
+			snprintf(unknown, sizeof(unknown), "0x%02x", order[i]);
+			name = unknown;
+		}
+
+		printf("  %-22s %4zu %12llu %12llu %5.1f%%", name, c->size,
+		       (unsigned long long) c->count, (unsigned long long) c->bytes,
+		       percent(c->bytes, d->bytes));
+
+		if( dir == MONOME_WIRE_OUT )
+			printf(" %10llu", (unsigned long long) c->redundant);
+
+		printf("\n");
+	}
+}
+
+static void print_report(report_t *r, const char *path) {
+	printf("%s: %s (%s), %s, %ux%u\n", path, r->header.friendly,
+	       r->header.serial, r->header.proto, r->header.cols, r->header.rows);
+	printf("  %.3f s, link budget %llu bytes/s each way (%llu baud)\n\n",
+	       (double) r->end_ns / NS_PER_SEC, (unsigned long long) r->budget,
+	       (unsigned long long) r->budget * 10);
+
+	print_link(r);
+	printf("  (peaks over %llu ms windows)\n",
+	       (unsigned long long) (r->window_ns / NS_PER_MS));
+
+	print_commands(r, MONOME_WIRE_OUT);
+	print_commands(r, MONOME_WIRE_IN);
+
+	printf("\n  led commands: %llu, %llu bytes\n",
+	       (unsigned long long) r->led_commands,
+	       (unsigned long long) r->led_bytes);
+	printf("  redundant: %llu, %llu bytes (%.1f%%)\n",
+	       (unsigned long long) r->redundant_commands,
+	       (unsigned long long) r->redundant_bytes,
+	       percent(r->redundant_bytes, r->led_bytes));
+
+	if( r->frame_ns )
+		printf("  ideal diff encoder, %llu ms frames: ",
+		       (unsigned long long) (r->frame_ns / NS_PER_MS));
+	else
+		printf("  ideal diff encoder, per write: ");
+
+	printf("%llu bytes, %.1f%% saved\n", (unsigned long long) r->ideal_bytes,
+	       percent((double) r->led_bytes - (double) r->ideal_bytes,
+	               r->led_bytes));
+}
+
+/**
+ * reading
+ */
+
+static const dialect_t *find_dialect(const char *proto) {
+	size_t i;
+
+	for( i = 0; i < sizeof(dialects) / sizeof(*dialects); i++ )
+		if( !strcmp(dialects[i].proto, proto) )
+			return &dialects[i];
+
+	return NULL;
+}
+
+/* the replay of a trace has the device's own led costs */
+static void load_cost(report_t *r, const char *path) {
+	monome_t blank, *monome;
+
+	if( (monome = monome_open_replay(path, MONOME_REPLAY_FAST)) ) {
+		r->cost = *monome_encoder_cost(monome);
+		monome_close(monome);
+		return;
+	}
+
+	memset(&blank, 0, sizeof(blank));
+	r->cost = *monome_encoder_cost(&blank);
+}
+
+static int report_on(const char *path, uint64_t budget, uint64_t window_ns,
+                     uint64_t frame_ns) {
+	monome_trace_cursor_t cursor;
+	monome_trace_record_t record;
+	const void *map;
+	report_t *r;
+	size_t size, n;
+	uint8_t *leds;
+	int ret = -1;
+
+	if( !(map = m_map_file(path, &size)) ) {
+		fprintf(stderr, "%s: couldn't read\n", path);
+		return -1;
+	}
+
+	if( !(r = calloc(1, sizeof(*r))) )
+		goto err_alloc;
+
+	if( monome_trace_open(map, size, &r->header, &cursor) ) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		goto err_trace;
+	}
+
+	if( !(r->dialect = find_dialect(r->header.proto)) ) {
+		fprintf(stderr, "%s: don't know %s\n", path, r->header.proto);
+		goto err_trace;
+	}
+
+	r->rows = r->header.rows;
+	r->cols = r->header.cols;
+	n = r->rows * r->cols;
+
+	if( !(leds = calloc(6, n ? n : 1)) )
+		goto err_trace;
+
+	r->grid.level = leds;
+	r->grid.known = leds + n;
+	r->frame_grid.level = leds + (2 * n);
+	r->frame_grid.known = leds + (3 * n);
+	r->next = leds + (4 * n);
+	r->prev = leds + (5 * n);
+
+	load_cost(r, path);
+
+	if( budget )
+		r->budget = budget;
+	else if( r->header.link_rate )
+		r->budget = r->header.link_rate;
+	else
+		r->budget = MONOME_LINK_RATE(NO_QUIRKS);
+
+	r->window_ns = window_ns;
+	r->frame_ns = frame_ns;
+
+	while( (ret = monome_trace_next(&cursor, &record)) > 0 ) {
+		if( record.ns > r->end_ns )
+			r->end_ns = record.ns;
+
+		count_bytes(r, &r->dir[record.direction], record.ns, record.nbyte);
+
+		if( record.direction == MONOME_WIRE_OUT && r->frame_ns
+		    && record.ns / r->frame_ns != r->frame ) {
+			frame_end(r);
+			r->frame = record.ns / r->frame_ns;
+		}
+
+		feed(r, record.direction, record.data, record.nbyte);
+
+		if( record.direction == MONOME_WIRE_OUT && !r->frame_ns )
+			frame_end(r);
+	}
+
+	if( ret < 0 )
+		fprintf(stderr, "%s: corrupt after %zu bytes, reporting up to there\n",
+		        path, cursor.pos);
+
+	frame_end(r);
+	window_end(r, &r->dir[MONOME_WIRE_IN]);
+	window_end(r, &r->dir[MONOME_WIRE_OUT]);
+
+	print_report(r, path);
+	ret = 0;
+
+	free(leds);
+err_trace:
+	free(r);
+err_alloc:
+	m_unmap_file(map, size);
+	return ret;
+}
+
+static void usage(const char *app) {
+	printf("usage: %s [options] <trace> [<trace>...]\n"
+		   "\n"
+		   "  -h, --help			display this information\n"
+		   "\n"
+		   "  -b, --baud <baud>		the link's speed, instead of the trace's\n"
+		   "  -w, --window <ms>		window to find peak rates over (default %d)\n"
+		   "  -f, --frame <ms>		group writes into frames this long for the\n"
+		   "				ideal encoder (default: each write alone)\n"
+		   "\n", app, DEFAULT_WINDOW_MS);
+}
+
+int main(int argc, char **argv) {
+	uint64_t budget, window_ms, frame_ms;
+	int c, i, failed;
+
+	struct option arguments[] = {
+		{"help",   no_argument,       0, 'h'},
+		{"baud",   required_argument, 0, 'b'},
+		{"window", required_argument, 0, 'w'},
+		{"frame",  required_argument, 0, 'f'},
+		{0, 0, 0, 0}
+	};
+
+	budget = 0;
+	window_ms = DEFAULT_WINDOW_MS;
+	frame_ms = 0;
+	i = 0;
+
+	while( (c = getopt_long(argc, argv, "hb:w:f:", arguments, &i)) > 0 )
+		switch( c ) {
+		case 'h':
+			usage(argv[0]);
+			return 1;
+
+		case 'b':
+			/* 8N1, ten bits to a byte */
+			budget = strtoull(optarg, NULL, 10) / 10;
+			break;
+
+		case 'w':
+			window_ms = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'f':
+			frame_ms = strtoull(optarg, NULL, 10);
+			break;
+
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+
+	if( optind >= argc || !window_ms ) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	for( failed = 0, i = optind; i < argc; i++ ) {
+		if( i > optind )
+			printf("\n");
+
+		if( report_on(argv[i], budget, window_ms * NS_PER_MS,
+		              frame_ms * NS_PER_MS) )
+			failed = 1;
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}